@@ -0,0 +1,407 @@
+#include "batch.h"
+#include "hostclock.h"
+#include "sched.h"
+#include "vm.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BATCH_LINE_MAX  4096
+#define BATCH_FIELDS_MAX 256
+#define BATCH_FAIL_LIST 20
+
+typedef struct {
+    char*    path;
+    VmxImage img;
+    bool     ok;
+    u32      jobs;
+    u32      failed;
+    uint64_t ns;
+} BatchProgram;
+
+typedef struct {
+    char*  text;          /* línea del manifiesto; los campos apuntan adentro */
+    int    lineno;
+    int    prog;
+    char*  in_path;
+    char*  out_path;
+    char** params;
+    int    argc;
+    char*  dump;          /* VMI si se corta por cuota */
+
+    int      rc;
+    uint64_t t0;
+    uint64_t ns;
+    uint64_t insns;
+} BatchJob;
+
+typedef struct {
+    BatchProgram* progs;
+    int           nprogs;
+    BatchJob*     jobs;
+    int           njobs;
+    u32           ram_kib;
+    const VmLimits* limits;
+
+    atomic_int      next;
+    pthread_mutex_t out_lock;
+} Batch;
+
+static int find_or_add_program(Batch* b, const char* path){
+    for (int i = 0; i < b->nprogs; i++){
+        if (strcmp(b->progs[i].path, path) == 0) return i;
+    }
+    BatchProgram* p = (BatchProgram*)realloc(b->progs, (size_t)(b->nprogs + 1) * sizeof *p);
+    if (!p) return -1;
+    b->progs = p;
+    memset(&p[b->nprogs], 0, sizeof *p);
+    p[b->nprogs].path = strdup(path);
+    return b->nprogs++;
+}
+
+static bool parse_manifest(Batch* b, const char* path){
+    FILE* f = fopen(path, "r");
+    if (!f){
+        fprintf(stderr, "Error: no pude abrir el manifiesto %s\n", path);
+        return false;
+    }
+
+    char line[BATCH_LINE_MAX];
+    int lineno = 0;
+    int cap = 0;
+    while (fgets(line, sizeof line, f)){
+        lineno++;
+        if (!strchr(line, '\n') && !feof(f)){
+            fprintf(stderr, "%s:%d: linea demasiado larga (max %d bytes)\n", path, lineno, BATCH_LINE_MAX - 2);
+            fclose(f);
+            return false;
+        }
+        char* p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == 0 || *p == '\n' || *p == '\r' || *p == '#') continue;
+
+        if (b->njobs == cap){
+            cap = cap ? cap * 2 : 64;
+            BatchJob* nj = (BatchJob*)realloc(b->jobs, (size_t)cap * sizeof *nj);
+            if (!nj){ fclose(f); return false; }
+            b->jobs = nj;
+        }
+        BatchJob* j = &b->jobs[b->njobs];
+        memset(j, 0, sizeof *j);
+        j->lineno = lineno;
+        j->text = strdup(p);
+
+        /* separa los campos en el lugar */
+        char* fields[BATCH_FIELDS_MAX];
+        int n = 0;
+        char* save = NULL;
+        char* t = strtok_r(j->text, " \t\r\n", &save);
+        for (; t && n < BATCH_FIELDS_MAX; t = strtok_r(NULL, " \t\r\n", &save)){
+            fields[n++] = t;
+        }
+        if (t){
+            fprintf(stderr, "%s:%d: demasiados campos (max %d)\n", path, lineno, BATCH_FIELDS_MAX);
+            free(j->text);
+            fclose(f);
+            return false;
+        }
+        if (n < 3){
+            fprintf(stderr, "%s:%d: se esperaba 'programa entrada salida [params...]'\n", path, lineno);
+            free(j->text);
+            fclose(f);
+            return false;
+        }
+
+        j->prog = find_or_add_program(b, fields[0]);
+        if (j->prog < 0){ free(j->text); fclose(f); return false; }
+        j->in_path  = fields[1];
+        j->out_path = fields[2];
+        j->argc     = n - 3;
+        if (j->argc > 0){
+            j->params = (char**)malloc((size_t)j->argc * sizeof(char*));
+            if (!j->params){ free(j->text); fclose(f); return false; }
+            memcpy(j->params, &fields[3], (size_t)j->argc * sizeof(char*));
+        }
+        b->njobs++;
+    }
+    fclose(f);
+    return true;
+}
+
+static bool write_output(Batch* b, BatchJob* j, const VmOutBuf* out){
+    if (strcmp(j->out_path, "-") == 0){
+        pthread_mutex_lock(&b->out_lock);
+        if (out->len) fwrite(out->data, 1, out->len, stdout);
+        fflush(stdout);
+        pthread_mutex_unlock(&b->out_lock);
+        return true;
+    }
+
+    FILE* f = fopen(j->out_path, "wb");
+    if (!f){
+        fprintf(stderr, "Error: no pude crear %s (linea %d)\n", j->out_path, j->lineno);
+        return false;
+    }
+    bool ok = fwrite(out->data, 1, out->len, f) == out->len;
+    if (fclose(f) != 0) ok = false;
+    if (!ok) fprintf(stderr, "Error: no pude escribir %s\n", j->out_path);
+    return ok;
+}
+
+/* cuotas por trabajo; cada uno vuelca en PREFIJO.<linea>.vmi */
+static void job_limits(Batch* b, BatchJob* j, VM* vm){
+    if (!b->limits) return;
+    vm->limits = *b->limits;
+    vm->limits.dump_path = NULL;
+    if (!b->limits->dump_path) return;
+    size_t n = strlen(b->limits->dump_path) + 24;
+    free(j->dump);
+    j->dump = (char*)malloc(n);
+    if (!j->dump) return;
+    snprintf(j->dump, n, "%s.%d.vmi", b->limits->dump_path, j->lineno);
+    vm->limits.dump_path = j->dump;
+}
+
+static void run_job(Batch* b, BatchJob* j){
+    const BatchProgram* p = &b->progs[j->prog];
+    uint64_t t0 = host_now_ns();
+    j->rc = BATCH_RC_IO;
+
+    if (!p->ok){
+        j->ns = host_now_ns() - t0;
+        return;
+    }
+
+    FILE* in = NULL;
+    if (strcmp(j->in_path, "-") != 0){
+        in = fopen(j->in_path, "r");
+        if (!in){
+            fprintf(stderr, "Error: no pude abrir %s (linea %d)\n", j->in_path, j->lineno);
+            j->ns = host_now_ns() - t0;
+            return;
+        }
+    }
+
+    VM* vm = (VM*)malloc(sizeof *vm);
+    if (!vm){
+        if (in) fclose(in);
+        j->ns = host_now_ns() - t0;
+        return;
+    }
+    vm_init_job(vm, b->ram_kib, p->path, j->argc);
+    job_limits(b, j, vm);
+
+    /* la salida se junta en memoria y se escribe de una vez al terminar */
+    VmOutBuf out = {0};
+    vmio_stdio(&vm->io, in, NULL);
+    vmio_capture(&vm->io, &out);
+
+    if (vm_load_image(vm, &p->img, j->params, j->argc)){
+        j->rc = vm_run(vm);
+        j->insns = vm->stats.insns;
+    }
+    if (in) fclose(in);
+
+    if (!write_output(b, j, &out) && j->rc == 0){
+        j->rc = BATCH_RC_IO;
+    }
+    vmio_outbuf_free(&out);
+    vm_release(vm);
+    free(vm);
+    j->ns = host_now_ns() - t0;
+}
+
+static void sched_job_done(void* arg, VM* vm, int rc){
+    BatchJob* j = (BatchJob*)arg;
+    j->rc    = rc;
+    j->insns = vm->stats.insns;
+    j->ns    = host_now_ns() - j->t0;
+    vm_release(vm);
+    free(vm);
+}
+
+/* modo --sched: la entrada se lee sin bloquear y la salida se escribe al
+   final de cada rebanada, así sirve para sesiones interactivas (FIFOs, ttys) */
+static void spawn_job(Batch* b, Sched* s, BatchJob* j){
+    const BatchProgram* p = &b->progs[j->prog];
+    j->t0 = host_now_ns();
+    j->rc = BATCH_RC_IO;
+    if (!p->ok) return;
+
+    int in_fd = -1;
+    if (strcmp(j->in_path, "-") != 0){
+        in_fd = open(j->in_path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (in_fd < 0){
+            fprintf(stderr, "Error: no pude abrir %s (linea %d)\n", j->in_path, j->lineno);
+            return;
+        }
+    }
+    int out_fd = STDOUT_FILENO;
+    if (strcmp(j->out_path, "-") != 0){
+        out_fd = open(j->out_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (out_fd < 0){
+            fprintf(stderr, "Error: no pude crear %s (linea %d)\n", j->out_path, j->lineno);
+            if (in_fd >= 0) close(in_fd);
+            return;
+        }
+    }
+
+    VM* vm = (VM*)malloc(sizeof *vm);
+    if (vm){
+        vm_init_job(vm, b->ram_kib, p->path, j->argc);
+        job_limits(b, j, vm);
+    }
+    if (!vm || !vm_load_image(vm, &p->img, j->params, j->argc) ||
+        !sched_spawn(s, vm, in_fd, out_fd, sched_job_done, j)){
+        free(vm);
+        if (in_fd >= 0) close(in_fd);
+        if (out_fd > STDERR_FILENO) close(out_fd);
+        j->ns = host_now_ns() - j->t0;
+    }
+}
+
+static void* worker_main(void* arg){
+    Batch* b = (Batch*)arg;
+    for (;;){
+        int i = atomic_fetch_add_explicit(&b->next, 1, memory_order_relaxed);
+        if (i >= b->njobs) break;
+        run_job(b, &b->jobs[i]);
+    }
+    return NULL;
+}
+
+static void batch_report(const Batch* b, unsigned threads, uint64_t wall_ns, FILE* out){
+    double wall_s = (double)wall_ns / 1e9;
+    fprintf(out, "\n== batch: %d trabajos, %u hilos, %.3f s", b->njobs, threads, wall_s);
+    if (wall_ns) fprintf(out, " (%.0f trabajos/s)", (double)b->njobs / wall_s);
+    fprintf(out, " ==\n");
+
+    u32 rc_count[256] = {0};
+    uint64_t min_ns = UINT64_MAX, max_ns = 0, sum_ns = 0, insns = 0;
+    for (int i = 0; i < b->njobs; i++){
+        const BatchJob* j = &b->jobs[i];
+        rc_count[(unsigned)j->rc & 0xFFu]++;
+        if (j->ns < min_ns) min_ns = j->ns;
+        if (j->ns > max_ns) max_ns = j->ns;
+        sum_ns += j->ns;
+        insns  += j->insns;
+    }
+    if (b->njobs == 0) min_ns = 0;
+
+    fprintf(out, "codigos de salida:");
+    for (int rc = 0; rc < 256; rc++){
+        if (rc_count[rc]) fprintf(out, " %d x%u", rc, rc_count[rc]);
+    }
+    fprintf(out, "\n");
+
+    if (b->njobs){
+        fprintf(out, "tiempo por trabajo (ms): min %.3f  media %.3f  max %.3f\n",
+                (double)min_ns / 1e6, (double)sum_ns / 1e6 / b->njobs, (double)max_ns / 1e6);
+        fprintf(out, "instrucciones: %llu", (unsigned long long)insns);
+        if (wall_ns) fprintf(out, " (%.2f MIPS agregados)", (double)insns / 1e6 / wall_s);
+        fprintf(out, "\n");
+    }
+
+    fprintf(out, "\n%-32s %8s %8s %12s %10s\n", "programa", "trabajos", "errores", "total ms", "media ms");
+    for (int i = 0; i < b->nprogs; i++){
+        const BatchProgram* p = &b->progs[i];
+        fprintf(out, "%-32s %8u %8u %12.3f %10.3f\n", p->path, p->jobs, p->failed,
+                (double)p->ns / 1e6, p->jobs ? (double)p->ns / 1e6 / p->jobs : 0.0);
+    }
+
+    int shown = 0;
+    for (int i = 0; i < b->njobs && shown < BATCH_FAIL_LIST; i++){
+        const BatchJob* j = &b->jobs[i];
+        if (j->rc == 0) continue;
+        if (shown++ == 0) fprintf(out, "\ntrabajos con error:\n");
+        fprintf(out, "  linea %-6d rc=%d  %s %s -> %s\n", j->lineno, j->rc,
+                b->progs[j->prog].path, j->in_path, j->out_path);
+    }
+}
+
+int batch_run(const char* manifest, unsigned threads, uint32_t ram_kib, u32 slice, u32 idle_ms,
+              const VmLimits* limits, FILE* report){
+    Batch b;
+    memset(&b, 0, sizeof b);
+    b.ram_kib = ram_kib;
+    b.limits  = limits;
+
+    int rc = 1;
+    if (!parse_manifest(&b, manifest)) goto done;
+
+    /* cada programa se lee una sola vez; las VM solo copian desde la imagen */
+    for (int i = 0; i < b.nprogs; i++){
+        b.progs[i].ok = vmx_image_read(b.progs[i].path, &b.progs[i].img);
+    }
+
+    if (threads == 0) threads = 1;
+
+    uint64_t t0 = host_now_ns();
+    uint64_t wall_ns = 0;
+    unsigned started = 0;
+    Sched* sched = NULL;
+
+    if (slice){
+        sched = sched_create(threads, slice, idle_ms);
+        if (!sched) goto done;
+        for (int i = 0; i < b.njobs; i++) spawn_job(&b, sched, &b.jobs[i]);
+        sched_wait(sched);
+        wall_ns = host_now_ns() - t0;
+        started = threads;
+    } else {
+        if (b.njobs > 0 && threads > (unsigned)b.njobs) threads = (unsigned)b.njobs;
+
+        atomic_init(&b.next, 0);
+        pthread_mutex_init(&b.out_lock, NULL);
+
+        pthread_t* tids = (pthread_t*)calloc(threads, sizeof *tids);
+        if (tids){
+            for (; started < threads; started++){
+                if (pthread_create(&tids[started], NULL, worker_main, &b) != 0) break;
+            }
+        }
+        if (started == 0){
+            worker_main(&b);
+            started = 1;
+        } else {
+            for (unsigned i = 0; i < started; i++) pthread_join(tids[i], NULL);
+        }
+        wall_ns = host_now_ns() - t0;
+        free(tids);
+        pthread_mutex_destroy(&b.out_lock);
+    }
+
+    rc = 0;
+    for (int i = 0; i < b.njobs; i++){
+        BatchProgram* p = &b.progs[b.jobs[i].prog];
+        p->jobs++;
+        p->ns += b.jobs[i].ns;
+        if (b.jobs[i].rc != 0){
+            p->failed++;
+            rc = 1;
+        }
+    }
+
+    if (report){
+        batch_report(&b, started, wall_ns, report);
+        if (sched) sched_report(sched, report);
+    }
+    sched_destroy(sched);
+
+done:
+    for (int i = 0; i < b.njobs; i++){
+        free(b.jobs[i].params);
+        free(b.jobs[i].dump);
+        free(b.jobs[i].text);
+    }
+    free(b.jobs);
+    for (int i = 0; i < b.nprogs; i++){
+        if (b.progs[i].ok) vmx_image_free(&b.progs[i].img);
+        free(b.progs[i].path);
+    }
+    free(b.progs);
+    return rc;
+}
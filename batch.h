@@ -0,0 +1,20 @@
+#pragma once
+#include "vm.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/* Modo batch: cada línea del manifiesto es un trabajo
+       programa.vmx  entrada  salida  [param1 param2 ...]
+   '-' como entrada = sin entrada (EOF); '-' como salida = stdout del host.
+   Las líneas vacías y las que empiezan con '#' se ignoran. */
+
+#define BATCH_RC_IO 2   /* no se pudo cargar el programa o abrir/escribir archivos */
+
+/* slice = 0: un hilo por trabajo a la vez, salida completa al terminar.
+   slice > 0: todos los trabajos como tareas del planificador (sched.h),
+   'threads' hilos trabajadores y expropiación cada 'slice' instrucciones.
+   idle_ms > 0 (solo con slice): comprime las VM que esperan entrada más de idle_ms.
+   limits (puede ser NULL): cuotas de cada trabajo; limits->dump_path es un
+   prefijo y el volcado de la línea N va a PREFIJO.N.vmi */
+int batch_run(const char* manifest, unsigned threads, uint32_t ram_kib, uint32_t slice, uint32_t idle_ms,
+              const VmLimits* limits, FILE* report);
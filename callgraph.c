@@ -0,0 +1,198 @@
+#include "callgraph.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NO_NODE 0xFFFFFFFFu
+
+static u32 new_node(CallGraph* cg, u16 func, u32 parent){
+    if (cg->node_count == cg->node_cap){
+        u32 cap = cg->node_cap ? cg->node_cap * 2u : 256u;
+        CallNode* n = (CallNode*)realloc(cg->nodes, (size_t)cap * sizeof *n);
+        if (!n) return NO_NODE;
+        cg->nodes = n;
+        cg->node_cap = cap;
+    }
+    u32 id = cg->node_count++;
+    CallNode* n = &cg->nodes[id];
+    n->func = func;
+    n->parent = parent;
+    n->first_child = NO_NODE;
+    n->next_sibling = NO_NODE;
+    n->self = 0;
+    if (parent != NO_NODE){
+        n->next_sibling = cg->nodes[parent].first_child;
+        cg->nodes[parent].first_child = id;
+    }
+    return id;
+}
+
+CallGraph* callgraph_create(VM* vm){
+    CallGraph* cg = (CallGraph*)calloc(1, sizeof *cg);
+    if (!cg) return NULL;
+    cg->cur = new_node(cg, (u16)(vm->reg[IP] & 0xFFFFu), NO_NODE);
+    if (cg->cur == NO_NODE){
+        free(cg);
+        return NULL;
+    }
+    return cg;
+}
+
+void callgraph_destroy(CallGraph* cg){
+    if (!cg) return;
+    free(cg->nodes);
+    free(cg);
+}
+
+static void pop_frame(CallGraph* cg){
+    cg->depth--;
+    cg->cur = cg->nodes[cg->stack[cg->depth].node].parent;
+}
+
+void callgraph_on_call(CallGraph* cg, u16 target, u32 ret_ip, u16 slot){
+    /* frames cuya dirección de retorno ya no está en la pila (SP/BP manipulados) */
+    while (cg->depth > 0 && cg->stack[cg->depth - 1].slot <= slot){
+        pop_frame(cg);
+    }
+
+    if (cg->depth == CALLGRAPH_MAX_DEPTH){
+        cg->overflow++;
+        return;
+    }
+
+    u32 child = cg->nodes[cg->cur].first_child;
+    while (child != NO_NODE && cg->nodes[child].func != target){
+        child = cg->nodes[child].next_sibling;
+    }
+    if (child == NO_NODE){
+        child = new_node(cg, target, cg->cur);
+        if (child == NO_NODE){
+            cg->overflow++;
+            return;
+        }
+    }
+
+    ShadowFrame* f = &cg->stack[cg->depth++];
+    f->node   = child;
+    f->ret_ip = ret_ip;
+    f->slot   = slot;
+    cg->cur   = child;
+}
+
+void callgraph_on_ret(CallGraph* cg, u32 ret_ip, u16 sp){
+    u32 k = cg->depth;
+    while (k > 0 && cg->stack[k - 1].ret_ip != ret_ip) k--;
+
+    if (k > 0){
+        while (cg->depth >= k) pop_frame(cg);
+        return;
+    }
+
+    if (cg->overflow > 0){
+        cg->overflow--;
+        return;
+    }
+
+    /* RET a una dirección que no apiló ningún CALL: se trata como salto */
+    cg->unmatched++;
+    while (cg->depth > 0 && cg->stack[cg->depth - 1].slot < sp){
+        pop_frame(cg);
+    }
+}
+
+typedef struct {
+    u16      func;
+    uint64_t incl;
+    uint64_t excl;
+    uint64_t ctx;      /* contextos de llamada distintos */
+} FuncStat;
+
+static bool has_ancestor_func(CallGraph* cg, u32 node){
+    u16 f = cg->nodes[node].func;
+    for (u32 a = cg->nodes[node].parent; a != NO_NODE; a = cg->nodes[a].parent){
+        if (cg->nodes[a].func == f) return true;
+    }
+    return false;
+}
+
+void callgraph_report(CallGraph* cg, FILE* out){
+    uint64_t* total = (uint64_t*)calloc(cg->node_count, sizeof *total);
+    FuncStat* fs    = (FuncStat*)calloc(cg->node_count, sizeof *fs);
+    if (!total || !fs){
+        free(total);
+        free(fs);
+        return;
+    }
+
+    /* los hijos siempre tienen índice mayor que el padre */
+    for (u32 i = cg->node_count; i-- > 0;){
+        total[i] += cg->nodes[i].self;
+        if (cg->nodes[i].parent != NO_NODE) total[cg->nodes[i].parent] += total[i];
+    }
+
+    u32 nf = 0;
+    for (u32 i = 0; i < cg->node_count; i++){
+        u32 j = 0;
+        while (j < nf && fs[j].func != cg->nodes[i].func) j++;
+        if (j == nf){ fs[nf].func = cg->nodes[i].func; nf++; }
+        fs[j].excl += cg->nodes[i].self;
+        if (!has_ancestor_func(cg, i)) fs[j].incl += total[i];
+        if (i != 0) fs[j].ctx++;
+    }
+
+    for (u32 i = 1; i < nf; i++){
+        FuncStat k = fs[i];
+        u32 j = i;
+        while (j > 0 && fs[j-1].incl < k.incl){ fs[j] = fs[j-1]; j--; }
+        fs[j] = k;
+    }
+
+    uint64_t all = total[0] ? total[0] : 1;
+    fprintf(out, "CALL GRAPH: %llu instrucciones, %u contextos\n",
+            (unsigned long long)total[0], (unsigned)cg->node_count);
+    fprintf(out, " %-9s %14s %7s %14s %7s %9s\n", "SUB", "inclusivo", "%", "exclusivo", "%", "ctx");
+    for (u32 i = 0; i < nf; i++){
+        fprintf(out, " sub_%04X %14llu %6.2f%% %14llu %6.2f%% %9llu\n",
+                (unsigned)fs[i].func,
+                (unsigned long long)fs[i].incl, 100.0 * (double)fs[i].incl / (double)all,
+                (unsigned long long)fs[i].excl, 100.0 * (double)fs[i].excl / (double)all,
+                (unsigned long long)fs[i].ctx);
+    }
+    if (cg->unmatched){
+        fprintf(out, " (%llu RET sin CALL correspondiente)\n", (unsigned long long)cg->unmatched);
+    }
+    fputc('\n', out);
+
+    free(total);
+    free(fs);
+}
+
+bool callgraph_write_folded(CallGraph* cg, const char* path){
+    FILE* f = fopen(path, "w");
+    if (!f){
+        fprintf(stderr, "Error: no pude abrir el archivo de call graph %s\n", path);
+        return false;
+    }
+
+    u32* chain = (u32*)malloc((size_t)cg->node_count * sizeof *chain);
+    if (!chain){
+        fclose(f);
+        return false;
+    }
+
+    /* formato "collapsed stacks": raiz;...;hoja cantidad */
+    for (u32 i = 0; i < cg->node_count; i++){
+        if (!cg->nodes[i].self) continue;
+        u32 n = 0;
+        for (u32 a = i; a != NO_NODE; a = cg->nodes[a].parent) chain[n++] = a;
+        while (n-- > 0){
+            fprintf(f, "sub_%04X%c", (unsigned)cg->nodes[chain[n]].func, n ? ';' : ' ');
+        }
+        fprintf(f, "%llu\n", (unsigned long long)cg->nodes[i].self);
+    }
+
+    free(chain);
+    bool ok = (ferror(f) == 0);
+    fclose(f);
+    return ok;
+}
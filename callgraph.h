@@ -0,0 +1,45 @@
+#pragma once
+#include "vm.h"
+#include <stdint.h>
+#include <stdio.h>
+
+#define CALLGRAPH_MAX_DEPTH 4096
+
+typedef struct {
+    u16      func;       /* offset de entrada de la subrutina en el segmento de código */
+    u32      parent;
+    u32      first_child;
+    u32      next_sibling;
+    uint64_t self;       /* instrucciones ejecutadas con este nodo en el tope */
+} CallNode;
+
+typedef struct {
+    u32 node;
+    u32 ret_ip;          /* valor que apiló CALL */
+    u16 slot;            /* offset en la pila donde quedó la dirección de retorno */
+} ShadowFrame;
+
+typedef struct CallGraph {
+    CallNode*   nodes;
+    u32         node_count;
+    u32         node_cap;
+    u32         cur;
+
+    ShadowFrame stack[CALLGRAPH_MAX_DEPTH];
+    u32         depth;
+    u32         overflow;  /* CALLs que no entraron en la pila sombra */
+    uint64_t    unmatched; /* RET sin frame correspondiente (se tratan como salto) */
+} CallGraph;
+
+CallGraph* callgraph_create(VM* vm);
+void       callgraph_destroy(CallGraph* cg);
+
+static inline void callgraph_tick(CallGraph* cg){
+    cg->nodes[cg->cur].self++;
+}
+
+void callgraph_on_call(CallGraph* cg, u16 target, u32 ret_ip, u16 slot);
+void callgraph_on_ret(CallGraph* cg, u32 ret_ip, u16 sp);
+
+void callgraph_report(CallGraph* cg, FILE* out);
+bool callgraph_write_folded(CallGraph* cg, const char* path);
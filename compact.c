@@ -0,0 +1,209 @@
+#include "compact.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PACK_PAGES   ((sizeof(VM) + VM_PAGE_BYTES - 1) / VM_PAGE_BYTES)
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+#define LZ_MAX_DIST  0xFFFFu
+#define LZ_NONE      0xFFFFFFFFu
+
+struct VmPacked {
+    u32 len;                            /* bytes de data */
+    u8  present[(PACK_PAGES + 7) / 8];  /* bit i = la página i no es nula y está en data */
+    u8  data[];
+};
+
+/* LZ77 con el formato de bloque de LZ4: cada secuencia es un byte con
+   (literales << 4 | match - 4), los literales, la distancia en 2 bytes y los
+   largos que no entran en 4 bits continúan en bytes de 255. La última
+   secuencia solo tiene literales. */
+
+static size_t lz_bound(size_t n){
+    return n + n / 255 + 16;
+}
+
+static u32 lz_hash(const u8* p){
+    u32 v;
+    memcpy(&v, p, 4);
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static size_t lz_put_len(u8* out, size_t n){
+    size_t k = 0;
+    while (n >= 255){
+        out[k++] = 255;
+        n -= 255;
+    }
+    out[k++] = (u8)n;
+    return k;
+}
+
+static size_t lz_sequence(u8* out, const u8* lit, size_t nlit, size_t dist, size_t mlen){
+    size_t o = 1;
+    u8 tok = (u8)((nlit < 15 ? nlit : 15) << 4);
+    if (nlit >= 15) o += lz_put_len(out + o, nlit - 15);
+    memcpy(out + o, lit, nlit);
+    o += nlit;
+    if (mlen){
+        size_t m = mlen - LZ_MIN_MATCH;
+        tok |= (u8)(m < 15 ? m : 15);
+        out[o++] = (u8)(dist & 0xFF);
+        out[o++] = (u8)(dist >> 8);
+        if (m >= 15) o += lz_put_len(out + o, m - 15);
+    }
+    out[0] = tok;
+    return o;
+}
+
+static size_t lz_pack(const u8* in, size_t n, u8* out){
+    u32 table[1u << LZ_HASH_BITS];
+    memset(table, 0xFF, sizeof table);
+
+    size_t ip = 0, anchor = 0, op = 0;
+    while (ip + LZ_MIN_MATCH <= n){
+        u32 h = lz_hash(in + ip);
+        u32 ref = table[h];
+        table[h] = (u32)ip;
+        if (ref == LZ_NONE || ip - ref > LZ_MAX_DIST || memcmp(in + ref, in + ip, LZ_MIN_MATCH) != 0){
+            ip++;
+            continue;
+        }
+        size_t len = LZ_MIN_MATCH;
+        while (ip + len < n && in[ref + len] == in[ip + len]) len++;
+        op += lz_sequence(out + op, in + anchor, ip - anchor, ip - ref, len);
+        ip += len;
+        anchor = ip;
+    }
+    op += lz_sequence(out + op, in + anchor, n - anchor, 0, 0);
+    return op;
+}
+
+static bool lz_get_len(const u8* in, size_t n, size_t* ip, size_t* len){
+    u8 b;
+    do {
+        if (*ip >= n) return false;
+        b = in[(*ip)++];
+        *len += b;
+    } while (b == 255);
+    return true;
+}
+
+static bool lz_unpack(const u8* in, size_t n, u8* out, size_t cap){
+    size_t ip = 0, op = 0;
+    while (ip < n){
+        u8 tok = in[ip++];
+        size_t nlit = tok >> 4;
+        if (nlit == 15 && !lz_get_len(in, n, &ip, &nlit)) return false;
+        if (nlit > n - ip || nlit > cap - op) return false;
+        memcpy(out + op, in + ip, nlit);
+        ip += nlit;
+        op += nlit;
+        if (ip == n) break;
+
+        if (n - ip < 2) return false;
+        size_t dist = (size_t)in[ip] | ((size_t)in[ip + 1] << 8);
+        ip += 2;
+        size_t mlen = tok & 0x0F;
+        if (mlen == 15 && !lz_get_len(in, n, &ip, &mlen)) return false;
+        mlen += LZ_MIN_MATCH;
+        if (dist == 0 || dist > op || mlen > cap - op) return false;
+        for (size_t i = 0; i < mlen; i++, op++) out[op] = out[op - dist];   /* puede solaparse */
+    }
+    return op == cap;
+}
+
+static bool page_is_zero(const u8* p, size_t n){
+    for (size_t i = 0; i < n; i++){
+        if (p[i]) return false;
+    }
+    return true;
+}
+
+static size_t page_len(size_t i){
+    size_t off = i * VM_PAGE_BYTES;
+    return sizeof(VM) - off < VM_PAGE_BYTES ? sizeof(VM) - off : VM_PAGE_BYTES;
+}
+
+VmPacked* vm_pack(const VM* vm, u32* zero_pages){
+    if (vm->threads || vm->mem != vm->ram) return NULL;
+
+    u8 present[sizeof ((VmPacked*)0)->present];
+    memset(present, 0, sizeof present);
+
+    /* las páginas no nulas, una tras otra, para que LZ vea todo junto */
+    u8* flat = (u8*)malloc(sizeof(VM) + lz_bound(sizeof(VM)));
+    if (!flat) return NULL;
+    u8* lz = flat + sizeof(VM);
+
+    const u8* src = (const u8*)vm;
+    size_t n = 0;
+    u32 zero = 0;
+    for (size_t i = 0; i < PACK_PAGES; i++){
+        size_t len = page_len(i);
+        if (page_is_zero(src + i * VM_PAGE_BYTES, len)){
+            zero++;
+            continue;
+        }
+        present[i >> 3] |= (u8)(1u << (i & 7));
+        memcpy(flat + n, src + i * VM_PAGE_BYTES, len);
+        n += len;
+    }
+
+    size_t zlen = lz_pack(flat, n, lz);
+    VmPacked* p = (VmPacked*)malloc(sizeof *p + zlen);
+    if (p){
+        p->len = (u32)zlen;
+        memcpy(p->present, present, sizeof present);
+        memcpy(p->data, lz, zlen);
+        if (zero_pages) *zero_pages = zero;
+    }
+    free(flat);
+    return p;
+}
+
+size_t vm_packed_size(const VmPacked* p){
+    return sizeof *p + p->len;
+}
+
+VM* vm_unpack(VmPacked* p){
+    size_t n = 0;
+    for (size_t i = 0; i < PACK_PAGES; i++){
+        if (p->present[i >> 3] & (1u << (i & 7))) n += page_len(i);
+    }
+
+    VM* vm = (VM*)malloc(sizeof *vm);
+    u8* flat = (u8*)malloc(n ? n : 1);
+    if (!vm || !flat){
+        free(vm);
+        free(flat);
+        return NULL;
+    }
+    if (!lz_unpack(p->data, p->len, flat, n)){
+        /* solo puede pasar si la memoria se corrompió */
+        fprintf(stderr, "Error: VM comprimida invalida\n");
+        abort();
+    }
+
+    u8* dst = (u8*)vm;
+    size_t off = 0;
+    for (size_t i = 0; i < PACK_PAGES; i++){
+        size_t len = page_len(i);
+        if (p->present[i >> 3] & (1u << (i & 7))){
+            memcpy(dst + i * VM_PAGE_BYTES, flat + off, len);
+            off += len;
+        } else {
+            memset(dst + i * VM_PAGE_BYTES, 0, len);
+        }
+    }
+    free(flat);
+    free(p);
+
+    vm->mem = vm->ram;
+    return vm;
+}
+
+void vm_packed_free(VmPacked* p){
+    free(p);
+}
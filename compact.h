@@ -0,0 +1,25 @@
+#pragma once
+#include "vm.h"
+#include <stddef.h>
+
+/* VM dormida comprimida en memoria. Se comprime la estructura VM entera
+   (la ram es casi todo su tamaño) en páginas de VM_PAGE_BYTES: las páginas
+   nulas no se guardan y el resto va en un solo flujo LZ.
+
+   No se puede comprimir una VM con hilos invitados vivos (comparten su ram)
+   ni la VM de un hilo (su ram es de otra). */
+
+typedef struct VmPacked VmPacked;
+
+/* comprime vm (que no se modifica ni se libera); NULL si no se puede.
+   zero_pages, si no es NULL, recibe cuántas páginas nulas se omitieron */
+VmPacked* vm_pack(const VM* vm, u32* zero_pages);
+
+/* bytes ocupados por la VM comprimida */
+size_t    vm_packed_size(const VmPacked* p);
+
+/* reconstruye la VM en un bloque nuevo (malloc) y libera p;
+   NULL sin memoria, y entonces p sigue siendo válida */
+VM*       vm_unpack(VmPacked* p);
+
+void      vm_packed_free(VmPacked* p);
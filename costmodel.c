@@ -0,0 +1,127 @@
+#include "costmodel.h"
+#include "disasm.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+static void cost_defaults(CostModel* cm){
+    for (int i = 0; i < 256; i++) cm->op[i] = 1;
+    for (int i = 0x01; i <= 0x07; i++) cm->op[i] = 2;   /* saltos */
+    cm->op[0x00] = 10;  /* SYS */
+    cm->op[0x09] = 6;   /* CAS */
+    cm->op[0x0A] = 6;   /* XADD */
+    cm->op[0x0B] = 2;   /* PUSH */
+    cm->op[0x0C] = 2;   /* POP */
+    cm->op[0x0D] = 4;   /* CALL */
+    cm->op[0x0E] = 4;   /* RET */
+    cm->op[0x13] = 4;   /* MUL */
+    cm->op[0x14] = 20;  /* DIV */
+    cm->op[0x1F] = 8;   /* RND */
+
+    cm->operand[OT_NONE] = 0;
+    cm->operand[OT_REG]  = 0;
+    cm->operand[OT_IMM]  = 0;
+    cm->operand[OT_MEM]  = 3;
+
+    cm->sys[1]   = 1000;  /* lectura */
+    cm->sys[3]   = 1000;
+    cm->sys[2]   = 200;   /* escritura */
+    cm->sys[4]   = 200;
+    cm->sys[7]   = 100;
+}
+
+static int parse_opcode(const char* s){
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')){
+        unsigned long v = strtoul(s + 2, NULL, 16);
+        return v < 256 ? (int)v : -1;
+    }
+    for (int i = 0; i < 256; i++){
+        const char* m = opcode_mnemonic((u8)i);
+        if (strcmp(m, "OP?") != 0 && strcasecmp(m, s) == 0) return i;
+    }
+    return -1;
+}
+
+static int parse_operand_type(const char* s){
+    if (strcasecmp(s, "none") == 0) return OT_NONE;
+    if (strcasecmp(s, "reg")  == 0) return OT_REG;
+    if (strcasecmp(s, "imm")  == 0) return OT_IMM;
+    if (strcasecmp(s, "mem")  == 0) return OT_MEM;
+    return -1;
+}
+
+/*
+ * Formato de la tabla (una entrada por línea, '#' comenta):
+ *   op MNEMONICO|0xNN CICLOS
+ *   operand none|reg|imm|mem CICLOS
+ *   sys NUMERO CICLOS
+ */
+static bool cost_load(CostModel* cm, const char* path){
+    FILE* f = fopen(path, "r");
+    if (!f){
+        fprintf(stderr, "Error: no pude abrir la tabla de costos %s\n", path);
+        return false;
+    }
+
+    char line[256];
+    int lineno = 0;
+    while (fgets(line, sizeof line, f)){
+        lineno++;
+        char* hash = strchr(line, '#');
+        if (hash) *hash = 0;
+
+        char kind[32], key[32];
+        unsigned long cycles;
+        int n = sscanf(line, "%31s %31s %lu", kind, key, &cycles);
+        if (n <= 0) continue;
+        if (n != 3){
+            fprintf(stderr, "%s:%d: se esperaba 'tipo clave ciclos'\n", path, lineno);
+            fclose(f);
+            return false;
+        }
+
+        int idx = -1;
+        if (strcmp(kind, "op") == 0){
+            idx = parse_opcode(key);
+            if (idx >= 0) cm->op[idx] = (u32)cycles;
+        } else if (strcmp(kind, "operand") == 0){
+            idx = parse_operand_type(key);
+            if (idx >= 0) cm->operand[idx] = (u32)cycles;
+        } else if (strcmp(kind, "sys") == 0){
+            unsigned long no = strtoul(key, NULL, 0);
+            idx = no < STATS_SYS_SLOTS ? (int)no : -1;
+            if (idx >= 0) cm->sys[idx] = (u32)cycles;
+        }
+        if (idx < 0){
+            fprintf(stderr, "%s:%d: entrada desconocida '%s %s'\n", path, lineno, kind, key);
+            fclose(f);
+            return false;
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+CostModel* cost_create(const char* path){
+    CostModel* cm = (CostModel*)calloc(1, sizeof *cm);
+    if (!cm) return NULL;
+    cost_defaults(cm);
+    if (path && !cost_load(cm, path)){
+        free(cm);
+        return NULL;
+    }
+    return cm;
+}
+
+void cost_destroy(CostModel* cm){
+    free(cm);
+}
+
+void cost_report(const CostModel* cm, const VM* vm, FILE* out){
+    uint64_t n = vm->stats.insns;
+    fprintf(out, "CICLOS: %llu (%llu instrucciones, %.2f ciclos/instruccion)\n\n",
+            (unsigned long long)cm->cycles, (unsigned long long)n,
+            n ? (double)cm->cycles / (double)n : 0.0);
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "vm.h"
+#include "decoder.h"
+#include "stats.h"
+#include <stdint.h>
+#include <stdio.h>
+
+#define SYS_CYCLES 0x10u   /* EAX/EDX <- contador de ciclos virtuales (parte baja/alta) */
+
+typedef struct CostModel {
+    u32      op[256];                 /* costo base por opcode */
+    u32      operand[4];              /* extra por tipo de operando: OT_NONE..OT_MEM */
+    u32      sys[STATS_SYS_SLOTS];    /* extra fijo por número de SYS */
+    uint64_t cycles;
+} CostModel;
+
+CostModel* cost_create(const char* path);
+void       cost_destroy(CostModel* cm);
+
+static inline void cost_insn(CostModel* cm, const DecodedInst* di){
+    cm->cycles += cm->op[di->opcode] + cm->operand[di->A.type & 3] + cm->operand[di->B.type & 3];
+}
+
+static inline void cost_sys(CostModel* cm, u32 callno){
+    cm->cycles += cm->sys[callno < STATS_SYS_SLOTS ? callno : STATS_SYS_SLOTS - 1];
+}
+
+void       cost_report(const CostModel* cm, const VM* vm, FILE* out);
@@ -1,13 +1,21 @@
+#include "callgraph.h"
+#include "costmodel.h"
 #include "cpu.h"
 #include "decoder.h"
 #include "disasm.h"
+#include "gthreads.h"
+#include "hostclock.h"
 #include "memory.h"
+#include "probes.h"
+#include "procs.h"
+#include "regions.h"
+#include "systab.h"
+#include "trace.h"
 #include "vm.h"
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h> 
-#include <time.h>
 #include <ctype.h>
 
 static inline uint16_t hi16_u32(uint32_t x){ return (uint16_t)(x >> 16); }
@@ -37,9 +45,9 @@ static inline uint8_t reg_sector(const DecodedOp* op){ return (uint8_t)((op->raw
 static inline uint32_t sext_from8(uint32_t v){ return (uint32_t)(int32_t)(int8_t)(v & 0xFFu); }
 static inline uint32_t sext_from16(uint32_t v){ return (uint32_t)(int32_t)(int16_t)(v & 0xFFFFu); }
 
-static inline void term_clear(void){
-    fputs("\033[2J\033[H", stdout);
-    fflush(stdout);
+static inline void term_clear(VmIo* io){
+    vmio_printf(io, "\033[2J\033[H");
+    vmio_flush(io);
 }
 
 static int single_step(VM* vm){
@@ -51,26 +59,35 @@ static int single_step(VM* vm){
     if (off == vm->seg[seg].size) return 0;
 
     if (off > vm->seg[seg].size){
+        MV_PROBE1(seg__fault, vm->reg[IP]);
         fprintf(stderr,"Error: fallo de segmento\n");
         return -1;
     }
 
     uint16_t phys;
     if (!translate_and_check_instr(vm, seg, off, 1, &phys)){
+        MV_PROBE2(insn__invalid, vm->reg[IP], 0xFFu);
         fprintf(stderr,"Error: instruccion invalida\n");
         return -1;
     }
 
     DecodedInst di;
+    vm->insn_ip = vm->reg[IP];
     if (!fetch_and_decode(vm, &di)){
         uint32_t opc=0xFF;
         (void)mem_read_u8(vm, seg, off, &opc);
+        MV_PROBE2(insn__invalid, vm->insn_ip, opc);
         fprintf(stderr,"Error: instruccion invalida OPC=%02X\n", (unsigned)opc);
         return -1;
     }
 
     if (vm->disassemble){
-        disasm_print(vm, &di);
+        if (vm->trace){
+            trace_insn(vm->trace, vm, &di);
+            trace_flush(vm->trace);
+        } else {
+            disasm_print(vm, &di);
+        }
     }
 
     OpHandler tb[256];
@@ -101,6 +118,8 @@ static int stack_push32(VM* vm, uint32_t val){
     sp -= 4;
     if (!mem_write_u32(vm, seg, sp, val)) { fprintf(stderr,"Error: stack overflow\n"); return -1; }
     set_sp_off(vm, sp);
+    uint32_t used = (uint32_t)vm->seg[seg].size - sp;
+    if (used > vm->stats.stack_peak) vm->stats.stack_peak = used;
     return 0;
 }
 static int stack_pop32(VM* vm, uint32_t* out){
@@ -266,6 +285,7 @@ static int op_stop(VM* vm, const DecodedInst* di){
 }
 static int op_invalid(VM* vm, const DecodedInst* di){
     (void)vm; (void)di;
+    MV_PROBE2(insn__invalid, vm->insn_ip, di->opcode);
     fprintf(stderr, "Error: instrucción inválida OPC=%02X\n", di->opcode);
     return -1;
 }
@@ -488,17 +508,57 @@ static int op_swap(VM* vm, const DecodedInst* di){
     return 0;
 
 }
+/* xorshift64* con el estado en la VM: sin estado global, cada VM su secuencia */
+static u32 vm_rand(VM* vm){
+    if (!vm->rng){
+        vm_seed(vm, host_now_ns() ^ (uint64_t)(uintptr_t)vm);
+        vm->nondet = true;   /* sin semilla explícita (vm_seed) */
+    }
+    uint64_t x = vm->rng;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    vm->rng = x;
+    return (u32)((x * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
 static int op_rnd(VM* vm, const DecodedInst* di){
-    static int seeded=0;
-    if(!seeded){ srand((unsigned)time(NULL)); seeded=1; }
-    
     u32 lim;
     if(!read_operand_u32(vm, &di->B, &lim)) return -1;
-    u32 val=(lim==0u)?0:(u32)(rand() % lim);
+    u32 val=(lim==0u)?0:vm_rand(vm) % lim;
     if(!write_operand_u32(vm, &di->A, val)) return -1;
     set_NZ(vm, val);
     return 0;
 }
+/* CAS/XADD: el destino es una celda de memoria de 4 bytes (ver gthreads.h) */
+static bool atomic_target(VM* vm, const DecodedOp* op, u16* seg, u16* off){
+    if (!get_mem_address(vm, op, seg, off) || mem_size_from_code(mem_size_code(op)) != 4){
+        fprintf(stderr, "Error: CAS/XADD requieren una celda de memoria de 4 bytes\n");
+        return false;
+    }
+    return true;
+}
+static int op_cas(VM* vm, const DecodedInst* di){
+    u16 seg, off;
+    u32 desired, old;
+    if (!atomic_target(vm, &di->A, &seg, &off)) return -1;
+    if (!read_operand_u32(vm, &di->B, &desired)) return -1;
+    u32 expected = vm->reg[EAX];
+    if (!mem_atomic_cas32(vm, seg, off, expected, desired, &old)) return -1;
+    if (old != expected) vm->reg[EAX] = old;
+    set_NZ(vm, old - expected);
+    return 0;
+}
+static int op_xadd(VM* vm, const DecodedInst* di){
+    u16 seg, off;
+    u32 delta, old;
+    if (!atomic_target(vm, &di->A, &seg, &off)) return -1;
+    if (!read_operand_u32(vm, &di->B, &delta)) return -1;
+    if (!mem_atomic_add32(vm, seg, off, delta, &old)) return -1;
+    if (di->B.type == OT_REG && !write_operand_u32(vm, &di->B, old)) return -1;
+    set_NZ(vm, old);
+    return 0;
+}
 static int op_push(VM* vm, const DecodedInst* di){
     uint32_t v = 0;
     if (!read_operand_u32(vm, &di->A, &v)) {
@@ -520,6 +580,7 @@ static int op_call(VM* vm, const DecodedInst* di){
     int16_t off;
     if (!read_jump_offset(vm, di, &off)) return -1; 
     if (stack_push32(vm, vm->reg[IP]) < 0) return -1;
+    if (vm->callgraph) callgraph_on_call(vm->callgraph, (uint16_t)off, vm->reg[IP], sp_off(vm));
     jump_to_code(vm, (uint16_t)off);
     return 0;
 }
@@ -527,27 +588,22 @@ static int op_ret(VM* vm, const DecodedInst* di){
     (void)di;
     uint32_t ret;
     if (stack_pop32(vm, &ret) < 0) return -1;
+    if (vm->callgraph) callgraph_on_ret(vm->callgraph, ret, sp_off(vm));
     vm->reg[IP] = ret;   
     return 0;
 }
-static bool read_line(char* buf, size_t cap){
-    if (!fgets(buf, (int)cap, stdin)) {
-        clearerr(stdin);
-        return false;
+static int read_line(VmIo* io, char* buf, size_t cap){
+    int r = vmio_read_line(io, buf, cap);
+    if (r != VMIO_OK) {
+        return r;
     }
     size_t n = strlen(buf);
     while (n && (buf[n-1]=='\n' || buf[n-1]=='\r')) {
         buf[--n] = 0;
     }
-    return true;                     
+    return VMIO_OK;                     
 }
-static bool parse_input(u32 mode, u16 cell_size, u32* out){
-    char buf[256];
-    if (!read_line(buf, sizeof buf)) {
-        fprintf(stderr, "Error: Falla al leer input de SYS 1. Abortando.\n");
-        return false;
-    }
-
+static bool parse_input(char* buf, u32 mode, u16 cell_size, u32* out){
     if (mode & MODE_CHR){
         u32 v = 0;
         for (u16 i = 0; i < cell_size; i++){
@@ -573,15 +629,15 @@ static bool parse_input(u32 mode, u16 cell_size, u32* out){
     *out = (u32)ul;
     return true;
 }
-static void print_binary(u32 v){
-    if (v == 0){ printf("0b0"); return; }
-    printf("0b");
+static void print_binary(VmIo* io, u32 v){
+    if (v == 0){ vmio_printf(io, "0b0"); return; }
+    vmio_printf(io, "0b");
     int started = 0;
     for (int i = 31; i >= 0; --i){
         int bit = (v >> i) & 1;
         if (!started && bit == 0) continue;  
         started = 1;
-        putchar(bit ? '1' : '0');
+        vmio_putc(io, bit ? '1' : '0');
     }
 }
 static inline uint32_t mask_by_size(uint32_t v, uint16_t sz){
@@ -591,178 +647,329 @@ static inline uint32_t mask_by_size(uint32_t v, uint16_t sz){
         case 4: default: return v;
     }
 }
-static void print_hex_padded(uint32_t v, uint16_t cell_size){
+static void print_hex_padded(VmIo* io, uint32_t v, uint16_t cell_size){
     switch (cell_size){
-        case 1: printf("0x%X",  (unsigned)(v & 0xFFu));    break;
-        case 2: printf("0x%X",  (unsigned)(v & 0xFFFFu));  break;
-        case 4: printf("0x%X",  (unsigned)v);              break;
-        default: printf("0x%X", (unsigned)v);              break;
+        case 1: vmio_printf(io, "0x%X",  (unsigned)(v & 0xFFu));    break;
+        case 2: vmio_printf(io, "0x%X",  (unsigned)(v & 0xFFFFu));  break;
+        case 4: vmio_printf(io, "0x%X",  (unsigned)v);              break;
+        default: vmio_printf(io, "0x%X", (unsigned)v);              break;
     }
 }
-static void print_dec_signed(uint32_t v, uint16_t cell_size){
+static void print_dec_signed(VmIo* io, uint32_t v, uint16_t cell_size){
     switch (cell_size){
-        case 1:  printf("%d",  (int8_t) (v & 0xFFu));    break;
-        case 2:  printf("%d", (int16_t)(v & 0xFFFFu));   break;
-        case 4:  printf("%d", (int32_t) v);              break;
-        default: printf("%u",  v);                       break;
+        case 1:  vmio_printf(io, "%d",  (int8_t) (v & 0xFFu));    break;
+        case 2:  vmio_printf(io, "%d", (int16_t)(v & 0xFFFFu));   break;
+        case 4:  vmio_printf(io, "%d", (int32_t) v);              break;
+        default: vmio_printf(io, "%u",  v);                       break;
     }
 }
-static void print_chars(u32 v, u16 size){
+static void print_chars(VmIo* io, u32 v, u16 size){
     for(int i=size-1; i>=0; --i){
         unsigned char ch = (unsigned char)((v >> (i*8)) & 0xFFu);
-        putchar(isprint(ch)?ch:'.');
+        vmio_putc(io, isprint(ch)?ch:'.');
     }
 }
-static void print_cell(uint32_t modes, uint32_t value, uint16_t cell_size){
+static void print_cell(VmIo* io, uint32_t modes, uint32_t value, uint16_t cell_size){
     uint32_t shown = mask_by_size(value, cell_size);
     int first = 1;
 
     if (modes & MODE_HEX){
-        if (!first) putchar(' ');
-        print_hex_padded(shown, cell_size);
+        if (!first) vmio_putc(io, ' ');
+        print_hex_padded(io, shown, cell_size);
         first = 0;
     }
     if (modes & MODE_OCT){
-        if (!first) putchar(' ');
-        printf("0o%o", (unsigned)shown);
+        if (!first) vmio_putc(io, ' ');
+        vmio_printf(io, "0o%o", (unsigned)shown);
         first = 0;
     }
     if (modes & MODE_CHR){
-        if (!first) putchar(' ');
-        print_chars(shown, cell_size);
+        if (!first) vmio_putc(io, ' ');
+        print_chars(io, shown, cell_size);
         first = 0;
     }
     if (modes & MODE_DEC){
-        if (!first) putchar(' ');
-        print_dec_signed(shown, cell_size);
+        if (!first) vmio_putc(io, ' ');
+        print_dec_signed(io, shown, cell_size);
         first = 0;
     }
     if (modes & MODE_BIN){
-        if (!first) putchar(' ');
-        print_binary(shown);
+        if (!first) vmio_putc(io, ' ');
+        print_binary(io, shown);
     }
 }
 
-static int op_sys(VM* vm, const DecodedInst* di){
-    uint32_t callno = 0xFFFFFFFFu;
-    read_operand_u32(vm, &di->A, &callno);
+static int sys_region(VM* vm, uint32_t callno){
+    uint32_t edx = vm->reg[EDX];
+    char name[REGION_NAME_MAX];
+    const char* key = NULL;
+    if (!(callno == SYS_REGION_END && edx == 0xFFFFFFFFu)){
+        if (!mem_read_string(vm, edx, name, sizeof name)) return -1;
+        key = name;
+    }
 
-    if (!read_operand_u32(vm, &di->A, &callno)) {
-        callno = (vm->reg[EAX] & 0xFFFFu);
+    if (!vm->regions){
+        vm->regions = regions_create();
+        if (!vm->regions) return -1;
     }
 
+    uint64_t now = host_now_ns();
+    if (callno == SYS_REGION_BEGIN){
+        if (!regions_begin(vm->regions, key, now, vm->stats.insns)){
+            fprintf(stderr, "Error: demasiadas regiones anidadas\n");
+            return -1;
+        }
+    } else {
+        regions_end(vm->regions, key, now, vm->stats.insns);
+    }
+    return 0;
+}
+
+static int sys_read(VM* vm, uint32_t callno){
+    (void)callno;
     uint32_t eax = vm->reg[EAX];
     uint32_t ecx = vm->reg[ECX];
     uint32_t edx = vm->reg[EDX];
+    uint16_t count = ecx_count(ecx);
+    uint16_t size  = ecx_size(ecx);
 
-    uint16_t count = ecx_count(ecx);  
-    uint16_t size  = ecx_size(ecx);   
+    uint32_t modes = eax & 0x1Fu;
 
-    if (callno == 1u) {
-     uint32_t modes = eax & 0x1Fu;
+    if (count == 0) {count = 1;}
+    if (size == 0) { size = 4;}
 
-     if (count == 0) {count = 1;}
-     if (size == 0) { size = 4;}
+    /* al reanudar tras un bloqueo se sigue en la celda pendiente, sin repetir el prompt */
+    uint16_t first = vm->sys_waiting ? vm->sys_resume : 0;
 
-     for (uint16_t i = 0; i < count; ++i) {
+    for (uint16_t i = first; i < count; ++i) {
         uint16_t phys;
         if (!phys_of_cell(vm, edx, size, i, &phys))
             return -1;
 
-        printf("[%04X]: ", phys);
-        fflush(stdout);
+        if (!(vm->sys_waiting && i == first)) {
+            vmio_printf(&vm->io, "[%04X]: ", phys);
+            vmio_flush(&vm->io);
+        }
+
+        char buf[256];
+        int r = read_line(&vm->io, buf, sizeof buf);
+        if (r == VMIO_AGAIN) {
+            vm->sys_resume  = i;
+            vm->sys_waiting = true;
+            return OP_BLOCKED;
+        }
+        vm->sys_waiting = false;
+        if (r != VMIO_OK) {
+            fprintf(stderr, "Error: Falla al leer input de SYS 1. Abortando.\n");
+            return -1;
+        }
 
         uint32_t val = 0;
-        if (!parse_input(modes, size, &val))
+        if (!parse_input(buf, modes, size, &val))
             return -1;
 
         uint16_t seg = (uint16_t)(edx >> 16);
         uint16_t off = (uint16_t)((edx & 0xFFFFu) + i * size);
         if (!mem_write_cell(vm, seg, off, size, val))
             return -1;
-     }
-     return 0;
     }
+    return 0;
+}
 
-    if (callno == 2u){
-        uint32_t modes = eax & 0x1Fu;
-        for (uint16_t i=0; i<count; ++i){
-            uint16_t phys;
-            if (!phys_of_cell(vm, edx, size, i, &phys)) return -1;
+static int sys_write(VM* vm, uint32_t callno){
+    (void)callno;
+    uint32_t eax = vm->reg[EAX];
+    uint32_t ecx = vm->reg[ECX];
+    uint32_t edx = vm->reg[EDX];
+    uint16_t count = ecx_count(ecx);
+    uint16_t size  = ecx_size(ecx);
 
-            uint16_t seg = (uint16_t)(edx >> 16);
-            uint16_t off = (uint16_t)((edx & 0xFFFFu) + i*size);
-            uint32_t val = 0;
-            if (!mem_read_cell(vm, seg, off, size, &val)) return -1;
+    uint32_t modes = eax & 0x1Fu;
+    for (uint16_t i=0; i<count; ++i){
+        uint16_t phys;
+        if (!phys_of_cell(vm, edx, size, i, &phys)) return -1;
 
-            printf("[%04X]: ", phys);
-            print_cell(modes, val, size);
-            putchar('\n'); fflush(stdout);
-        }
-        return 0;
+        uint16_t seg = (uint16_t)(edx >> 16);
+        uint16_t off = (uint16_t)((edx & 0xFFFFu) + i*size);
+        uint32_t val = 0;
+        if (!mem_read_cell(vm, seg, off, size, &val)) return -1;
+
+        vmio_printf(&vm->io, "[%04X]: ", phys);
+        print_cell(&vm->io, modes, val, size);
+        vmio_putc(&vm->io, '\n'); vmio_flush(&vm->io);
     }
+    return 0;
+}
 
-    if (callno == 3u){
-        uint16_t maxlen = (uint16_t)(ecx & 0xFFFFu);
-        uint16_t seg = (uint16_t)(edx >> 16);
-        uint16_t off = (uint16_t)(edx & 0xFFFFu);
-        if (maxlen == 0) return 0;
+static int sys_read_str(VM* vm, uint32_t callno){
+    (void)callno;
+    uint32_t ecx = vm->reg[ECX];
+    uint32_t edx = vm->reg[EDX];
 
-        char buf[1024];
-        if (!read_line(buf, sizeof buf)) buf[0] = 0;
-        size_t n = strlen(buf);
-        if (n > (size_t)(maxlen-1)) n = (size_t)(maxlen-1);
+    uint16_t maxlen = (uint16_t)(ecx & 0xFFFFu);
+    uint16_t seg = (uint16_t)(edx >> 16);
+    uint16_t off = (uint16_t)(edx & 0xFFFFu);
+    if (maxlen == 0) return 0;
 
-        for (size_t i=0; i<n; ++i){
-            if (!mem_write_u8(vm, seg, (uint16_t)(off + (uint16_t)i), (uint32_t)(uint8_t)buf[i])) return -1;
-        }
-        if (!mem_write_u8(vm, seg, (uint16_t)(off + (uint16_t)n), 0)) return -1;
-        return 0;
+    char buf[1024];
+    int r = read_line(&vm->io, buf, sizeof buf);
+    if (r == VMIO_AGAIN) {
+        vm->sys_waiting = true;
+        return OP_BLOCKED;
     }
+    vm->sys_waiting = false;
+    if (r != VMIO_OK) buf[0] = 0;
+    size_t n = strlen(buf);
+    if (n > (size_t)(maxlen-1)) n = (size_t)(maxlen-1);
 
-    if (callno == 4u){
-        uint16_t seg = (uint16_t)(edx >> 16);
-        uint16_t off = (uint16_t)(edx & 0xFFFFu);
-        for (;;){
-            uint32_t ch;
-            if (!mem_read_u8(vm, seg, off, &ch)) break;
-            off++;
-            if (ch == 0) break;
-            putchar((int)(uint8_t)ch);
-        }
-        fflush(stdout);
-        return 0;
+    for (size_t i=0; i<n; ++i){
+        if (!mem_write_u8(vm, seg, (uint16_t)(off + (uint16_t)i), (uint32_t)(uint8_t)buf[i])) return -1;
     }
+    if (!mem_write_u8(vm, seg, (uint16_t)(off + (uint16_t)n), 0)) return -1;
+    return 0;
+}
+
+static int sys_write_str(VM* vm, uint32_t callno){
+    (void)callno;
+    uint32_t edx = vm->reg[EDX];
+
+    uint16_t seg = (uint16_t)(edx >> 16);
+    uint16_t off = (uint16_t)(edx & 0xFFFFu);
+    for (;;){
+        uint32_t ch;
+        if (!mem_read_u8(vm, seg, off, &ch)) break;
+        off++;
+        if (ch == 0) break;
+        vmio_putc(&vm->io, (int)(uint8_t)ch);
+    }
+    vmio_flush(&vm->io);
+    return 0;
+}
+
+static int sys_cycles(VM* vm, uint32_t callno){
+    (void)callno;
+    uint64_t cycles = vm->cost ? vm->cost->cycles : 0;
+    vm->reg[EAX] = (uint32_t)cycles;
+    vm->reg[EDX] = (uint32_t)(cycles >> 32);
+    return 0;
+}
+
+static int sys_clock(VM* vm, uint32_t callno){
+    (void)callno;
+    vm->nondet = true;
+    uint64_t now = host_now_ns();
+    vm->reg[EAX] = (uint32_t)now;
+    vm->reg[EDX] = (uint32_t)(now >> 32);
+    return 0;
+}
 
-    if (callno == 7u){
-        term_clear();
+static int sys_icount(VM* vm, uint32_t callno){
+    (void)callno;
+    uint64_t n = vm->stats.insns;
+    vm->reg[EAX] = (uint32_t)n;
+    vm->reg[EDX] = (uint32_t)(n >> 32);
+    return 0;
+}
+
+static int sys_sleep(VM* vm, uint32_t callno){
+    (void)callno;
+    uint32_t edx = vm->reg[EDX];
+
+    if (vm->procs) return procs_sleep(vm, (uint64_t)edx * 1000ull);
+    vmio_flush(&vm->io);
+    return vm_sleep_limited(vm, (uint64_t)edx * 1000ull) ? 0 : OP_LIMIT;
+}
+
+static int sys_clear(VM* vm, uint32_t callno){
+    (void)callno;
+    term_clear(&vm->io);
+    return 0;
+}
+
+static int sys_break(VM* vm, uint32_t callno){
+    (void)callno;
+    vm->nondet = true;
+    if (!vm->have_vmi || !vm->opt_vmi_path){
         return 0;
     }
+    if (!vm_save_vmi(vm, vm->opt_vmi_path)) return -1;
 
-    if (callno == 0xFu){
-        if (!vm->have_vmi || !vm->opt_vmi_path){
-            return 0;
-        }
-        if (!vm_save_vmi(vm, vm->opt_vmi_path)) return -1;
-
-        for(;;){
-            fputs("breakpoint (g=go, ENTER=step, q=quit)> ", stdout); fflush(stdout);
-            char line[64]; if (!fgets(line, sizeof line, stdin)) line[0]=0;
-            size_t m=strlen(line);
-            while (m && (line[m-1]=='\n' || line[m-1]=='\r')) line[--m]=0;
-
-            if (line[0] == 'g' || line[0] == 'G'){
-                return 0;              
-            } else if (line[0] == 'q' || line[0] == 'Q'){
-                vm->reg[IP] = 0xFFFFFFFFu;
-                return -1;
-            } else {
-                if (single_step(vm) < 0) return -1;
-                if (!vm_save_vmi(vm, vm->opt_vmi_path)) return -1;
-            }
+    for(;;){
+        vmio_printf(&vm->io, "breakpoint (g=go, ENTER=step, q=quit)> "); vmio_flush(&vm->io);
+        char line[64]; if (vmio_read_line(&vm->io, line, sizeof line) != VMIO_OK) line[0]=0;
+        size_t m=strlen(line);
+        while (m && (line[m-1]=='\n' || line[m-1]=='\r')) line[--m]=0;
+
+        if (line[0] == 'g' || line[0] == 'G'){
+            return 0;              
+        } else if (line[0] == 'q' || line[0] == 'Q'){
+            vm->reg[IP] = 0xFFFFFFFFu;
+            return -1;
+        } else {
+            if (single_step(vm) < 0) return -1;
+            if (!vm_save_vmi(vm, vm->opt_vmi_path)) return -1;
         }
     }
-    return -1;
+}
+
+/* llamadas propias de la VM, indexadas por número (systab.h) */
+const SysEntry sys_builtin[SYS_TABLE_SIZE] = {
+    [1]                = { sys_read,      NULL, NULL, true },
+    [2]                = { sys_write,     NULL, NULL, true },
+    [3]                = { sys_read_str,  NULL, NULL, true },
+    [4]                = { sys_write_str, NULL, NULL, true },
+    [7]                = { sys_clear,     NULL, NULL, true },
+    [0xF]              = { sys_break,     NULL, NULL, true },
+    [SYS_CYCLES]       = { sys_cycles,    NULL, NULL, false },
+    [SYS_REGION_BEGIN] = { sys_region,    NULL, NULL, false },
+    [SYS_REGION_END]   = { sys_region,    NULL, NULL, false },
+    [SYS_CLOCK]        = { sys_clock,     NULL, NULL, false },
+    [SYS_ICOUNT]       = { sys_icount,    NULL, NULL, false },
+    [SYS_SLEEP]        = { sys_sleep,     NULL, NULL, false },
+    [SYS_SPAWN]        = { procs_sys,     NULL, NULL, false },
+    [SYS_YIELD]        = { procs_sys,     NULL, NULL, false },
+    [SYS_WAIT]         = { procs_sys,     NULL, NULL, false },
+    [SYS_EXIT]         = { procs_sys,     NULL, NULL, false },
+    [SYS_THREAD_START] = { gthreads_sys,  NULL, NULL, false },
+    [SYS_THREAD_JOIN]  = { gthreads_sys,  NULL, NULL, false },
+};
+
+static int op_sys(VM* vm, const DecodedInst* di){
+    uint32_t callno = 0xFFFFFFFFu;
+    read_operand_u32(vm, &di->A, &callno);
+
+    if (!read_operand_u32(vm, &di->A, &callno)) {
+        callno = (vm->reg[EAX] & 0xFFFFu);
+    }
+
+    if (vm->cost) cost_sys(vm->cost, callno);
+
+    MV_PROBE2(sys__entry, callno, vm->reg[EDX]);
+    const SysEntry* e = NULL;
+    if (callno < SYS_TABLE_SIZE) e = vm->systab ? &vm->systab->e[callno] : &sys_builtin[callno];
+
+    /* E/S y prompt de depuración: una llamada completa por vez entre hilos */
+    bool io = e && e->io;
+    uint64_t t0 = host_now_ns();
+    if (io) gthreads_io_lock(vm);
+    int rc = -1;
+    if (e && e->fn)        rc = e->fn(vm, callno);
+    else if (e && e->host) rc = systab_host_call(vm, e, callno);
+    if (io) gthreads_io_unlock(vm);
+    stats_sys(&vm->stats, callno, host_now_ns() - t0);
+    MV_PROBE2(sys__exit, callno, rc);
+
+    if (rc == OP_BLOCKED){
+        /* se vuelve a ejecutar cuando haya entrada: no cuenta dos veces */
+        vm->reg[IP] = vm->insn_ip;
+        vm->stats.insns--;
+    }
+    if (io && rc == 0 && vm->limits.out_bytes &&
+        (vm->threads ? gthreads_charge_output(vm) : vm->io.written - vm->limits.out0) > vm->limits.out_bytes){
+        vm->limits.hit = VM_LIMIT_OUTPUT;
+        return OP_LIMIT;
+    }
+    return rc;
 }
 
 void init_dispatch_table(OpHandler tb[256]){
@@ -777,6 +984,8 @@ void init_dispatch_table(OpHandler tb[256]){
     tb[0x06] = op_jnp;
     tb[0x07] = op_jnn;
     tb[0x08] = op_not;
+    tb[0x09] = op_cas;
+    tb[0x0A] = op_xadd;
 
     tb[0x0B] = op_push; 
     tb[0x0C] = op_pop;  
@@ -4,6 +4,14 @@
 
 typedef int (*OpHandler)(VM*, const DecodedInst*);
 
+#define OP_BLOCKED (-2)    /* la instrucción espera entrada; IP vuelve a ella */
+#define OP_SWITCH  (-3)    /* la instrucción terminó; hay que elegir otro proceso */
+#define OP_LIMIT   (-4)    /* la instrucción superó una cuota (vm->limits.hit) */
+
+#define SYS_CLOCK  0x13u   /* EAX/EDX <- reloj monotónico del host en ns (parte baja/alta) */
+#define SYS_ICOUNT 0x14u   /* EAX/EDX <- instrucciones ejecutadas (parte baja/alta) */
+#define SYS_SLEEP  0x15u   /* duerme EDX microsegundos sin consumir CPU */
+
 void init_dispatch_table(OpHandler table[256]);
 int  exec_instruction(VM* vm, const DecodedInst* di, OpHandler table[256]);
 
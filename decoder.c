@@ -16,7 +16,7 @@ static inline OperandType type_from_code(uint8_t code){
 }
 
 static inline bool is_two_ops(uint8_t opc){
-    return (opc >= 0x10 && opc <= 0x1F);
+    return (opc >= 0x10 && opc <= 0x1F) || opc == 0x09 || opc == 0x0A;
 }
 static inline bool is_one_op(uint8_t opc){
     return (opc <= 0x08) || opc == 0x0B || opc == 0x0C || opc == 0x0D;
@@ -67,10 +67,7 @@ static bool fetch_bytes_instr(VM* vm, uint16_t seg, uint16_t off, uint16_t n, ui
 }
 
 
-bool fetch_and_decode(VM* vm, DecodedInst* di){
-    uint16_t seg = (uint16_t)(vm->reg[IP] >> 16);
-    uint16_t off = (uint16_t)(vm->reg[IP] & 0xFFFFu);
-
+bool decode_at(VM* vm, uint16_t seg, uint16_t off, DecodedInst* di){
     uint16_t phys0 = 0;
     uint8_t  hdr   = 0;
     if (!fetch_bytes_instr(vm, seg, off, 1, &phys0, &hdr)) {
@@ -89,11 +86,6 @@ bool fetch_and_decode(VM* vm, DecodedInst* di){
     di->B.size = 0;
 
 
-    vm->reg[OPC] = (uint32_t)di->opcode;
-    vm->reg[OP1] = 0;
-    vm->reg[OP2] = 0;
-
-
     if (is_two_ops(di->opcode)){
         OperandType typeB = type_from_code((uint8_t)(hdr >> 6));
         OperandType typeA = ((hdr >> 5) & 0x1) ? OT_MEM : OT_REG;
@@ -143,6 +135,22 @@ bool fetch_and_decode(VM* vm, DecodedInst* di){
         return false;
     }
 
+    return true;
+}
+
+bool fetch_and_decode(VM* vm, DecodedInst* di){
+    uint16_t seg = (uint16_t)(vm->reg[IP] >> 16);
+    uint16_t off = (uint16_t)(vm->reg[IP] & 0xFFFFu);
+
+    vm->reg[OP1] = 0;
+    vm->reg[OP2] = 0;
+
+    if (!decode_at(vm, seg, off, di)) {
+        return false;
+    }
+
+    vm->reg[OPC] = (uint32_t)di->opcode;
+
     {
         uint32_t descA = desc_from_operand(&di->A);
         uint32_t descB = desc_from_operand(&di->B);
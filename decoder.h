@@ -43,4 +43,7 @@ static inline uint8_t size_from_type(OperandType t){
 
 static inline uint8_t type_size(OperandType t){ return size_from_type(t); }
 
-bool fetch_and_decode(VM* vm, DecodedInst* inst);
\ No newline at end of file
+bool fetch_and_decode(VM* vm, DecodedInst* inst);
+
+/* decodifica sin tocar IP/OPC/OP1/OP2 */
+bool decode_at(VM* vm, u16 seg, u16 off, DecodedInst* inst);
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include "disasm.h"
 #include "memory.h"
 #include "vm.h"
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
@@ -36,7 +37,11 @@ static const char* vmx_regname(uint8_t code){
     }
 }
 
-static const char* logical_kind_for_index(VM* vm, int i){
+const char* reg_name(u8 idx){
+    return vmx_regname(idx);
+}
+
+const char* disasm_segment_kind(VM* vm, int i){
     if (i == vm->idx_param) return "PARAM";
     if (i == vm->idx_const) return "CONST";
     if (i == vm->idx_code)  return "CODE";
@@ -46,47 +51,47 @@ static const char* logical_kind_for_index(VM* vm, int i){
     return "?";
 }
 
-void disasm_dump_segments(VM* vm){
-    puts("SEGMENTS:");
+void disasm_dump_segments(VM* vm, FILE* out){
+    fputs("SEGMENTS:\n", out);
     for (int i = 0; i < SEG_COUNT; i++){
         u16 base = vm->seg[i].base;
         u16 size = vm->seg[i].size;
         if (size == 0) continue;
-        printf(" %d %-6s base=%04X size=%04X\n",
+        fprintf(out, " %d %-6s base=%04X size=%04X\n",
                i,
-               logical_kind_for_index(vm, i),
+               disasm_segment_kind(vm, i),
                (unsigned)base,
                (unsigned)size);
     }
 
     u16 cs_idx = (u16)(vm->reg[CS] >> 16);
     u16 ip_off = (u16)(vm->reg[IP] & 0xFFFFu);
-    printf("ENTRY: CS=%u IP=%04X\n\n",
+    fprintf(out, "ENTRY: CS=%u IP=%04X\n\n",
            (unsigned)cs_idx,
            (unsigned)ip_off);
 }
 
-static void print_string_preview_bytes(const u8* p, u16 length){
+static void print_string_preview_bytes(FILE* out, const u8* p, u16 length){
     u16 max = (length > 16) ? 16 : length;
     for (u16 i = 0; i < max; i++){
         u8 ch = p[i];
         if (ch == 0) break;
-        printf("%02X ", (unsigned)ch);
+        fprintf(out, "%02X ", (unsigned)ch);
     }
 }
 
 
-static void print_string_preview_text(const u8* p, u16 length){
-    putchar('"');
+static void print_string_preview_text(FILE* out, const u8* p, u16 length){
+    fputc('"', out);
     for (u16 i = 0; i < length; i++){
         u8 ch = p[i];
         if (ch == 0) break;
-        putchar((ch >= 32 && ch < 127) ? ch : '.');
+        fputc((ch >= 32 && ch < 127) ? ch : '.', out);
     }
-    putchar('"');
+    fputc('"', out);
 }
 
-void disasm_dump_const_strings(VM* vm){
+void disasm_dump_const_strings(VM* vm, FILE* out){
     if (vm->idx_const < 0) {
         return;
     }
@@ -95,7 +100,7 @@ void disasm_dump_const_strings(VM* vm){
     u16 size = vm->seg[vm->idx_const].size;
     if (size == 0) return;
 
-    puts("CONST STRINGS:");
+    fputs("CONST STRINGS:\n", out);
 
     u16 off = 0;
     while (off < size){
@@ -110,18 +115,18 @@ void disasm_dump_const_strings(VM* vm){
         }
         u16 length = (u16)(off - start);
 
-        printf(" [%04X] ", (unsigned)(base + start));
-        print_string_preview_bytes(&vm->ram[base + start], length);
-        printf("| ");
-        print_string_preview_text(&vm->ram[base + start], length);
-        putchar('\n');
+        fprintf(out, " [%04X] ", (unsigned)(base + start));
+        print_string_preview_bytes(out, &vm->ram[base + start], length);
+        fputs("| ", out);
+        print_string_preview_text(out, &vm->ram[base + start], length);
+        fputc('\n', out);
 
         if (off < size && vm->ram[base + off] == 0){
             off++;
         }
     }
 
-    putchar('\n');
+    fputc('\n', out);
 }
 
 static const char* reg_aliased_name(uint8_t reg_code, uint8_t sector){
@@ -146,6 +151,8 @@ const char* opcode_mnemonic(u8 op){
         [0x06]="JNP",
         [0x07]="JNN",
         [0x08]="NOT",
+        [0x09]="CAS",
+        [0x0A]="XADD",
 
         [0x0B]="PUSH",
         [0x0C]="POP",
@@ -233,24 +240,31 @@ static void format_operand(const DecodedOp* op, uint8_t size_hint, char* out, si
 #define COL_MNEM 4
 #define COL_A    18
 
-void disasm_print(VM* vm, const DecodedInst* di){
-    static int      have_entry = 0;
-    static uint16_t entry_phys = 0;
-    if (!have_entry){ entry_phys = di->phys; have_entry = 1; }
-
-    putchar((di->phys == entry_phys)?'>':' ');
+/* snprintf al final de out; una vez truncado no agrega más */
+#if defined(__GNUC__)
+__attribute__((format(printf, 4, 5)))
+#endif
+static int append(char* out, size_t cap, int len, const char* fmt, ...){
+    if (len < 0 || (size_t)len >= cap) return len;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(out + len, cap - (size_t)len, fmt, ap);
+    va_end(ap);
+    return n < 0 ? len : len + n;
+}
 
-    printf("[%04X] ", di->phys);
+int disasm_format(VM* vm, const DecodedInst* di, char* out, size_t cap){
+    int len = snprintf(out, cap, "[%04X] ", di->phys);
 
     uint8_t raw[8];
     uint16_t n = di->size;
     if (n > sizeof(raw)) n = sizeof(raw);
     code_read_bytes(vm, di->phys, raw, n);
     for (uint16_t i=0; i<n; ++i){
-        printf("%02X%s", raw[i], (i+1<n ? " " : ""));
+        len = append(out, cap, len, "%02X%s", raw[i], (i+1<n ? " " : ""));
     }
 
-    printf(" | ");
+    len = append(out, cap, len, " | ");
 
     uint8_t hintA = 0, hintB = 0;            /* 0=sin pista, 1/2/4 = b/w/l */
     if (di->A.type == OT_REG && di->B.type == OT_MEM)
@@ -266,10 +280,22 @@ void disasm_print(VM* vm, const DecodedInst* di){
     if (di->A.type != OT_NONE && di->B.type != OT_NONE){
         char AwithComma[96];
         snprintf(AwithComma, sizeof AwithComma, "%s,", A); 
-        printf("%-*s %-*s %s\n", COL_MNEM, m, COL_A, AwithComma, B);
+        len = append(out, cap, len, "%-*s %-*s %s", COL_MNEM, m, COL_A, AwithComma, B);
     } else if (di->A.type != OT_NONE){
-        printf("%-*s %s\n", COL_MNEM, m, A);
+        len = append(out, cap, len, "%-*s %s", COL_MNEM, m, A);
     } else {
-        printf("%s\n", m);
+        len = append(out, cap, len, "%s", m);
     }
-}
\ No newline at end of file
+    return len;
+}
+
+void disasm_print(VM* vm, const DecodedInst* di){
+    static int      have_entry = 0;
+    static uint16_t entry_phys = 0;
+    if (!have_entry){ entry_phys = di->phys; have_entry = 1; }
+
+    char line[DISASM_LINE_MAX];
+    disasm_format(vm, di, line, sizeof line);
+    putchar((di->phys == entry_phys)?'>':' ');
+    puts(line);
+}
@@ -2,12 +2,17 @@
 #include "vm.h"
 #include "decoder.h"
 #include <stddef.h>
+#include <stdio.h>
+
+#define DISASM_LINE_MAX 160
 
 const char* opcode_mnemonic(u8 opcode);
 const char* reg_name(u8 idx);
+const char* disasm_segment_kind(VM* vm, int seg_idx);
 
-void disasm_dump_segments(VM* vm);
-void disasm_dump_const_strings(VM* vm);
+void disasm_dump_segments(VM* vm, FILE* out);
+void disasm_dump_const_strings(VM* vm, FILE* out);
+int  disasm_format(VM* vm, const DecodedInst* di, char* out, size_t cap);
 void disasm_print(VM* vm, const DecodedInst* di);
 
 void disasm_print(VM* vm, const DecodedInst* di);
@@ -0,0 +1,178 @@
+#include "fanout.h"
+#include "hostclock.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct {
+    VmOutBuf out;
+    int      rc;
+    bool     done;
+} Replica;
+
+typedef struct {
+    const VmxImage* img;
+    const char*     path;
+    char**          params;
+    int             argc;
+    uint32_t        ram_kib;
+    uint64_t        seed;
+    const VmLimits* limits;
+    const char*     in;
+    size_t          in_len;
+
+    Replica*        r;
+    unsigned        n;
+    atomic_uint     next;           /* próxima réplica sin empezar */
+    atomic_ullong   insns;
+    atomic_ullong   vm_ns;
+
+    pthread_mutex_t lock;           /* printed y la escritura en stdout */
+    unsigned        printed;        /* réplicas ya escritas, en orden */
+} Fanout;
+
+static void write_prefixed(unsigned i, const VmOutBuf* b){
+    size_t p = 0;
+    while (p < b->len){
+        const char* nl = (const char*)memchr(b->data + p, '\n', b->len - p);
+        size_t end = nl ? (size_t)(nl - b->data) + 1 : b->len;
+        printf("[%u] ", i);
+        fwrite(b->data + p, 1, end - p, stdout);
+        if (!nl) putchar('\n');
+        p = end;
+    }
+}
+
+static int run_replica(Fanout* f, unsigned i){
+    VM* vm = (VM*)malloc(sizeof *vm);
+    if (!vm) return 1;
+    vm_init_job(vm, f->ram_kib, f->path, f->argc);
+    if (!vm_load_image(vm, f->img, f->params, f->argc)){
+        free(vm);
+        return 1;
+    }
+    vm_seed(vm, f->seed + i);
+    if (f->limits){
+        vm->limits = *f->limits;
+        vm->limits.dump_path = NULL;
+    }
+
+    VmInBuf in = { f->in, f->in_len, 0 };
+    vmio_input(&vm->io, &in);
+    vmio_capture(&vm->io, &f->r[i].out);
+
+    uint64_t t0 = host_now_ns();
+    int rc = vm_run(vm);
+    atomic_fetch_add(&f->vm_ns, host_now_ns() - t0);
+    atomic_fetch_add(&f->insns, vm->stats.insns);
+    vm_release(vm);
+    free(vm);
+    return rc;
+}
+
+/* escribe las réplicas terminadas que siguen en orden; así la salida sale
+   mientras se corre y no hace falta guardarla toda */
+static void flush_ready(Fanout* f){
+    while (f->printed < f->n && f->r[f->printed].done){
+        Replica* r = &f->r[f->printed];
+        write_prefixed(f->printed, &r->out);
+        vmio_outbuf_free(&r->out);
+        f->printed++;
+    }
+    fflush(stdout);
+}
+
+static void* worker_main(void* arg){
+    Fanout* f = (Fanout*)arg;
+    for (;;){
+        unsigned i = atomic_fetch_add(&f->next, 1u);
+        if (i >= f->n) break;
+        int rc = run_replica(f, i);
+
+        pthread_mutex_lock(&f->lock);
+        f->r[i].rc   = rc;
+        f->r[i].done = true;
+        if (i == f->printed) flush_ready(f);
+        pthread_mutex_unlock(&f->lock);
+    }
+    return NULL;
+}
+
+static char* read_input(size_t* n){
+    *n = 0;
+    if (isatty(STDIN_FILENO)) return NULL;
+    return vmio_read_all(stdin, n);
+}
+
+int fanout_run(const char* path, char** params, int argc, uint32_t ram_kib,
+               unsigned replicas, unsigned threads, uint64_t seed,
+               const VmLimits* limits, FILE* report){
+    if (replicas == 0 || replicas > FANOUT_MAX_REPLICAS){
+        fprintf(stderr, "Error: --fanout admite de 1 a %u replicas\n", FANOUT_MAX_REPLICAS);
+        return 1;
+    }
+    VmxImage img;
+    if (!vmx_image_read(path, &img)) return 1;
+
+    Fanout f;
+    memset(&f, 0, sizeof f);
+    f.img     = &img;
+    f.path    = path;
+    f.params  = params;
+    f.argc    = argc;
+    f.ram_kib = ram_kib;
+    f.seed    = seed;
+    f.limits  = limits;
+    f.n       = replicas;
+    f.in      = read_input(&f.in_len);
+    f.r       = (Replica*)calloc(replicas, sizeof *f.r);
+    atomic_init(&f.next, 0u);
+    atomic_init(&f.insns, 0ull);
+    atomic_init(&f.vm_ns, 0ull);
+    pthread_mutex_init(&f.lock, NULL);
+    if (!f.r){
+        vmx_image_free(&img);
+        free((char*)f.in);
+        return 1;
+    }
+
+    if (threads > replicas) threads = replicas;
+    pthread_t* th = (pthread_t*)calloc(threads, sizeof *th);
+    unsigned started = 0;
+    uint64_t t0 = host_now_ns();
+    for (; th && started < threads; started++){
+        if (pthread_create(&th[started], NULL, worker_main, &f) != 0) break;
+    }
+    if (started == 0){
+        fprintf(stderr, "Error: no pude crear los hilos\n");
+    }
+    for (unsigned i = 0; i < started; i++) pthread_join(th[i], NULL);
+    uint64_t wall = host_now_ns() - t0;
+
+    unsigned failed = 0;
+    int rc = 0;
+    for (unsigned i = 0; i < replicas; i++){
+        if (!f.r[i].done || f.r[i].rc != 0){
+            failed++;
+            if (rc == 0) rc = f.r[i].done ? f.r[i].rc : 1;
+        }
+        vmio_outbuf_free(&f.r[i].out);
+    }
+
+    if (report){
+        fprintf(report, "== fanout: %u replicas, semilla %llu, %u con error, %u hilos: %.3f s (%.3f s de VM, %.1fx), %llu instrucciones ==\n",
+                replicas, (unsigned long long)seed, failed, started, (double)wall / 1e9,
+                (double)atomic_load(&f.vm_ns) / 1e9,
+                wall ? (double)atomic_load(&f.vm_ns) / (double)wall : 0.0,
+                (unsigned long long)atomic_load(&f.insns));
+    }
+
+    free(th);
+    free(f.r);
+    free((char*)f.in);
+    pthread_mutex_destroy(&f.lock);
+    vmx_image_free(&img);
+    return rc;
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include "vm.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/* Monte Carlo: N réplicas del mismo programa repartidas en 'threads' hilos.
+   La réplica i siembra su RND con vm_seed(seed + i), así que con la misma
+   semilla la corrida entera se repite igual sin importar cuántos hilos haya.
+   Todas reciben la misma entrada (stdin leída una vez; nada si es una
+   terminal) y su salida va a stdout en orden de réplica, cada línea con
+   "[i] " adelante. */
+
+#define FANOUT_MAX_REPLICAS 100000u
+
+/* limits (puede ser NULL): cuotas de cada réplica, sin volcado .vmi.
+   Devuelve 0 si todas terminaron bien; con report != NULL, un resumen */
+int fanout_run(const char* path, char** params, int argc, uint32_t ram_kib,
+               unsigned replicas, unsigned threads, uint64_t seed,
+               const VmLimits* limits, FILE* report);
@@ -0,0 +1,227 @@
+#include "gthreads.h"
+#include "hostclock.h"
+#include "memory.h"
+#include <stdlib.h>
+#include <string.h>
+
+static GThreads* gthreads_create(VM* owner){
+    GThreads* gt = (GThreads*)calloc(1, sizeof *gt);
+    if (!gt) return NULL;
+    gt->owner    = owner;
+    gt->next_tid = 1;
+    pthread_mutex_init(&gt->lock, NULL);
+    pthread_mutex_init(&gt->io_lock, NULL);
+    atomic_init(&gt->stop, false);
+
+    /* lo que la dueña ya usó sigue contando */
+    VmLimits* l = &owner->limits;
+    atomic_init(&gt->insns_used, l->armed ? owner->stats.insns - l->insns0 : 0);
+    atomic_init(&gt->out_used, l->armed ? owner->io.written - l->out0 : 0);
+    atomic_init(&gt->hit, VM_LIMIT_NONE);
+    l->insns_charged = owner->stats.insns;
+    l->out_charged   = owner->io.written;
+    return gt;
+}
+
+uint64_t gthreads_charge_insns(VM* vm){
+    VmLimits* l = &vm->limits;
+    uint64_t d = vm->stats.insns - l->insns_charged;
+    l->insns_charged = vm->stats.insns;
+    return atomic_fetch_add(&vm->threads->insns_used, d) + d;
+}
+
+uint64_t gthreads_charge_output(VM* vm){
+    VmLimits* l = &vm->limits;
+    uint64_t d = vm->io.written - l->out_charged;
+    l->out_charged = vm->io.written;
+    return atomic_fetch_add(&vm->threads->out_used, d) + d;
+}
+
+static void* thread_main(void* arg){
+    GThread*  t  = (GThread*)arg;
+    GThreads* gt = t->vm->threads;
+    VmExit r = VM_FAULT;
+    while (!atomic_load(&gt->stop)){
+        r = vm_run_for(t->vm, GTHREADS_SLICE);
+        if (r == VM_PREEMPTED) continue;
+        if (r == VM_BLOCKED){
+            /* E/S no bloqueante (--sched) sin línea todavía */
+            host_sleep_ns(1000000ull);
+            continue;
+        }
+        break;
+    }
+    if (r == VM_LIMIT){
+        /* la cuota es de todos: la dueña y los demás hilos cortan también */
+        int none = VM_LIMIT_NONE;
+        atomic_compare_exchange_strong(&gt->hit, &none, t->vm->limits.hit);
+    }
+    t->rc = r;
+    return NULL;
+}
+
+/* el hilo comparte segmentos y ram; SS:SP apuntan a la pila que pasó el invitado */
+static VM* thread_vm(VM* vm, GThreads* gt, u16 entry, u32 stack_top){
+    u16 sseg = hi16(stack_top);
+    if (sseg >= SEG_COUNT || vm->seg[sseg].size == 0 || lo16(stack_top) > vm->seg[sseg].size){
+        fprintf(stderr, "Error: pila invalida para el hilo (%08X)\n", (unsigned)stack_top);
+        return NULL;
+    }
+    VM* t = (VM*)malloc(sizeof *t);
+    if (!t) return NULL;
+    vm_init(t, false);
+
+    memcpy(t->reg, vm->reg, sizeof t->reg);
+    memcpy(t->seg, vm->seg, sizeof t->seg);
+    t->idx_param   = vm->idx_param;
+    t->idx_const   = vm->idx_const;
+    t->idx_code    = vm->idx_code;
+    t->idx_data    = vm->idx_data;
+    t->idx_extra   = vm->idx_extra;
+    t->idx_stack   = vm->idx_stack;
+    t->code_size   = vm->code_size;
+    t->ram_kib     = vm->ram_kib;
+    t->have_params = vm->have_params;
+
+    t->mem     = vm->mem;
+    t->io      = vm->io;
+    /* la cuota y el reloj son los de la dueña (gthreads_charge_*), sin volcado propio */
+    t->limits  = vm->limits;
+    t->limits.dump_path     = NULL;
+    t->limits.hit           = VM_LIMIT_NONE;
+    t->limits.insns_charged = 0;
+    t->limits.out_charged   = 0;
+    t->systab  = vm->systab;
+    t->threads = gt;
+
+    t->reg[IP]  = (vm->reg[CS] & 0xFFFF0000u) | entry;
+    t->reg[SS]  = stack_top & 0xFFFF0000u;
+    t->reg[SP]  = stack_top;
+    t->reg[BP]  = stack_top;
+    t->reg[EAX] = vm->reg[EBX];
+    return t;
+}
+
+static void free_thread_vm(VM* t){
+    t->threads = NULL;   /* la tabla es de la dueña */
+    vm_release(t);
+    free(t);
+}
+
+static int thread_start(VM* vm, GThreads* gt){
+    vm->reg[EAX] = 0xFFFFFFFFu;
+
+    VM* t = thread_vm(vm, gt, lo16(vm->reg[EDX]), vm->reg[ECX]);
+    if (!t) return 0;
+
+    pthread_mutex_lock(&gt->lock);
+    GThread* slot = NULL;
+    for (int i = 0; i < GTHREADS_MAX; i++){
+        if (!gt->t[i].used){ slot = &gt->t[i]; break; }
+    }
+    if (!slot){
+        pthread_mutex_unlock(&gt->lock);
+        fprintf(stderr, "Error: demasiados hilos (max %d)\n", GTHREADS_MAX);
+        free_thread_vm(t);
+        return 0;
+    }
+    memset(slot, 0, sizeof *slot);
+    slot->used = true;
+    slot->tid  = gt->next_tid++;
+    slot->vm   = t;
+    if (pthread_create(&slot->th, NULL, thread_main, slot) != 0){
+        slot->used = false;
+        pthread_mutex_unlock(&gt->lock);
+        fprintf(stderr, "Error: no pude crear el hilo\n");
+        free_thread_vm(t);
+        return 0;
+    }
+    gt->started++;
+    gt->live++;
+    if (gt->live > gt->peak) gt->peak = gt->live;
+    vm->reg[EAX] = slot->tid;
+    pthread_mutex_unlock(&gt->lock);
+    return 0;
+}
+
+/* espera un hilo ya marcado 'joining' y libera su lugar; devuelve su EAX o -1 */
+static u32 reap(GThreads* gt, GThread* t){
+    pthread_join(t->th, NULL);
+    u32 result = (t->rc == VM_HALTED) ? t->vm->reg[EAX] : 0xFFFFFFFFu;
+
+    pthread_mutex_lock(&gt->lock);
+    stats_merge(&gt->stats, &t->vm->stats);
+    free_thread_vm(t->vm);
+    t->vm   = NULL;
+    t->used = false;
+    gt->live--;
+    pthread_mutex_unlock(&gt->lock);
+    return result;
+}
+
+static int thread_join(VM* vm, GThreads* gt, u32 tid){
+    GThread* t = NULL;
+    pthread_mutex_lock(&gt->lock);
+    for (int i = 0; i < GTHREADS_MAX; i++){
+        GThread* c = &gt->t[i];
+        if (c->used && c->tid == tid && !c->joining && c->vm != vm){ t = c; break; }
+    }
+    if (t) t->joining = true;
+    pthread_mutex_unlock(&gt->lock);
+
+    vm->reg[EAX] = t ? reap(gt, t) : 0xFFFFFFFFu;
+    return 0;
+}
+
+int gthreads_sys(VM* vm, u32 callno){
+    if (!vm->threads){
+        if (callno == SYS_THREAD_JOIN){
+            vm->reg[EAX] = 0xFFFFFFFFu;
+            return 0;
+        }
+        if (vm->procs){
+            fprintf(stderr, "Error: SYS_THREAD_START no se permite con procesos invitados\n");
+            vm->reg[EAX] = 0xFFFFFFFFu;
+            return 0;
+        }
+        vm->threads = gthreads_create(vm);
+        if (!vm->threads) return -1;
+    }
+
+    switch (callno){
+    case SYS_THREAD_START:
+        vm->nondet = true;   /* el orden entre hilos depende del host */
+        return thread_start(vm, vm->threads);
+    case SYS_THREAD_JOIN:
+        return thread_join(vm, vm->threads, vm->reg[EDX]);
+    }
+    return -1;
+}
+
+void gthreads_stop(GThreads* gt){
+    if (!gt) return;
+    atomic_store(&gt->stop, true);
+    for (int i = 0; i < GTHREADS_MAX; i++){
+        GThread* t = &gt->t[i];
+        pthread_mutex_lock(&gt->lock);
+        bool mine = t->used && !t->joining;
+        if (mine) t->joining = true;
+        pthread_mutex_unlock(&gt->lock);
+        if (mine) (void)reap(gt, t);
+    }
+    stats_merge(&gt->owner->stats, &gt->stats);
+    memset(&gt->stats, 0, sizeof gt->stats);
+}
+
+void gthreads_destroy(GThreads* gt){
+    if (!gt) return;
+    gthreads_stop(gt);
+    pthread_mutex_destroy(&gt->lock);
+    pthread_mutex_destroy(&gt->io_lock);
+    free(gt);
+}
+
+void gthreads_report(const GThreads* gt, FILE* out){
+    fprintf(out, "== hilos: %llu creados, maximo %u a la vez ==\n",
+            (unsigned long long)gt->started, (unsigned)gt->peak);
+}
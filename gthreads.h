@@ -0,0 +1,87 @@
+#pragma once
+#include "vm.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Hilos invitados: varias copias del banco de registros ejecutando el mismo
+   programa sobre la misma ram, cada una en un hilo del host.
+
+   Modelo de memoria:
+   - Cada hilo tiene sus registros (IP, SP, EAX...) y su pila; la tabla de
+     segmentos y la ram son las de la VM dueña.
+   - Los accesos normales (MOV, ADD sobre memoria, PUSH...) no son atómicos
+     ni están ordenados entre hilos: un hilo puede ver una palabra a medio
+     escribir por otro, o ver escrituras en otro orden.
+   - CAS y XADD (opcodes 0x09/0x0A) son atómicos sobre cualquier celda de
+     4 bytes y secuencialmente consistentes: todo lo que un hilo escribió
+     antes de un CAS/XADD es visible para el hilo que después observa el
+     valor que ese CAS/XADD dejó. Alcanzan para armar locks
+     (CAS 0->1 para tomar, XADD -1 o CAS 1->0 para soltar) y colas con índices.
+   - SYS_THREAD_START y SYS_THREAD_JOIN también ordenan: el hilo nuevo ve todo
+     lo escrito antes de crearlo y quien hace join ve todo lo que escribió el hilo.
+
+   CAS [mem], B   si [mem] == EAX entonces [mem] <- B; si no EAX <- [mem].
+                  NZ como CMP [mem], EAX (Z=1 si se escribió)
+   XADD [mem], B  [mem] <- [mem] + B; si B es registro recibe el valor anterior;
+                  NZ según el valor anterior */
+
+#define SYS_THREAD_START 0x28u   /* EDX = offset en el código, ECX = tope de pila (puntero),
+                                    EBX = argumento (EAX del hilo); EAX <- tid o -1 */
+#define SYS_THREAD_JOIN  0x29u   /* EDX = tid; EAX <- EAX del hilo al terminar, -1 si falló */
+
+#define GTHREADS_MAX   32
+#define GTHREADS_SLICE 100000u   /* instrucciones entre controles de cancelación */
+
+typedef struct {
+    bool      used;
+    u32       tid;
+    pthread_t th;
+    VM*       vm;         /* registros propios; vm->mem apunta a la ram de la dueña */
+    VmExit    rc;
+    bool      joining;    /* alguien ya hace join */
+} GThread;
+
+typedef struct GThreads {
+    VM*             owner;
+    GThread         t[GTHREADS_MAX];
+    u32             next_tid;
+    pthread_mutex_t lock;       /* tabla de hilos */
+    pthread_mutex_t io_lock;    /* una llamada de E/S del invitado a la vez */
+    atomic_bool     stop;       /* la dueña terminó: los hilos abandonan */
+
+    /* cuotas: lo usado por la dueña y todos sus hilos, contra vm->limits de la dueña */
+    atomic_ullong   insns_used;
+    atomic_ullong   out_used;
+    atomic_int      hit;        /* VM_LIMIT_* de la primera que agotó una cuota */
+
+    VmStats         stats;      /* contadores de los hilos ya terminados */
+    uint64_t        started;
+    u32             peak;
+    u32             live;
+} GThreads;
+
+/* los SYS de E/S usan la VmIo de la dueña, compartida por todos los hilos */
+static inline void gthreads_io_lock(VM* vm){
+    if (vm->threads) pthread_mutex_lock(&vm->threads->io_lock);
+}
+static inline void gthreads_io_unlock(VM* vm){
+    if (vm->threads) pthread_mutex_unlock(&vm->threads->io_lock);
+}
+
+/* suman lo que vm ejecutó o escribió desde la última vez a lo compartido
+   y devuelven el total de la dueña y sus hilos */
+uint64_t gthreads_charge_insns(VM* vm);
+uint64_t gthreads_charge_output(VM* vm);
+
+/* SYS_THREAD_START / SYS_THREAD_JOIN; devuelve 0 o -1 */
+int  gthreads_sys(VM* vm, u32 callno);
+
+/* la dueña terminó: los hilos que sigan vivos abandonan en su próxima rebanada.
+   Espera a todos y suma sus contadores a los de la dueña */
+void gthreads_stop(GThreads* gt);
+
+void gthreads_destroy(GThreads* gt);
+
+void gthreads_report(const GThreads* gt, FILE* out);
@@ -0,0 +1,61 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/* FNV-1a: claves de cache por contenido (no criptográfico) */
+
+static inline uint64_t fnv1a64(const void* data, size_t n){
+    const uint8_t* p = (const uint8_t*)data;
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < n; i++){
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+/* versión de 128 bits, incremental, para claves que se guardan en disco.
+   En dos mitades de 64 bits: no todos los compiladores tienen __int128 */
+typedef struct {
+    uint64_t hi, lo;
+} Fnv128;
+
+static inline void fnv128_init(Fnv128* f){
+    f->hi = 0x6c62272e07bb0142ull;
+    f->lo = 0x62b821756295c58dull;
+}
+
+/* h *= 2^88 + 0x13B (el primo de FNV-128), módulo 2^128 */
+static inline void fnv128_mul(Fnv128* f){
+    const uint64_t c = 0x13Bull;
+    uint64_t pa = (f->lo & 0xFFFFFFFFull) * c;
+    uint64_t pb = (f->lo >> 32) * c;
+    uint64_t lo = pa + (pb << 32);
+    f->hi = f->hi * c + (pb >> 32) + (lo < pa) + (f->lo << 24);
+    f->lo = lo;
+}
+
+static inline void fnv128_add(Fnv128* f, const void* data, size_t n){
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t i = 0; i < n; i++){
+        f->lo ^= p[i];
+        fnv128_mul(f);
+    }
+}
+
+/* un campo con su largo delante, para que "ab"+"c" no choque con "a"+"bc" */
+static inline void fnv128_field(Fnv128* f, const void* data, size_t n){
+    uint64_t len = (uint64_t)n;
+    fnv128_add(f, &len, sizeof len);
+    fnv128_add(f, data, n);
+}
+
+/* 32 dígitos hex + '\0' */
+static inline void fnv128_hex(const Fnv128* f, char out[33]){
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < 32; i++){
+        uint64_t half = i < 16 ? f->hi : f->lo;
+        out[i] = digits[(unsigned)(half >> (60 - 4 * (i & 15))) & 0xFu];
+    }
+    out[32] = 0;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+
+static inline uint64_t host_now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* duerme sin consumir CPU; reintenta si una señal (p.ej. SIGPROF) lo interrumpe */
+static inline void host_sleep_ns(uint64_t ns){
+    struct timespec req, rem;
+    req.tv_sec  = (time_t)(ns / 1000000000ull);
+    req.tv_nsec = (long)(ns % 1000000000ull);
+    while (nanosleep(&req, &rem) != 0 && errno == EINTR){
+        req = rem;
+    }
+}
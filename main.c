@@ -1,12 +1,432 @@
+#include "batch.h"
+#include "callgraph.h"
+#include "costmodel.h"
+#include "fanout.h"
+#include "gthreads.h"
+#include "memprof.h"
+#include "mv.h"
+#include "hostclock.h"
+#include "pipeline.h"
+#include "procs.h"
+#include "profile.h"
+#include "regions.h"
+#include "rescache.h"
+#include "sampler.h"
+#include "sched.h"
+#include "serve.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "trace.h"
+#include "tracebin.h"
 #include "vm.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <unistd.h>
+
+/* --max-insns=N, --max-time=MS, --max-output=BYTES y --limit-vmi=PREFIJO.
+   Devuelve 1 si a era una de ellas, 0 si no, -1 si el valor no sirve */
+static int limit_option(VmLimits* l, const char* a){
+  if (strncmp(a, "--limit-vmi=", 12) == 0){
+    l->dump_path = a + 12;
+    return 1;
+  }
+  uint64_t* dst;
+  uint64_t scale = 1;
+  const char* v;
+  if (strncmp(a, "--max-insns=", 12) == 0){
+    dst = &l->insns; v = a + 12;
+  } else if (strncmp(a, "--max-time=", 11) == 0){
+    dst = &l->wall_ns; v = a + 11; scale = 1000000ull;
+  } else if (strncmp(a, "--max-output=", 13) == 0){
+    dst = &l->out_bytes; v = a + 13;
+  } else {
+    return 0;
+  }
+  *dst = strtoull(v, NULL, 10) * scale;
+  if (*dst == 0){
+    fprintf(stderr,"%.*s debe ser >0\n", (int)(v - a - 1), a);
+    return -1;
+  }
+  return 1;
+}
+
+static bool limits_set(const VmLimits* l){
+  return l->insns || l->wall_ns || l->out_bytes;
+}
+
+static int main_batch(int argc, char** argv){
+  if (argc < 3){
+    fprintf(stderr,"--batch espera un manifiesto\n");
+    return 1;
+  }
+
+  const char* manifest = argv[2];
+  u32 ram_kib = RAM_DEFAULT_KIB;
+  u32 slice = 0;
+  u32 idle_ms = 0;
+  VmLimits limits = {0};
+  limits.dump_path = "limite";
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  unsigned threads = ncpu > 0 ? (unsigned)ncpu : 1u;
+
+  for (int i = 3; i < argc; ++i){
+    const char* a = argv[i];
+    int lim = limit_option(&limits, a);
+    if (lim < 0) return 1;
+    if (lim) continue;
+    if (strncmp(a, "--jobs=", 7) == 0){
+      threads = (unsigned)strtoul(a + 7, NULL, 10);
+      if (threads == 0){
+        fprintf(stderr,"--jobs debe ser >0\n");
+        return 1;
+      }
+    } else if (strcmp(a, "--sched") == 0){
+      slice = SCHED_SLICE_DEFAULT;
+    } else if (strncmp(a, "--sched=", 8) == 0){
+      slice = (u32)strtoul(a + 8, NULL, 10);
+      if (slice == 0){
+        fprintf(stderr,"--sched debe ser >0\n");
+        return 1;
+      }
+    } else if (strncmp(a, "--compact-idle=", 15) == 0){
+      idle_ms = (u32)strtoul(a + 15, NULL, 10);
+      if (idle_ms == 0){
+        fprintf(stderr,"--compact-idle debe ser >0\n");
+        return 1;
+      }
+    } else if (a[0]=='m' && a[1]=='='){
+      ram_kib = (u32)strtoul(a+2, NULL, 10);
+      if (ram_kib == 0){
+        fprintf(stderr,"m debe ser >0\n");
+        return 1;
+      }
+    } else {
+      fprintf(stderr,"Opcion desconocida en modo batch: %s\n", a);
+      return 1;
+    }
+  }
+
+  if (idle_ms && !slice){
+    fprintf(stderr,"--compact-idle requiere --sched\n");
+    return 1;
+  }
+
+  return batch_run(manifest, threads, ram_kib, slice, idle_ms,
+                   limits_set(&limits) ? &limits : NULL, stderr);
+}
+
+static int main_serve(int argc, char** argv){
+  if (argc < 3){
+    fprintf(stderr,"--serve espera la ruta del socket\n");
+    return 1;
+  }
+
+  u32 ram_kib = RAM_DEFAULT_KIB;
+  unsigned cache = SERVE_CACHE_DEFAULT;
+  VmLimits limits = {0};
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  unsigned threads = ncpu > 0 ? (unsigned)ncpu : 1u;
+
+  for (int i = 3; i < argc; ++i){
+    const char* a = argv[i];
+    int lim = limit_option(&limits, a);
+    if (lim < 0) return 1;
+    if (lim) continue;
+    if (strncmp(a, "--jobs=", 7) == 0){
+      threads = (unsigned)strtoul(a + 7, NULL, 10);
+      if (threads == 0){
+        fprintf(stderr,"--jobs debe ser >0\n");
+        return 1;
+      }
+    } else if (strncmp(a, "--cache=", 8) == 0){
+      cache = (unsigned)strtoul(a + 8, NULL, 10);
+      if (cache == 0){
+        fprintf(stderr,"--cache debe ser >0\n");
+        return 1;
+      }
+    } else if (a[0]=='m' && a[1]=='='){
+      ram_kib = (u32)strtoul(a+2, NULL, 10);
+      if (ram_kib == 0){
+        fprintf(stderr,"m debe ser >0\n");
+        return 1;
+      }
+    } else {
+      fprintf(stderr,"Opcion desconocida en modo servidor: %s\n", a);
+      return 1;
+    }
+  }
+
+  return serve_run(argv[2], threads, ram_kib, cache, limits_set(&limits) ? &limits : NULL, stderr);
+}
+
+/* --fanout=N [--seed=S] [--jobs=J] [m=KIB] [cuotas] programa.vmx [params...] */
+static int main_fanout(int argc, char** argv){
+  unsigned replicas = (unsigned)strtoul(argv[1] + 9, NULL, 10);
+  u32 ram_kib = RAM_DEFAULT_KIB;
+  uint64_t seed = 0;
+  bool have_seed = false;
+  VmLimits limits = {0};
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  unsigned threads = ncpu > 0 ? (unsigned)ncpu : 1u;
+
+  int i = 2;
+  for (; i < argc && (argv[i][0] == '-' || (argv[i][0]=='m' && argv[i][1]=='=')); ++i){
+    const char* a = argv[i];
+    int lim = limit_option(&limits, a);
+    if (lim < 0) return 1;
+    if (lim) continue;
+    if (strncmp(a, "--seed=", 7) == 0){
+      seed = strtoull(a + 7, NULL, 0);
+      have_seed = true;
+    } else if (strncmp(a, "--jobs=", 7) == 0){
+      threads = (unsigned)strtoul(a + 7, NULL, 10);
+      if (threads == 0){
+        fprintf(stderr,"--jobs debe ser >0\n");
+        return 1;
+      }
+    } else if (a[0]=='m' && a[1]=='='){
+      ram_kib = (u32)strtoul(a+2, NULL, 10);
+      if (ram_kib == 0){
+        fprintf(stderr,"m debe ser >0\n");
+        return 1;
+      }
+    } else {
+      fprintf(stderr,"Opcion desconocida en modo fanout: %s\n", a);
+      return 1;
+    }
+  }
+  if (i >= argc){
+    fprintf(stderr,"--fanout espera un programa\n");
+    return 1;
+  }
+  /* sin --seed se elige una y se informa, para poder repetir la corrida */
+  if (!have_seed) seed = host_now_ns();
+
+  return fanout_run(argv[i], &argv[i + 1], argc - i - 1, ram_kib, replicas, threads, seed,
+                    limits_set(&limits) ? &limits : NULL, stderr);
+}
+
+/* el mismo programa una vez por archivo de entrada, volviendo a la foto post-carga */
+static int main_each(int argc, char** argv){
+  if (argc < 4){
+    fprintf(stderr,"--each-input espera una lista de entradas y un programa\n");
+    return 1;
+  }
+
+  u32 ram_kib = RAM_DEFAULT_KIB;
+  int first = 4;
+  if (first < argc && argv[first][0]=='m' && argv[first][1]=='='){
+    ram_kib = (u32)strtoul(argv[first]+2, NULL, 10);
+    if (ram_kib == 0){
+      fprintf(stderr,"m debe ser >0\n");
+      return 1;
+    }
+    first++;
+  }
+  int argc_params = argc - first;
+
+  VM* vm = (VM*)malloc(sizeof *vm);
+  if (!vm) return 1;
+  vm_init_job(vm, ram_kib, argv[3], argc_params);
+
+  FILE* list = fopen(argv[2], "r");
+  if (!list){
+    fprintf(stderr, "Error: no pude abrir %s\n", argv[2]);
+    free(vm);
+    return 1;
+  }
+  if (!vm_load(vm, argc_params > 0 ? &argv[first] : NULL, argc_params)){
+    fclose(list);
+    free(vm);
+    return 1;
+  }
+  VmSnapshot* snap = vm_snapshot(vm);
+  if (!snap){
+    fclose(list);
+    free(vm);
+    return 1;
+  }
+
+  u32 runs = 0, failed = 0;
+  uint64_t run_ns = 0, reset_ns = 0;
+  char line[4096];
+  while (fgets(line, sizeof line, list)){
+    line[strcspn(line, "\r\n")] = 0;
+    if (line[0] == 0 || line[0] == '#') continue;
+
+    FILE* in = NULL;
+    if (strcmp(line, "-") != 0 && !(in = fopen(line, "r"))){
+      fprintf(stderr, "Error: no pude abrir %s\n", line);
+      failed++;
+      continue;
+    }
+    vmio_stdio(&vm->io, in, stdout);
+
+    uint64_t t0 = host_now_ns();
+    if (vm_run(vm) != 0) failed++;
+    uint64_t t1 = host_now_ns();
+    vm_reset(vm, snap);
+    reset_ns += host_now_ns() - t1;
+    run_ns   += t1 - t0;
+    runs++;
+    if (in) fclose(in);
+  }
+  fclose(list);
+  fflush(stdout);
+
+  if (runs){
+    fprintf(stderr, "== %u corridas, %u con error: %.1f us por corrida, reset %.2f us (%.1f paginas de %u bytes) ==\n",
+            runs, failed, (double)run_ns / runs / 1e3, (double)reset_ns / runs / 1e3,
+            (double)snap->pages / runs, VM_PAGE_BYTES);
+  }
+  vm_snapshot_free(snap);
+  vm_release(vm);
+  free(vm);
+  return failed ? 1 : 0;
+}
+
+/* --pipeline [m=KIB] [--report] a.vmx [params] '|' b.vmx ...
+   también acepta todo en un solo argumento: "a.vmx x | b.vmx" */
+static int main_pipeline(int argc, char** argv){
+  u32 ram_kib = RAM_DEFAULT_KIB;
+  bool report = false;
+  int i = 2;
+  for (; i < argc; ++i){
+    if (argv[i][0]=='m' && argv[i][1]=='='){
+      ram_kib = (u32)strtoul(argv[i]+2, NULL, 10);
+      if (ram_kib == 0){
+        fprintf(stderr,"m debe ser >0\n");
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--report") == 0){
+      report = true;
+    } else {
+      break;
+    }
+  }
+
+  char* words[1024];
+  int nwords = 0;
+  for (; i < argc; ++i){
+    char* save = NULL;
+    for (char* t = strtok_r(argv[i], " \t", &save); t && nwords < 1024; t = strtok_r(NULL, " \t", &save)){
+      words[nwords++] = t;
+    }
+  }
+
+  PipelineStage stages[PIPELINE_MAX_STAGES];
+  int n = 0;
+  for (int w = 0; w < nwords; ){
+    if (n == PIPELINE_MAX_STAGES || strcmp(words[w], "|") == 0){
+      fprintf(stderr,"--pipeline: etapa vacia o demasiadas etapas\n");
+      return 1;
+    }
+    int end = w;
+    while (end < nwords && strcmp(words[end], "|") != 0) end++;
+    stages[n].path   = words[w];
+    stages[n].params = &words[w + 1];
+    stages[n].argc   = end - w - 1;
+    n++;
+    w = end + 1;
+    if (end < nwords && w == nwords){
+      fprintf(stderr,"--pipeline: etapa vacia al final\n");
+      return 1;
+    }
+  }
+  if (n == 0){
+    fprintf(stderr,"--pipeline espera al menos un programa\n");
+    return 1;
+  }
+  return pipeline_run(stages, n, ram_kib, report ? stderr : NULL);
+}
 
 int main(int argc, char** argv){
+  if (argc >= 2 && strcmp(argv[1], "--batch") == 0){
+    return main_batch(argc, argv);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--pipeline") == 0){
+    return main_pipeline(argc, argv);
+  }
+  if (argc >= 2 && strncmp(argv[1], "--fanout=", 9) == 0){
+    return main_fanout(argc, argv);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--each-input") == 0){
+    return main_each(argc, argv);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--serve") == 0){
+    return main_serve(argc, argv);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--connect") == 0){
+    if (argc < 4){
+      fprintf(stderr,"--connect espera el socket y el programa\n");
+      return 1;
+    }
+    return serve_request(argv[2], argv[3], &argv[4], argc - 4);
+  }
+
   if (argc < 2){
-    fprintf(stderr,"Uso:\n" "  %s programa.vmx [param1 param2 ...]\n" "  %s programa.vmx [-d] [m=KIB] [-p param1 ...]\n" "  %s imagen.vmi [-d]\n", argv[0], argv[0], argv[0]);
+    fprintf(stderr,"Uso:\n" "  %s programa.vmx [param1 param2 ...]\n" "  %s programa.vmx [-d] [m=KIB] [-p param1 ...]\n" "  %s imagen.vmi [-d]\n"
+                   "  %s --batch MANIFIESTO [--jobs=N] [m=KIB]\n"
+                   "                      un trabajo por linea: programa.vmx entrada salida [params...]\n"
+                   "                      ('-' = sin entrada / stdout); resumen en stderr\n"
+                   "  --sched[=N]         con --batch: tareas cooperativas en --jobs hilos con robo de\n"
+                   "                      trabajo; expropia cada N instrucciones (20000) y suspende\n"
+                   "                      en SYS 1/3 hasta que la entrada (FIFO, tty) sea legible\n"
+                   "  --compact-idle=MS   con --sched: comprime en memoria las VM que esperan entrada\n"
+                   "                      mas de MS ms (paginas nulas fuera, el resto LZ)\n"
+                   "  %s --pipeline [m=KIB] [--report] 'a.vmx [params] | b.vmx ...'\n"
+                   "                      cada etapa en su hilo; SYS 2/4 de una alimentan SYS 1/3\n"
+                   "                      de la siguiente por un buffer en memoria\n"
+                   "  %s --each-input LISTA programa.vmx [m=KIB] [params...]\n"
+                   "                      una corrida por archivo de LISTA ('-' = sin entrada); entre\n"
+                   "                      corridas restaura solo las paginas de ram escritas\n"
+                   "  %s --fanout=N [--seed=S] [--jobs=J] [m=KIB] programa.vmx [params...]\n"
+                   "                      N replicas en paralelo, la i con RND sembrado con S+i\n"
+                   "                      (reproducible); misma stdin para todas y la salida en\n"
+                   "                      orden con '[i] ' en cada linea; resumen en stderr\n"
+                   "  %s --serve SOCKET [--jobs=N] [--cache=N] [m=KIB]\n"
+                   "                      servidor en un socket Unix con cache LRU de programas (64);\n"
+                   "                      cada trabajo con --max-time=60000 si no se pide otro, y\n"
+                   "                      se abandona si el cliente se desconecta\n"
+                   "  %s --connect SOCKET programa.vmx|#HASH [params...]\n"
+                   "                      corre el programa en el servidor con esta stdin/stdout\n"
+                   "Traza (-d):\n"
+                   "  --trace-file=ARCH   escribe la traza en ARCH en lugar de stdout\n"
+                   "  --trace-range=LO:HI solo direcciones fisicas LO..HI (hex)\n"
+                   "  --trace-every=N     una de cada N instrucciones\n"
+                   "  --trace-bin=ARCH    traza binaria compacta (leer con mv-trace)\n"
+                   "Perfil:\n"
+                   "  --profile[=ARCH]    cuenta ejecuciones por instruccion y opcode;\n"
+                   "                      listado anotado en stderr y datos en ARCH (mv.prof)\n"
+                   "  --callgraph[=ARCH]  tiempos inclusivos/exclusivos por subrutina (CALL/RET);\n"
+                   "                      pilas colapsadas para flame graphs en ARCH (mv.folded)\n"
+                   "  --memprof[=ARCH]    mapa de calor de accesos a memoria y working set;\n"
+                   "                      datos en ARCH (mv.memprof)\n"
+                   "  --memprof-window=N  instrucciones por muestra de working set (10000)\n"
+                   "  --memprof-cache=BYTES,VIAS,LINEA  simula una cache asociativa\n"
+                   "  --sample=HZ         muestreo estadistico de IP y pila con SIGPROF\n"
+                   "Procesos (SYS 0x20-0x23):\n"
+                   "  --quantum=N         instrucciones por turno entre procesos invitados (10000)\n"
+                   "SYS nativos:\n"
+                   "  --sys-plugin=ARCH   carga un .so que atiende numeros de SYS (ver mv.h);\n"
+                   "                      se puede repetir, el ultimo que registra un numero gana\n"
+                   "Cuotas (tambien con --batch, --serve y --fanout):\n"
+                   "  --max-insns=N       corta despues de N instrucciones\n"
+                   "  --max-time=MS       corta despues de MS ms de reloj\n"
+                   "  --max-output=BYTES  corta la primera salida que pase de BYTES\n"
+                   "  --limit-vmi=PREF    al cortar vuelca el estado en PREF.vmi (limite.vmi; con\n"
+                   "                      --batch PREF.LINEA.vmi); sale con codigo 3\n"
+                   "Cache de resultados:\n"
+                   "  --result-cache=DIR  corridas deterministas (sin RND, reloj, SYS 0xF, procesos ni\n"
+                   "                      hilos) se guardan por hash(programa, params, m=, stdin) y se\n"
+                   "                      repiten sin ejecutar (solo las que terminan con codigo 0)\n"
+                   "Estadisticas:\n"
+                   "  --stats[=json]      tiempos por fase, MIPS, accesos a memoria y SYS en JSON (stderr)\n"
+                   "  --stats-out=ARCH    escribe el JSON en ARCH\n"
+                   "  --cost[=TABLA]      contador de ciclos virtuales (SYS 0x10); TABLA con lineas\n"
+                   "                      'op MNEM n', 'operand reg|imm|mem n', 'sys N n'\n", argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
     return 1;
   }
 
@@ -17,14 +437,179 @@ int main(int argc, char** argv){
   int user_args_start = -1;
   bool saw_p_flag = false;
 
+  const char* trace_path = NULL;
+  u32 trace_lo = 0, trace_hi = 0xFFFFu, trace_every = 1;
+  const char* tracebin_path = NULL;
+
+  const char* profile_path = NULL;
+  const char* callgraph_path = NULL;
+  u32 sample_hz = 0;
+
+  bool want_cost = false;
+  const char* cost_path = NULL;
+
+  bool want_stats = false;
+  const char* stats_path = NULL;
+
+  const char* memprof_path = NULL;
+  u32 memprof_window = MEMPROF_WINDOW_DEFAULT;
+  CacheConfig cache_cfg = {0, 0, 0};
+  bool have_cache = false;
+
+  const char* result_dir = NULL;
+  char limit_vmi[4096];
+  MvSysTable* systab = NULL;
+
   for (int i = 1; i < argc; ++i){
     const char* a = argv[i];
 
+    int lim = limit_option(&vm.limits, a);
+    if (lim < 0) return 1;
+    if (lim) continue;
+
     if (strcmp(a, "-d") == 0){
       vm.disassemble = 1;
       continue;
     }
 
+    if (strncmp(a, "--trace-file=", 13) == 0){
+      trace_path = a + 13;
+      vm.disassemble = 1;
+      continue;
+    }
+
+    if (strncmp(a, "--trace-bin=", 12) == 0){
+      tracebin_path = a + 12;
+      continue;
+    }
+
+    if (strncmp(a, "--trace-range=", 14) == 0){
+      char* end = NULL;
+      trace_lo = (u32)strtoul(a + 14, &end, 16);
+      if (!end || *end != ':' || trace_lo > 0xFFFFu){
+        fprintf(stderr,"--trace-range espera LO:HI en hexadecimal\n");
+        return 1;
+      }
+      trace_hi = (u32)strtoul(end + 1, NULL, 16);
+      if (trace_hi > 0xFFFFu) trace_hi = 0xFFFFu;
+      continue;
+    }
+
+    if (strncmp(a, "--trace-every=", 14) == 0){
+      trace_every = (u32)strtoul(a + 14, NULL, 10);
+      if (trace_every == 0){
+        fprintf(stderr,"--trace-every debe ser >0\n");
+        return 1;
+      }
+      continue;
+    }
+
+    if (strcmp(a, "--profile") == 0){
+      profile_path = "mv.prof";
+      continue;
+    }
+
+    if (strncmp(a, "--profile=", 10) == 0){
+      profile_path = a + 10;
+      continue;
+    }
+
+    if (strcmp(a, "--callgraph") == 0){
+      callgraph_path = "mv.folded";
+      continue;
+    }
+
+    if (strncmp(a, "--callgraph=", 12) == 0){
+      callgraph_path = a + 12;
+      continue;
+    }
+
+    if (strncmp(a, "--sample=", 9) == 0){
+      sample_hz = (u32)strtoul(a + 9, NULL, 10);
+      if (sample_hz == 0 || sample_hz > 100000u){
+        fprintf(stderr,"--sample espera una frecuencia entre 1 y 100000 Hz\n");
+        return 1;
+      }
+      continue;
+    }
+
+    if (strncmp(a, "--quantum=", 10) == 0){
+      vm.proc_quantum = (u32)strtoul(a + 10, NULL, 10);
+      if (vm.proc_quantum == 0){
+        fprintf(stderr,"--quantum debe ser >0\n");
+        return 1;
+      }
+      continue;
+    }
+
+    if (strcmp(a, "--cost") == 0){
+      want_cost = true;
+      continue;
+    }
+
+    if (strncmp(a, "--cost=", 7) == 0){
+      want_cost = true;
+      cost_path = a + 7;
+      continue;
+    }
+
+    if (strcmp(a, "--stats") == 0 || strcmp(a, "--stats=json") == 0){
+      want_stats = true;
+      continue;
+    }
+
+    if (strncmp(a, "--stats-out=", 12) == 0){
+      want_stats = true;
+      stats_path = a + 12;
+      continue;
+    }
+
+    if (strncmp(a, "--sys-plugin=", 13) == 0){
+      if (!systab) systab = mv_systab_create();
+      if (!systab || !mv_systab_load(systab, a + 13)) return 1;
+      vm.systab = systab;
+      continue;
+    }
+
+    if (strncmp(a, "--result-cache=", 15) == 0){
+      result_dir = a + 15;
+      continue;
+    }
+
+    if (strcmp(a, "--memprof") == 0){
+      memprof_path = "mv.memprof";
+      continue;
+    }
+
+    if (strncmp(a, "--memprof=", 10) == 0){
+      memprof_path = a + 10;
+      continue;
+    }
+
+    if (strncmp(a, "--memprof-window=", 17) == 0){
+      memprof_window = (u32)strtoul(a + 17, NULL, 10);
+      if (memprof_window == 0){
+        fprintf(stderr,"--memprof-window debe ser >0\n");
+        return 1;
+      }
+      continue;
+    }
+
+    if (strncmp(a, "--memprof-cache=", 16) == 0){
+      unsigned long sz = 0, ways = 0, line = 0;
+      if (sscanf(a + 16, "%lu,%lu,%lu", &sz, &ways, &line) != 3 ||
+          ways == 0 || line == 0 || (line & (line - 1)) != 0 || sz < ways * line){
+        fprintf(stderr,"--memprof-cache espera BYTES,VIAS,LINEA (LINEA potencia de 2)\n");
+        return 1;
+      }
+      cache_cfg.size_bytes = (u32)sz;
+      cache_cfg.ways = (u32)ways;
+      cache_cfg.line = (u32)line;
+      have_cache = true;
+      if (!memprof_path) memprof_path = "mv.memprof";
+      continue;
+    }
+
     if (a[0]=='m' && a[1]=='='){
       vm.ram_kib = (uint32_t)strtoul(a+2, NULL, 10);
       if (vm.ram_kib == 0){
@@ -67,6 +652,11 @@ int main(int argc, char** argv){
     return 1;
   }
 
+  if (limits_set(&vm.limits)){
+    snprintf(limit_vmi, sizeof limit_vmi, "%s.vmi", vm.limits.dump_path ? vm.limits.dump_path : "limite");
+    vm.limits.dump_path = limit_vmi;
+  }
+
   char** params = NULL;
   int param_count = 0;
 
@@ -93,11 +683,149 @@ int main(int argc, char** argv){
     params = NULL;
     param_count = 0;
   }
+  /* cache de resultados: la clave incluye toda la entrada, así que se lee
+     antes de correr y el invitado la consume desde memoria */
+  char* cache_in = NULL;
+  size_t cache_in_len = 0;
+  VmInBuf cache_inbuf = {0};
+  Fnv128 cache_key;
+  VmOutBuf cache_out = {0};
+  if (result_dir){
+    if (!vm.have_vmx || vm.disassemble || profile_path || callgraph_path || memprof_path ||
+        tracebin_path || want_cost || want_stats || sample_hz || limits_set(&vm.limits)){
+      fprintf(stderr,"--result-cache se ignora con .vmi, -d, --stats, cuotas y las herramientas de perfil\n");
+      result_dir = NULL;
+    } else {
+      cache_in = vmio_read_all(stdin, &cache_in_len);
+      if (!cache_in || !rescache_key(&cache_key, vm.opt_vmx_path, params, param_count,
+                                     vm.ram_kib, cache_in, cache_in_len)){
+        fprintf(stderr,"No pude cargar la VM.\n");
+        free(cache_in);
+        return 1;
+      }
+      int cached_rc = 0;
+      if (rescache_lookup(result_dir, &cache_key, &cache_out, &cached_rc)){
+        if (cache_out.len) fwrite(cache_out.data, 1, cache_out.len, stdout);
+        fflush(stdout);
+        vmio_outbuf_free(&cache_out);
+        free(cache_in);
+        return cached_rc;
+      }
+      cache_inbuf.data = cache_in;
+      cache_inbuf.len  = cache_in_len;
+      vmio_input(&vm.io, &cache_inbuf);
+      vmio_capture(&vm.io, &cache_out);
+    }
+  }
+
   if (!vm_load(&vm, params, param_count)){
     fprintf(stderr,"No pude cargar la VM.\n");
     return 1;
   }
 
+  if (vm.disassemble){
+    vm.trace = trace_open(trace_path);
+    if (!vm.trace) return 1;
+    trace_set_range(vm.trace, (u16)trace_lo, (u16)trace_hi);
+    trace_set_every(vm.trace, trace_every);
+  }
+
+  if (profile_path){
+    vm.profile = profile_create(&vm);
+    if (!vm.profile) return 1;
+  }
+
+  if (callgraph_path){
+    vm.callgraph = callgraph_create(&vm);
+    if (!vm.callgraph) return 1;
+  }
+
+  if (memprof_path){
+    vm.memprof = memprof_create(&vm, memprof_window, have_cache ? &cache_cfg : NULL);
+    if (!vm.memprof) return 1;
+  }
+
+  if (tracebin_path){
+    vm.tracebin = tracebin_open(&vm, tracebin_path);
+    if (!vm.tracebin) return 1;
+  }
+
+  if (want_cost){
+    vm.cost = cost_create(cost_path);
+    if (!vm.cost) return 1;
+  }
+
+  Sampler* sampler = NULL;
+  if (sample_hz){
+    sampler = sampler_start(&vm, sample_hz);
+    if (!sampler) return 1;
+  }
+
   int rc = vm_run(&vm);
+  sampler_stop(sampler);
+
+  if (result_dir){
+    if (cache_out.len) fwrite(cache_out.data, 1, cache_out.len, stdout);
+    fflush(stdout);
+    /* solo las que terminan bien: un error se informa en stderr, que no se guarda */
+    if (!vm.nondet && rc == 0 && !rescache_store(result_dir, &cache_key, &cache_out, rc)){
+      fprintf(stderr, "Error: no pude guardar el resultado en %s\n", result_dir);
+    }
+    vmio_outbuf_free(&cache_out);
+    free(cache_in);
+  }
+  trace_close(vm.trace);
+  tracebin_close(vm.tracebin);
+
+  if (sampler){
+    sampler_report(sampler, &vm, stderr);
+    sampler_destroy(sampler);
+  }
+
+  if (vm.regions){
+    regions_report(vm.regions, host_now_ns(), vm.stats.insns, stderr);
+  }
+
+  if (vm.procs){
+    procs_report(vm.procs, stderr);
+  }
+  if (vm.threads){
+    gthreads_report(vm.threads, stderr);
+  }
+  vm_release(&vm);
+  mv_systab_destroy(systab);
+
+  if (vm.cost){
+    cost_report(vm.cost, &vm, stderr);
+    cost_destroy(vm.cost);
+  }
+
+  if (want_stats){
+    FILE* sf = stats_path ? fopen(stats_path, "w") : stderr;
+    if (!sf){
+      fprintf(stderr, "Error: no pude abrir %s\n", stats_path);
+    } else {
+      stats_write_json(&vm.stats, sf);
+      if (sf != stderr) fclose(sf);
+    }
+  }
+
+  if (vm.profile){
+    profile_report(vm.profile, &vm, stderr);
+    profile_write(vm.profile, &vm, profile_path);
+    profile_destroy(vm.profile);
+  }
+
+  if (vm.callgraph){
+    callgraph_report(vm.callgraph, stderr);
+    callgraph_write_folded(vm.callgraph, callgraph_path);
+    callgraph_destroy(vm.callgraph);
+  }
+
+  if (vm.memprof){
+    memprof_report(vm.memprof, &vm, stderr);
+    memprof_write(vm.memprof, &vm, memprof_path);
+    memprof_destroy(vm.memprof);
+  }
   return rc;
 }
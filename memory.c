@@ -1,4 +1,8 @@
 #include "memory.h"
+#include "memprof.h"
+#include "probes.h"
+#include "tracebin.h"
+#include <pthread.h>
 #include <string.h>
 #include <stdio.h>
 
@@ -40,18 +44,27 @@ bool translate_and_check_instr(VM* vm, u16 seg_idx, u16 offset, u16 nbytes, u16*
     return translate_and_check(vm, seg_idx, offset, nbytes, out_phys);
 }
 
+static inline void mark_dirty(VM* vm, u16 phys, u16 nbytes){
+    vm->dirty |= (1ull << ((phys >> VM_PAGE_SHIFT) & 63u))
+               | (1ull << ((((u32)phys + nbytes - 1u) >> VM_PAGE_SHIFT) & 63u));
+}
+
 static bool read_bytes(VM* vm, u16 seg_idx, u16 offset, void* dst, u16 nbytes){
     u16 phys;
     if (!translate_and_check_data(vm, seg_idx, offset, nbytes, &phys)){
+        MV_PROBE4(mem__fault, seg_idx, offset, nbytes, 0);
         return false;
     }
 
     set_lar_mar(vm, seg_idx, offset, nbytes, phys);
 
-    memcpy(dst, &vm->ram[phys], nbytes);
+    vm->stats.mem_reads[stats_width_slot(nbytes)]++;
+    if (vm->memprof) memprof_access(vm->memprof, seg_idx, offset, phys, nbytes, false);
+
+    memcpy(dst, &vm->mem[phys], nbytes);
 
     u32 mbr = 0;
-    const u8* p = &vm->ram[phys];
+    const u8* p = &vm->mem[phys];
     switch (nbytes){
         case 1:
             mbr = (u32)p[0];
@@ -72,6 +85,7 @@ static bool read_bytes(VM* vm, u16 seg_idx, u16 offset, void* dst, u16 nbytes){
 static bool write_bytes(VM* vm, u16 seg_idx, u16 offset, const void* src, u16 nbytes){
     u16 phys;
     if (!translate_and_check_data(vm, seg_idx, offset, nbytes, &phys)){
+        MV_PROBE4(mem__fault, seg_idx, offset, nbytes, 1);
         return false;
     }
 
@@ -94,7 +108,104 @@ static bool write_bytes(VM* vm, u16 seg_idx, u16 offset, const void* src, u16 nb
     }
     vm->reg[MBR] = mbr;
 
-    memcpy(&vm->ram[phys], src, nbytes);
+    vm->stats.mem_writes[stats_width_slot(nbytes)]++;
+    if (vm->memprof) memprof_access(vm->memprof, seg_idx, offset, phys, nbytes, true);
+    if (vm->tracebin) tracebin_mem(vm->tracebin, phys, nbytes, mbr);
+
+    mark_dirty(vm, phys, nbytes);
+    memcpy(&vm->mem[phys], src, nbytes);
+    return true;
+}
+
+/* ram guarda big-endian: las atómicas trabajan sobre la palabra tal como está
+   en memoria y convierten los valores al entrar y salir */
+static inline u32 ram_word(u32 v){
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap32(v);
+#else
+    return v;
+#endif
+}
+
+/* las celdas que no quedan alineadas a 4 en el host (los segmentos empiezan
+   en cualquier byte) se serializan con un lock común; una celda dada es
+   siempre alineada o siempre no, así que nunca se mezclan los dos caminos */
+static pthread_mutex_t unaligned_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline bool host_aligned(const u32* w){
+    return ((uintptr_t)w & 3u) == 0;
+}
+
+static u32* atomic_cell(VM* vm, u16 seg_idx, u16 offset, u16* out_phys){
+    u16 phys;
+    if (!translate_and_check_data(vm, seg_idx, offset, 4, &phys)){
+        MV_PROBE4(mem__fault, seg_idx, offset, 4, 1);
+        return NULL;
+    }
+    set_lar_mar(vm, seg_idx, offset, 4, phys);
+    mark_dirty(vm, phys, 4);
+
+    vm->stats.mem_reads[2]++;
+    vm->stats.mem_writes[2]++;
+    if (vm->memprof){
+        memprof_access(vm->memprof, seg_idx, offset, phys, 4, false);
+        memprof_access(vm->memprof, seg_idx, offset, phys, 4, true);
+    }
+    *out_phys = phys;
+    return (u32*)(void*)&vm->mem[phys];
+}
+
+bool mem_atomic_cas32(VM* vm, u16 seg_idx, u16 offset, u32 expected, u32 desired, u32* old){
+    u16 phys;
+    u32* w = atomic_cell(vm, seg_idx, offset, &phys);
+    if (!w) return false;
+
+    bool ok;
+    if (host_aligned(w)){
+        u32 cur = ram_word(expected);
+        ok = __atomic_compare_exchange_n(w, &cur, ram_word(desired), false,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+        *old = ok ? expected : ram_word(cur);
+    } else {
+        u32 cur;
+        pthread_mutex_lock(&unaligned_lock);
+        memcpy(&cur, w, 4);
+        ok = (ram_word(cur) == expected);
+        if (ok){
+            u32 v = ram_word(desired);
+            memcpy(w, &v, 4);
+        }
+        pthread_mutex_unlock(&unaligned_lock);
+        *old = ram_word(cur);
+    }
+    vm->reg[MBR] = ok ? desired : *old;
+    if (ok && vm->tracebin) tracebin_mem(vm->tracebin, phys, 4, desired);
+    return true;
+}
+
+bool mem_atomic_add32(VM* vm, u16 seg_idx, u16 offset, u32 delta, u32* old){
+    u16 phys;
+    u32* w = atomic_cell(vm, seg_idx, offset, &phys);
+    if (!w) return false;
+
+    u32 cur, sum;
+    if (host_aligned(w)){
+        cur = __atomic_load_n(w, __ATOMIC_RELAXED);
+        do {
+            sum = ram_word(cur) + delta;
+        } while (!__atomic_compare_exchange_n(w, &cur, ram_word(sum), true,
+                                              __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+    } else {
+        pthread_mutex_lock(&unaligned_lock);
+        memcpy(&cur, w, 4);
+        sum = ram_word(cur) + delta;
+        u32 v = ram_word(sum);
+        memcpy(w, &v, 4);
+        pthread_mutex_unlock(&unaligned_lock);
+    }
+    *old = ram_word(cur);
+    vm->reg[MBR] = sum;
+    if (vm->tracebin) tracebin_mem(vm->tracebin, phys, 4, sum);
     return true;
 }
 
@@ -138,8 +249,49 @@ bool mem_write_u32(VM* vm, u16 seg_idx, u16 offset, u32 value){
     return write_bytes(vm, seg_idx, offset, b, 4);
 }
 
+bool mem_read_string(VM* vm, u32 ptr, char* buf, size_t cap){
+    u16 seg = hi16(ptr);
+    u16 off = lo16(ptr);
+    size_t n = 0;
+    for (;;){
+        u32 ch;
+        if (!mem_read_u8(vm, seg, off, &ch)) return false;
+        off++;
+        if (ch == 0) break;
+        if (n + 1 < cap) buf[n++] = (char)ch;
+    }
+    buf[n] = 0;
+    return true;
+}
+
+static bool host_range(VM* vm, u32 ptr, size_t n, u16* phys){
+    if (n == 0) return true;
+    if (n > 0xFFFFu || !translate_and_check_data(vm, hi16(ptr), lo16(ptr), (u16)n, phys)){
+        MV_PROBE4(mem__fault, hi16(ptr), lo16(ptr), (u16)n, 0);
+        return false;
+    }
+    return true;
+}
+
+bool mem_host_read(VM* vm, u32 ptr, void* dst, size_t n){
+    u16 phys = 0;
+    if (!host_range(vm, ptr, n, &phys)) return false;
+    memcpy(dst, &vm->mem[phys], n);
+    return true;
+}
+
+bool mem_host_write(VM* vm, u32 ptr, const void* src, size_t n){
+    u16 phys = 0;
+    if (!host_range(vm, ptr, n, &phys)) return false;
+    memcpy(&vm->mem[phys], src, n);
+    for (u32 p = phys >> VM_PAGE_SHIFT; n && p <= ((u32)phys + n - 1u) >> VM_PAGE_SHIFT; p++){
+        vm->dirty |= 1ull << (p & 63u);
+    }
+    return true;
+}
+
 bool code_read_bytes(VM* vm, u16 phys, void* dst, u16 nbytes){
-    memcpy(dst, &vm->ram[phys], nbytes);
+    memcpy(dst, &vm->mem[phys], nbytes);
     return true;
 }
 
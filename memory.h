@@ -1,6 +1,7 @@
 #pragma once
 #include "vm.h"
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 static inline uint32_t make_logical(u16 seg_idx, u16 offset) {
@@ -28,4 +29,18 @@ bool mem_write_u8(VM* vm, u16 seg_idx, u16 offset, u32 value);
 bool mem_write_u16(VM* vm, u16 seg_idx, u16 offset, u32 value);
 bool mem_write_u32(VM* vm, u16 seg_idx, u16 offset, u32 value);
 
+/* CAS/XADD de 4 bytes (gthreads.h).
+   *old recibe el valor que había; el CAS escribió si *old == expected */
+bool mem_atomic_cas32(VM* vm, u16 seg_idx, u16 offset, u32 expected, u32 desired, u32* old);
+bool mem_atomic_add32(VM* vm, u16 seg_idx, u16 offset, u32 delta, u32* old);
+
+/* acceso desde el host (libmv, SYS nativos) a n bytes en ptr = segmento:offset.
+   Mismo control de segmento que el invitado, pero no toca LAR/MAR/MBR ni
+   los contadores de accesos */
+bool mem_host_read (VM* vm, u32 ptr, void* dst, size_t n);
+bool mem_host_write(VM* vm, u32 ptr, const void* src, size_t n);
+
+/* copia una cadena del invitado terminada en 0 (se trunca a cap-1) */
+bool mem_read_string(VM* vm, u32 ptr, char* buf, size_t cap);
+
 bool code_read_bytes(VM* vm, u16 phys,void* dst, u16 nbytes);
@@ -0,0 +1,228 @@
+#include "memprof.h"
+#include "disasm.h"
+#include "decoder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HEAT_COLS 32
+
+MemProf* memprof_create(VM* vm, u32 window, const CacheConfig* cache){
+    MemProf* mp = (MemProf*)calloc(1, sizeof *mp);
+    if (!mp) return NULL;
+
+    mp->line = (cache && cache->line) ? cache->line : MEMPROF_LINE_DEFAULT;
+    mp->window = window ? window : MEMPROF_WINDOW_DEFAULT;
+    mp->window_left = mp->window;
+
+    for (int i = 0; i < SEG_COUNT; i++){
+        if (vm->seg[i].size == 0) continue;
+        mp->nblocks[i] = ((u32)vm->seg[i].size + mp->line - 1u) / mp->line;
+        mp->reads[i]  = (uint64_t*)calloc(mp->nblocks[i], sizeof(uint64_t));
+        mp->writes[i] = (uint64_t*)calloc(mp->nblocks[i], sizeof(uint64_t));
+        if (!mp->reads[i] || !mp->writes[i]) goto fail;
+    }
+
+    mp->touched_blocks = ((u32)vm->ram_kib * 1024u + mp->line - 1u) / mp->line;
+    mp->touched = (u8*)calloc(mp->touched_blocks, 1);
+    if (!mp->touched) goto fail;
+
+    if (cache){
+        if (cache->ways == 0 || cache->size_bytes < cache->ways * mp->line){
+            fprintf(stderr, "Error: configuración de caché inválida\n");
+            goto fail;
+        }
+        mp->cache_on = 1;
+        mp->cache    = *cache;
+        mp->cache.line = mp->line;
+        mp->sets = cache->size_bytes / (cache->ways * mp->line);
+        mp->tags = (u32*)malloc((size_t)mp->sets * cache->ways * sizeof(u32));
+        mp->lru  = (u32*)calloc((size_t)mp->sets * cache->ways, sizeof(u32));
+        mp->pc_cap    = vm->code_size;
+        mp->pc_hits   = (uint64_t*)calloc(mp->pc_cap ? mp->pc_cap : 1u, sizeof(uint64_t));
+        mp->pc_misses = (uint64_t*)calloc(mp->pc_cap ? mp->pc_cap : 1u, sizeof(uint64_t));
+        if (!mp->tags || !mp->lru || !mp->pc_hits || !mp->pc_misses) goto fail;
+        memset(mp->tags, 0xFF, (size_t)mp->sets * cache->ways * sizeof(u32));
+    }
+    return mp;
+
+fail:
+    memprof_destroy(mp);
+    return NULL;
+}
+
+void memprof_destroy(MemProf* mp){
+    if (!mp) return;
+    for (int i = 0; i < SEG_COUNT; i++){
+        free(mp->reads[i]);
+        free(mp->writes[i]);
+    }
+    free(mp->touched);
+    free(mp->ws_series);
+    free(mp->tags);
+    free(mp->lru);
+    free(mp->pc_hits);
+    free(mp->pc_misses);
+    free(mp);
+}
+
+void memprof_close_window(MemProf* mp){
+    mp->window_left = mp->window;
+    if (mp->ws_count == mp->ws_cap){
+        u32 cap = mp->ws_cap ? mp->ws_cap * 2u : 64u;
+        u32* s = (u32*)realloc(mp->ws_series, cap * sizeof(u32));
+        if (!s) return;
+        mp->ws_series = s;
+        mp->ws_cap = cap;
+    }
+    mp->ws_series[mp->ws_count++] = mp->ws_now;
+    memset(mp->touched, 0, mp->touched_blocks);
+    mp->ws_now = 0;
+}
+
+static void cache_access(MemProf* mp, u32 block){
+    u32 ways = mp->cache.ways;
+    u32 set  = block % mp->sets;
+    u32* tags = &mp->tags[set * ways];
+    u32* lru  = &mp->lru[set * ways];
+    u32 victim = 0;
+
+    mp->lru_clock++;
+    for (u32 w = 0; w < ways; w++){
+        if (tags[w] == block){
+            lru[w] = mp->lru_clock;
+            mp->hits++;
+            if (mp->pc < mp->pc_cap) mp->pc_hits[mp->pc]++;
+            return;
+        }
+        if (lru[w] < lru[victim]) victim = w;
+    }
+    tags[victim] = block;
+    lru[victim]  = mp->lru_clock;
+    mp->misses++;
+    if (mp->pc < mp->pc_cap) mp->pc_misses[mp->pc]++;
+}
+
+void memprof_access(MemProf* mp, u16 seg_idx, u16 offset, u16 phys, u16 nbytes, bool is_write){
+    u32 b = (u32)offset / mp->line;
+    if (seg_idx < SEG_COUNT && b < mp->nblocks[seg_idx]){
+        if (is_write) mp->writes[seg_idx][b]++;
+        else          mp->reads[seg_idx][b]++;
+    }
+
+    u32 first = (u32)phys / mp->line;
+    u32 last  = ((u32)phys + nbytes - 1u) / mp->line;
+    for (u32 blk = first; blk <= last; blk++){
+        if (blk < mp->touched_blocks && !mp->touched[blk]){
+            mp->touched[blk] = 1;
+            mp->ws_now++;
+        }
+        if (mp->cache_on) cache_access(mp, blk);
+    }
+}
+
+static char heat_char(uint64_t n, uint64_t max){
+    static const char ramp[] = " .:-=+*#%@";
+    if (n == 0 || max == 0) return ramp[0];
+    u32 i = (u32)(1 + (n * 8u) / max);
+    return ramp[i > 9 ? 9 : i];
+}
+
+void memprof_report(MemProf* mp, VM* vm, FILE* out){
+    fprintf(out, "MEMPROF: bloques de %u bytes\n", (unsigned)mp->line);
+
+    for (int s = 0; s < SEG_COUNT; s++){
+        if (!mp->nblocks[s]) continue;
+        uint64_t tr = 0, tw = 0, max = 0;
+        for (u32 b = 0; b < mp->nblocks[s]; b++){
+            tr += mp->reads[s][b];
+            tw += mp->writes[s][b];
+            uint64_t n = mp->reads[s][b] + mp->writes[s][b];
+            if (n > max) max = n;
+        }
+        fprintf(out, " %d %-6s base=%04X size=%04X  lecturas=%llu escrituras=%llu\n",
+                s, disasm_segment_kind(vm, s), (unsigned)vm->seg[s].base, (unsigned)vm->seg[s].size,
+                (unsigned long long)tr, (unsigned long long)tw);
+        if (!tr && !tw) continue;
+
+        /* una fila por HEAT_COLS bloques: R = lecturas, W = escrituras */
+        for (u32 row = 0; row < mp->nblocks[s]; row += HEAT_COLS){
+            char r[HEAT_COLS + 1], w[HEAT_COLS + 1];
+            u32 n = 0;
+            for (; n < HEAT_COLS && row + n < mp->nblocks[s]; n++){
+                r[n] = heat_char(mp->reads[s][row + n], max);
+                w[n] = heat_char(mp->writes[s][row + n], max);
+            }
+            r[n] = w[n] = 0;
+            fprintf(out, "   +%04X R |%s|\n", (unsigned)(row * mp->line), r);
+            fprintf(out, "         W |%s|\n", w);
+        }
+    }
+
+    fprintf(out, "WORKING SET (bloques por ventana de %u instrucciones):\n", (unsigned)mp->window);
+    u32 peak = 0;
+    for (u32 i = 0; i < mp->ws_count; i++) if (mp->ws_series[i] > peak) peak = mp->ws_series[i];
+    if (mp->ws_now > peak) peak = mp->ws_now;
+    for (u32 i = 0; i <= mp->ws_count; i++){
+        u32 v = (i < mp->ws_count) ? mp->ws_series[i] : mp->ws_now;
+        if (i == mp->ws_count && v == 0) break;
+        u32 bar = peak ? (v * 40u + peak - 1u) / peak : 0;
+        fprintf(out, " %8u %5u %6u B ", (unsigned)i, (unsigned)v, (unsigned)(v * mp->line));
+        for (u32 k = 0; k < bar; k++) fputc('#', out);
+        fputc('\n', out);
+    }
+
+    if (mp->cache_on){
+        uint64_t acc = mp->hits + mp->misses;
+        fprintf(out, "CACHE %u B, %u vías, línea %u B (%u conjuntos): aciertos %llu / %llu (%.2f%%)\n",
+                (unsigned)mp->cache.size_bytes, (unsigned)mp->cache.ways, (unsigned)mp->line,
+                (unsigned)mp->sets, (unsigned long long)mp->hits, (unsigned long long)acc,
+                acc ? 100.0 * (double)mp->hits / (double)acc : 0.0);
+        for (u32 a = 0; a < mp->pc_cap; a++){
+            uint64_t n = mp->pc_hits[a] + mp->pc_misses[a];
+            if (!n) continue;
+            char text[DISASM_LINE_MAX] = "";
+            DecodedInst di;
+            if (vm->idx_code >= 0 && decode_at(vm, (u16)vm->idx_code, (u16)(a - vm->seg[vm->idx_code].base), &di)){
+                disasm_format(vm, &di, text, sizeof text);
+            }
+            fprintf(out, " %10llu %6.2f%%  %s\n", (unsigned long long)n,
+                    100.0 * (double)mp->pc_hits[a] / (double)n, text);
+        }
+    }
+    fputc('\n', out);
+}
+
+bool memprof_write(MemProf* mp, VM* vm, const char* path){
+    FILE* f = fopen(path, "w");
+    if (!f){
+        fprintf(stderr, "Error: no pude abrir el archivo de memprof %s\n", path);
+        return false;
+    }
+
+    fprintf(f, "# mv-memprof 1\n");
+    fprintf(f, "line\t%u\nwindow\t%u\n", (unsigned)mp->line, (unsigned)mp->window);
+    for (int s = 0; s < SEG_COUNT; s++){
+        for (u32 b = 0; b < mp->nblocks[s]; b++){
+            if (!mp->reads[s][b] && !mp->writes[s][b]) continue;
+            fprintf(f, "block\t%d\t%s\t%04X\t%llu\t%llu\n", s, disasm_segment_kind(vm, s),
+                    (unsigned)(b * mp->line),
+                    (unsigned long long)mp->reads[s][b], (unsigned long long)mp->writes[s][b]);
+        }
+    }
+    for (u32 i = 0; i < mp->ws_count; i++){
+        fprintf(f, "ws\t%u\t%u\n", (unsigned)i, (unsigned)mp->ws_series[i]);
+    }
+    if (mp->ws_now) fprintf(f, "ws\t%u\t%u\n", (unsigned)mp->ws_count, (unsigned)mp->ws_now);
+    if (mp->cache_on){
+        for (u32 a = 0; a < mp->pc_cap; a++){
+            if (!mp->pc_hits[a] && !mp->pc_misses[a]) continue;
+            fprintf(f, "cache\t%04X\t%llu\t%llu\n", (unsigned)a,
+                    (unsigned long long)mp->pc_hits[a], (unsigned long long)mp->pc_misses[a]);
+        }
+    }
+
+    bool ok = (ferror(f) == 0);
+    fclose(f);
+    return ok;
+}
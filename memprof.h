@@ -0,0 +1,61 @@
+#pragma once
+#include "vm.h"
+#include <stdint.h>
+#include <stdio.h>
+
+#define MEMPROF_LINE_DEFAULT   64u
+#define MEMPROF_WINDOW_DEFAULT 10000u
+
+typedef struct {
+    u32 size_bytes;
+    u32 ways;
+    u32 line;
+} CacheConfig;
+
+typedef struct MemProf {
+    u32       line;
+    u32       nblocks[SEG_COUNT];
+    uint64_t* reads[SEG_COUNT];
+    uint64_t* writes[SEG_COUNT];
+
+    /* working set: bloques físicos distintos tocados por ventana de instrucciones */
+    u8*       touched;
+    u32       touched_blocks;
+    u32       ws_now;
+    u32       window;
+    u32       window_left;
+    u32*      ws_series;
+    u32       ws_count;
+    u32       ws_cap;
+
+    u16       pc;            /* dirección física de la instrucción en curso */
+
+    /* caché simulada (opcional) */
+    int       cache_on;
+    CacheConfig cache;
+    u32       sets;
+    u32*      tags;          /* sets * ways; 0xFFFFFFFF = vacío */
+    u32*      lru;
+    u32       lru_clock;
+    uint64_t* pc_hits;       /* por dirección física de código */
+    uint64_t* pc_misses;
+    u32       pc_cap;
+    uint64_t  hits;
+    uint64_t  misses;
+} MemProf;
+
+MemProf* memprof_create(VM* vm, u32 window, const CacheConfig* cache);
+void     memprof_destroy(MemProf* mp);
+
+void     memprof_access(MemProf* mp, u16 seg_idx, u16 offset, u16 phys, u16 nbytes, bool is_write);
+void     memprof_close_window(MemProf* mp);
+
+static inline void memprof_insn(MemProf* mp, u16 phys){
+    mp->pc = phys;
+    if (--mp->window_left == 0){
+        memprof_close_window(mp);
+    }
+}
+
+void     memprof_report(MemProf* mp, VM* vm, FILE* out);
+bool     memprof_write(MemProf* mp, VM* vm, const char* path);
@@ -0,0 +1,120 @@
+#include "mv.h"
+#include "memory.h"
+#include "vm.h"
+#include <stdlib.h>
+
+_Static_assert((int)MV_HALTED == (int)VM_HALTED && (int)MV_FAULT == (int)VM_FAULT &&
+               (int)MV_PREEMPTED == (int)VM_PREEMPTED && (int)MV_BLOCKED == (int)VM_BLOCKED &&
+               (int)MV_LIMIT == (int)VM_LIMIT, "MvExit sigue a VmExit");
+_Static_assert((int)MV_IP == (int)IP && (int)MV_SP == (int)SP && (int)MV_EAX == (int)EAX && (int)MV_EFX == (int)EFX &&
+               (int)MV_CC == (int)CC && (int)MV_CS == (int)CS && (int)MV_PS == (int)PS, "registros de mv.h");
+_Static_assert((int)MV_IO_OK == (int)VMIO_OK && (int)MV_IO_EOF == (int)VMIO_EOF && (int)MV_IO_AGAIN == (int)VMIO_AGAIN,
+               "códigos de E/S de mv.h");
+
+static int no_input(void* ctx, char* buf, size_t cap){
+    (void)ctx; (void)cap;
+    buf[0] = 0;
+    return VMIO_EOF;
+}
+
+static void no_output(void* ctx, const char* data, size_t n){
+    (void)ctx; (void)data; (void)n;
+}
+
+MvVm* mv_create(uint32_t ram_kib){
+    if (ram_kib > RAM_DEFAULT_KIB) return NULL;   /* la ram de la VM es fija */
+    MvVm* m = (MvVm*)malloc(sizeof *m);
+    if (!m) return NULL;
+    vm_init(m, false);
+    if (ram_kib) m->ram_kib = ram_kib;
+    mv_set_io(m, NULL);
+    return m;
+}
+
+void mv_destroy(MvVm* m){
+    if (!m) return;
+    vm_release(m);
+    free(m);
+}
+
+bool mv_load(MvVm* m, const void* vmx, size_t len, const char* const* params, int argc){
+    VmxImage img;
+    if (!vmx_image_from_buffer(vmx, len, &img)) return false;
+
+    /* una carga nueva empieza de cero; se conserva lo que puso el host */
+    VM* vm = m;
+    VmIo     io     = vm->io;
+    VmLimits limits = vm->limits;
+    uint64_t rng    = vm->rng;
+    u32      kib    = vm->ram_kib;
+    const MvSysTable* systab = vm->systab;
+    vm_release(vm);
+    vm_init_job(vm, kib, "(memoria)", argc);
+    vm->io      = io;
+    vm->limits  = limits;
+    vm->limits.armed = false;
+    vm->rng     = rng;
+    vm->systab  = systab;
+
+    bool ok = vm_load_image(vm, &img, (char**)params, argc);
+    vmx_image_free(&img);
+    return ok;
+}
+
+void mv_set_io(MvVm* m, const MvIo* io){
+    VmIo* v = &m->io;
+    v->read_line = io && io->read_line ? io->read_line : no_input;
+    v->write     = io && io->write     ? io->write     : no_output;
+    v->flush     = NULL;
+    v->in_ctx    = io ? io->user : NULL;
+    v->out_ctx   = io ? io->user : NULL;
+}
+
+void mv_seed(MvVm* m, uint64_t seed){
+    vm_seed(m, seed);
+}
+
+void mv_set_limits(MvVm* m, uint64_t insns, uint64_t wall_ns, uint64_t out_bytes){
+    VmLimits* l = &m->limits;
+    l->insns     = insns;
+    l->wall_ns   = wall_ns;
+    l->out_bytes = out_bytes;
+    l->dump_path = NULL;
+    l->armed     = false;
+}
+
+MvExit mv_run_for(MvVm* m, uint64_t n_instructions){
+    return (MvExit)vm_run_for(m, n_instructions);
+}
+
+MvExit mv_call(MvVm* m, uint16_t entry, const uint32_t* args, int nargs,
+               uint64_t max_insns, uint32_t* result){
+    return (MvExit)vm_call(m, entry, args, nargs, max_insns, result);
+}
+
+uint64_t mv_insns(const MvVm* m){
+    return m->stats.insns;
+}
+
+uint32_t mv_get_reg(const MvVm* m, int reg){
+    if (reg < 0 || reg >= REG_COUNT) return 0;
+    return m->reg[reg];
+}
+
+bool mv_set_reg(MvVm* m, int reg, uint32_t value){
+    if (reg < 0 || reg >= REG_COUNT) return false;
+    m->reg[reg] = value;
+    return true;
+}
+
+void mv_set_systab(MvVm* m, const MvSysTable* t){
+    m->systab = t;
+}
+
+bool mv_read(MvVm* m, uint32_t addr, void* dst, size_t n){
+    return mem_host_read(m, addr, dst, n);
+}
+
+bool mv_write(MvVm* m, uint32_t addr, const void* src, size_t n){
+    return mem_host_write(m, addr, src, n);
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* libmv: la VM para usar dentro de otro programa.
+
+   Todo el estado (ram, registros, RND, E/S, cuotas) vive en el MvVm, así
+   que se pueden correr muchas a la vez, cada una desde un hilo a la vez.
+   La biblioteca son todos los .c menos main.c; solo hace falta este header.
+
+       MvVm* m = mv_create(0);
+       mv_set_io(m, &io);
+       if (mv_load(m, vmx, vmx_len, NULL, 0))
+           while (mv_run_for(m, 100000) == MV_PREEMPTED) { ... }
+       mv_destroy(m);
+
+   Los errores del invitado (fallo de segmento, instrucción inválida) se
+   informan en stderr como en el ejecutable. */
+
+typedef struct MvVm MvVm;
+
+/* mismos valores que VmExit */
+typedef enum {
+    MV_HALTED    = 0,   /* STOP o fin del código */
+    MV_FAULT     = 1,
+    MV_PREEMPTED = 2,   /* se cumplieron las instrucciones pedidas; se puede seguir */
+    MV_BLOCKED   = 3,   /* read_line devolvió MV_IO_AGAIN; se puede seguir */
+    MV_LIMIT     = 5    /* se agotó una cuota (mv_set_limits) */
+} MvExit;
+
+/* registros que se pueden leer y escribir */
+enum {
+    MV_IP  = 3,  MV_SP  = 7,  MV_BP  = 8,
+    MV_EAX = 10, MV_EBX = 11, MV_ECX = 12, MV_EDX = 13, MV_EEX = 14, MV_EFX = 15,
+    MV_AC  = 16, MV_CC  = 17,
+    MV_CS  = 26, MV_DS  = 27, MV_ES  = 28, MV_SS  = 29, MV_KS  = 30, MV_PS = 31
+};
+
+enum { MV_IO_OK = 0, MV_IO_EOF = -1, MV_IO_AGAIN = -2 };
+
+typedef struct {
+    /* deja en buf una línea terminada en '\0' (puede incluir el '\n');
+       NULL = sin entrada (EOF) */
+    int  (*read_line)(void* user, char* buf, size_t cap);
+    /* NULL = la salida se descarta */
+    void (*write)(void* user, const char* data, size_t n);
+    void* user;
+} MvIo;
+
+/* ram_kib = 0: la ram por defecto (16 KiB), que es también el máximo; con más
+   devuelve NULL. Sin entrada ni salida hasta mv_set_io */
+MvVm*    mv_create(uint32_t ram_kib);
+void     mv_destroy(MvVm* m);
+
+/* el .vmx se copia; se puede liberar al volver. params como los de la línea de comandos */
+bool     mv_load(MvVm* m, const void* vmx, size_t len, const char* const* params, int argc);
+
+void     mv_set_io(MvVm* m, const MvIo* io);
+
+/* RND reproducible; sin semilla se siembra con el reloj */
+void     mv_seed(MvVm* m, uint64_t seed);
+
+/* cuotas de toda la corrida (0 = sin límite), sin volcado .vmi */
+void     mv_set_limits(MvVm* m, uint64_t insns, uint64_t wall_ns, uint64_t out_bytes);
+
+MvExit   mv_run_for(MvVm* m, uint64_t n_instructions);
+
+/* llama a la subrutina del invitado en el offset entry del código, con la
+   VM ya cargada (y los datos que dejó una corrida anterior): los argumentos
+   van a la pila como antes de un CALL, args[0] en [SP+4] al entrar. Corre
+   hasta el RET que le corresponde y deja EAX en *result.
+   MV_HALTED = volvió; MV_PREEMPTED = no volvió en max_insns (0 = sin tope).
+   Siempre deja los registros como estaban, así se puede llamar de nuevo */
+MvExit   mv_call(MvVm* m, uint16_t entry, const uint32_t* args, int nargs,
+                 uint64_t max_insns, uint32_t* result);
+
+/* instrucciones ejecutadas desde mv_create */
+uint64_t mv_insns(const MvVm* m);
+
+uint32_t mv_get_reg(const MvVm* m, int reg);
+bool     mv_set_reg(MvVm* m, int reg, uint32_t value);
+
+/* addr = segmento << 16 | offset, como los punteros del invitado;
+   falla si [addr, addr+n) se sale del segmento */
+bool     mv_read(MvVm* m, uint32_t addr, void* dst, size_t n);
+bool     mv_write(MvVm* m, uint32_t addr, const void* src, size_t n);
+
+/* SYS nativos: el host (o un plugin .so) atiende números de SYS en código
+   nativo. La llamada va directo por índice, igual que las propias.
+
+   El handler recibe los registros del invitado (se pueden escribir) y
+   read/write con el mismo control de segmento que el invitado; no necesita
+   ningún símbolo del ejecutable. Devuelve 0, o distinto de 0 para que la
+   VM termine con error. Con hilos invitados puede correr en varios hilos
+   a la vez. */
+
+typedef struct MvSysCall MvSysCall;
+struct MvSysCall {
+    uint32_t* reg;          /* reg[MV_EAX], reg[MV_EDX]... */
+    uint32_t  callno;
+    void*     user;         /* el de mv_systab_set */
+    bool    (*read)(MvSysCall* c, uint32_t addr, void* dst, size_t n);
+    bool    (*write)(MvSysCall* c, uint32_t addr, const void* src, size_t n);
+    MvVm*     vm;
+};
+
+typedef int (*MvSysFn)(MvSysCall* c);
+
+typedef struct MvSysTable MvSysTable;
+
+/* 256 entradas, empezando con las llamadas propias de la VM */
+MvSysTable* mv_systab_create(void);
+void        mv_systab_destroy(MvSysTable* t);
+
+/* callno < 256; reemplaza la llamada que hubiera. fn = NULL vuelve a la propia */
+bool        mv_systab_set(MvSysTable* t, uint32_t callno, MvSysFn fn, void* user);
+
+/* carga un .so que exporta
+       int mv_plugin_init(MvSysTable* t, MvSysRegister reg);
+   y registra sus llamadas con reg(t, callno, fn, user); 0 = ok.
+   El .so queda cargado hasta mv_systab_destroy */
+typedef bool (*MvSysRegister)(MvSysTable* t, uint32_t callno, MvSysFn fn, void* user);
+bool        mv_systab_load(MvSysTable* t, const char* so_path);
+
+/* la tabla se comparte entre VM y no se copia: no cambiarla mientras
+   alguna corre, ni destruirla antes que ellas. NULL = solo las propias */
+void        mv_set_systab(MvVm* m, const MvSysTable* t);
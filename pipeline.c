@@ -0,0 +1,252 @@
+#include "pipeline.h"
+#include "hostclock.h"
+#include "vm.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* head y tail crecen sin parar; el índice en buf es & (cap-1).
+   El productor acumula en 'pending' y publica tail en flush, con el buffer
+   lleno o antes de bloquearse; el consumidor publica head en cada lectura. */
+typedef struct {
+    char*         buf;
+    size_t        cap;
+    atomic_size_t head;
+    atomic_size_t tail;
+    size_t        pending;        /* escrito y todavía no publicado (solo el productor) */
+    atomic_bool   closed;         /* el productor terminó */
+    atomic_bool   gone;           /* el consumidor terminó */
+
+    atomic_int      sleepers;
+    pthread_mutex_t lock;         /* solo para dormir y despertar */
+    pthread_cond_t  cond;
+} Ring;
+
+typedef struct {
+    VM*       vm;
+    Ring*     in;                 /* NULL = stdin */
+    Ring*     out;                /* NULL = stdout */
+    int       rc;
+    uint64_t  ns;
+    pthread_t th;
+} Stage;
+
+static bool ring_init(Ring* r, size_t cap){
+    memset(r, 0, sizeof *r);
+    r->buf = (char*)malloc(cap);
+    if (!r->buf) return false;
+    r->cap = cap;
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->closed, false);
+    atomic_init(&r->gone, false);
+    atomic_init(&r->sleepers, 0);
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    return true;
+}
+
+static void ring_free(Ring* r){
+    free(r->buf);
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->cond);
+}
+
+static void ring_wake(Ring* r){
+    if (atomic_load(&r->sleepers) == 0) return;
+    pthread_mutex_lock(&r->lock);
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+}
+
+/* duerme hasta que ready(r) sea cierto; sleepers va antes de volver a mirar
+   para que quien publica vea que hay alguien esperando */
+static void ring_wait(Ring* r, bool (*ready)(Ring*)){
+    pthread_mutex_lock(&r->lock);
+    atomic_fetch_add(&r->sleepers, 1);
+    while (!ready(r)) pthread_cond_wait(&r->cond, &r->lock);
+    atomic_fetch_sub(&r->sleepers, 1);
+    pthread_mutex_unlock(&r->lock);
+}
+
+static bool can_read(Ring* r){
+    return atomic_load(&r->tail) != atomic_load(&r->head) || atomic_load(&r->closed);
+}
+
+static bool can_write(Ring* r){
+    size_t used = atomic_load(&r->tail) + r->pending - atomic_load(&r->head);
+    return used < r->cap || atomic_load(&r->gone);
+}
+
+static void ring_publish(Ring* r){
+    if (r->pending == 0) return;
+    atomic_fetch_add(&r->tail, r->pending);
+    r->pending = 0;
+    ring_wake(r);
+}
+
+static void ring_write(Ring* r, const char* data, size_t n){
+    while (n > 0){
+        if (atomic_load(&r->gone)) return;
+        size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed) + r->pending;
+        size_t room = r->cap - (tail - atomic_load(&r->head));
+        if (room == 0){
+            ring_publish(r);
+            ring_wait(r, can_write);
+            continue;
+        }
+        size_t k = n < room ? n : room;
+        for (size_t i = 0; i < k; i++) r->buf[(tail + i) & (r->cap - 1)] = data[i];
+        r->pending += k;
+        data += k;
+        n    -= k;
+        if (r->pending >= r->cap / 4) ring_publish(r);
+    }
+}
+
+static void ring_close(Ring* r){
+    ring_publish(r);
+    atomic_store(&r->closed, true);
+    pthread_mutex_lock(&r->lock);
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+}
+
+static void ring_abandon(Ring* r){
+    atomic_store(&r->gone, true);
+    pthread_mutex_lock(&r->lock);
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+}
+
+/* VmIo: una línea del buffer de entrada, hasta '\n' o cap-1 bytes */
+static int ring_read_line(void* ctx, char* buf, size_t cap){
+    Stage* st = (Stage*)ctx;
+    Ring*  r  = st->in;
+    size_t n  = 0;
+
+    /* lo que esta etapa tiene pendiente puede ser lo que la otra espera */
+    if (st->out) ring_publish(st->out);
+
+    while (n + 1 < cap){
+        size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+        size_t tail = atomic_load(&r->tail);
+        if (head == tail){
+            if (atomic_load(&r->closed) && atomic_load(&r->tail) == head) break;
+            ring_wait(r, can_read);
+            continue;
+        }
+        char ch = 0;
+        while (head != tail && n + 1 < cap){
+            ch = r->buf[head & (r->cap - 1)];
+            buf[n++] = ch;
+            head++;
+            if (ch == '\n') break;
+        }
+        atomic_store(&r->head, head);
+        ring_wake(r);
+        if (ch == '\n') break;
+    }
+    buf[n] = 0;
+    return n ? VMIO_OK : VMIO_EOF;
+}
+
+static void ring_out_write(void* ctx, const char* data, size_t n){
+    ring_write(((Stage*)ctx)->out, data, n);
+}
+
+static void ring_out_flush(void* ctx){
+    ring_publish(((Stage*)ctx)->out);
+}
+
+static void* stage_main(void* arg){
+    Stage* st = (Stage*)arg;
+    uint64_t t0 = host_now_ns();
+    st->rc = vm_run(st->vm);
+    st->ns = host_now_ns() - t0;
+    if (st->out) ring_close(st->out);
+    else fflush(stdout);
+    if (st->in) ring_abandon(st->in);
+    return NULL;
+}
+
+int pipeline_run(const PipelineStage* stages, int n, uint32_t ram_kib, FILE* report){
+    if (n < 1 || n > PIPELINE_MAX_STAGES){
+        fprintf(stderr, "Error: el pipeline admite de 1 a %d etapas\n", PIPELINE_MAX_STAGES);
+        return 1;
+    }
+
+    Stage st[PIPELINE_MAX_STAGES];
+    Ring  rings[PIPELINE_MAX_STAGES];
+    memset(st, 0, sizeof st);
+    int nrings = 0, nvms = 0, rc = 0;
+
+    for (int i = 0; i + 1 < n; i++, nrings++){
+        if (!ring_init(&rings[i], PIPELINE_RING_BYTES)){ rc = 1; goto out; }
+    }
+
+    for (int i = 0; i < n; i++, nvms++){
+        VM* vm = (VM*)malloc(sizeof *vm);
+        if (!vm){ rc = 1; goto out; }
+        st[i].vm = vm;
+        st[i].in  = i > 0 ? &rings[i - 1] : NULL;
+        st[i].out = i + 1 < n ? &rings[i] : NULL;
+
+        vm_init_job(vm, ram_kib, stages[i].path, stages[i].argc);
+        if (!vm_load(vm, stages[i].params, stages[i].argc)){
+            fprintf(stderr, "Error: no pude cargar la etapa %d (%s)\n", i + 1, stages[i].path);
+            nvms++;
+            rc = 1;
+            goto out;
+        }
+
+        vmio_stdio(&vm->io, stdin, stdout);
+        if (st[i].in){
+            vm->io.read_line = ring_read_line;
+            vm->io.in_ctx    = &st[i];
+        }
+        if (st[i].out){
+            vm->io.write   = ring_out_write;
+            vm->io.flush   = ring_out_flush;
+            vm->io.out_ctx = &st[i];
+        }
+    }
+
+    int started = 0;
+    for (; started < n; started++){
+        if (pthread_create(&st[started].th, NULL, stage_main, &st[started]) != 0){
+            fprintf(stderr, "Error: no pude crear el hilo de la etapa %d\n", started + 1);
+            rc = 1;
+            break;
+        }
+    }
+    if (started < n){
+        /* las etapas sin hilo no van a leer ni escribir nunca */
+        for (int i = started; i < n; i++){
+            if (st[i].in)  ring_abandon(st[i].in);
+            if (st[i].out) ring_close(st[i].out);
+        }
+    }
+    for (int i = 0; i < started; i++){
+        pthread_join(st[i].th, NULL);
+        if (rc == 0 && st[i].rc != 0) rc = st[i].rc;
+    }
+
+    if (report){
+        for (int i = 0; i < started; i++){
+            fprintf(report, "etapa %d %-24s rc=%d  %.3f ms  %llu instrucciones\n",
+                    i + 1, stages[i].path, st[i].rc, (double)st[i].ns / 1e6,
+                    (unsigned long long)st[i].vm->stats.insns);
+        }
+    }
+
+out:
+    for (int i = 0; i < nvms; i++){
+        if (!st[i].vm) continue;
+        vm_release(st[i].vm);
+        free(st[i].vm);
+    }
+    for (int i = 0; i < nrings; i++) ring_free(&rings[i]);
+    return rc;
+}
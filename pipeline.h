@@ -0,0 +1,23 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+/* Varias VM encadenadas como un pipe del shell, cada una en su hilo:
+   la salida (SYS 2/4) de una etapa es la entrada (SYS 1/3) de la siguiente
+   a través de un buffer circular de un productor y un consumidor.
+   La primera etapa lee de stdin y la última escribe en stdout. Un buffer
+   lleno frena a quien escribe; si la etapa siguiente terminó, lo que
+   quede por escribir se descarta. */
+
+#define PIPELINE_RING_BYTES (64u * 1024u)   /* potencia de 2 */
+#define PIPELINE_MAX_STAGES 16
+
+typedef struct {
+    const char* path;
+    char**      params;
+    int         argc;
+} PipelineStage;
+
+/* devuelve el primer código distinto de 0 entre las etapas (como pipefail);
+   con report != NULL imprime una línea por etapa */
+int pipeline_run(const PipelineStage* stages, int n, uint32_t ram_kib, FILE* report);
@@ -0,0 +1,39 @@
+#pragma once
+
+/*
+ * Tracepoints estáticos USDT (proveedor "mv") para perf/bpftrace/SystemTap.
+ * Se activan solos si existe <sys/sdt.h>; -DMV_NO_USDT los quita.
+ * Un probe deshabilitado es un nop en el binario.
+ * El probe por instrucción solo se compila con -DMV_USDT_INSN (build de trazado).
+ *
+ *   mv:load__start(path)            mv:load__end(path, ok)
+ *   mv:vmi__save__start(path)       mv:vmi__save__end(path, ok)
+ *   mv:vmi__load__start(path)       mv:vmi__load__end(path, ok)
+ *   mv:sys__entry(callno, edx)      mv:sys__exit(callno, rc)
+ *   mv:mem__fault(seg, off, nbytes, write)
+ *   mv:seg__fault(ip)               mv:insn__invalid(ip, opcode)
+ *   mv:insn(phys, opcode)
+ */
+
+#if !defined(MV_NO_USDT) && defined(__has_include)
+#  if __has_include(<sys/sdt.h>)
+#    include <sys/sdt.h>
+#    define MV_HAVE_USDT 1
+#  endif
+#endif
+
+#ifdef MV_HAVE_USDT
+#  define MV_PROBE1(name, a)          DTRACE_PROBE1(mv, name, a)
+#  define MV_PROBE2(name, a, b)       DTRACE_PROBE2(mv, name, a, b)
+#  define MV_PROBE4(name, a, b, c, d) DTRACE_PROBE4(mv, name, a, b, c, d)
+#else
+#  define MV_PROBE1(name, a)          do { } while (0)
+#  define MV_PROBE2(name, a, b)       do { } while (0)
+#  define MV_PROBE4(name, a, b, c, d) do { } while (0)
+#endif
+
+#if defined(MV_HAVE_USDT) && defined(MV_USDT_INSN)
+#  define MV_PROBE_INSN(phys, opcode) DTRACE_PROBE2(mv, insn, phys, opcode)
+#else
+#  define MV_PROBE_INSN(phys, opcode) do { } while (0)
+#endif
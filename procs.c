@@ -0,0 +1,358 @@
+#include "procs.h"
+#include "cpu.h"
+#include "hostclock.h"
+#include "memory.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define PROCS_ARGV_MAX 16
+
+static void ctx_save(const VM* vm, GuestProc* p){
+    memcpy(p->reg, vm->reg, sizeof p->reg);
+    memcpy(p->seg, vm->seg, sizeof p->seg);
+    p->idx_param   = vm->idx_param;
+    p->idx_const   = vm->idx_const;
+    p->idx_code    = vm->idx_code;
+    p->idx_data    = vm->idx_data;
+    p->idx_extra   = vm->idx_extra;
+    p->idx_stack   = vm->idx_stack;
+    p->code_size   = vm->code_size;
+    p->sys_resume  = vm->sys_resume;
+    p->sys_waiting = vm->sys_waiting;
+}
+
+static void ctx_load(VM* vm, const GuestProc* p){
+    memcpy(vm->reg, p->reg, sizeof vm->reg);
+    memcpy(vm->seg, p->seg, sizeof vm->seg);
+    vm->idx_param   = p->idx_param;
+    vm->idx_const   = p->idx_const;
+    vm->idx_code    = p->idx_code;
+    vm->idx_data    = p->idx_data;
+    vm->idx_extra   = p->idx_extra;
+    vm->idx_stack   = p->idx_stack;
+    vm->code_size   = p->code_size;
+    vm->sys_resume  = p->sys_resume;
+    vm->sys_waiting = p->sys_waiting;
+}
+
+static inline bool holds_ram(const GuestProc* p){
+    return p->state != PROC_FREE && p->state != PROC_ZOMBIE;
+}
+
+static u32 live_count(const Procs* ps){
+    u32 n = 0;
+    for (int i = 0; i < PROCS_MAX; i++){
+        if (holds_ram(&ps->p[i])) n++;
+    }
+    return n;
+}
+
+static int find_pid(const Procs* ps, u32 pid){
+    for (int i = 0; i < PROCS_MAX; i++){
+        if (ps->p[i].state != PROC_FREE && ps->p[i].pid == pid) return i;
+    }
+    return -1;
+}
+
+/* el programa ya cargado pasa a ser el pid 0 y ocupa ram[0, fin de su último segmento) */
+static Procs* procs_create(VM* vm){
+    Procs* ps = (Procs*)calloc(1, sizeof *ps);
+    if (!ps) return NULL;
+    ps->quantum = vm->proc_quantum ? vm->proc_quantum : PROCS_QUANTUM_DEFAULT;
+
+    GuestProc* root = &ps->p[0];
+    root->state  = PROC_READY;
+    root->pid    = 0;
+    root->parent = 0xFFFFFFFFu;
+    for (int i = 0; i < SEG_COUNT; i++){
+        u32 end = (u32)vm->seg[i].base + vm->seg[i].size;
+        if (vm->seg[i].size && end > root->limit) root->limit = end;
+    }
+    ctx_save(vm, root);
+
+    ps->cur      = 0;
+    ps->next_pid = 1;
+    ps->peak     = 1;
+    return ps;
+}
+
+void procs_destroy(Procs* ps){
+    if (!ps) return;
+    for (int i = 0; i < ps->nimages; i++) vmx_image_free(&ps->images[i].img);
+    free(ps);
+}
+
+static const VmxImage* image_for(Procs* ps, const char* path){
+    for (int i = 0; i < ps->nimages; i++){
+        if (strcmp(ps->images[i].path, path) == 0) return &ps->images[i].img;
+    }
+    if (ps->nimages == PROCS_MAX){
+        vmx_image_free(&ps->images[0].img);
+        memmove(&ps->images[0], &ps->images[1], (PROCS_MAX - 1) * sizeof ps->images[0]);
+        ps->nimages--;
+    }
+    ProcImage* pi = &ps->images[ps->nimages];
+    if (!vmx_image_read(path, &pi->img)) return NULL;
+    snprintf(pi->path, sizeof pi->path, "%s", path);
+    ps->nimages++;
+    return &pi->img;
+}
+
+/* primer hueco libre de 'need' bytes; need = 0 toma el hueco más grande (VMX v1) */
+static bool alloc_region(const Procs* ps, u32 ram_limit, u32 need, u32* base, u32* limit){
+    u32 lo[PROCS_MAX], hi[PROCS_MAX];
+    int n = 0;
+    for (int i = 0; i < PROCS_MAX; i++){
+        const GuestProc* p = &ps->p[i];
+        if (!holds_ram(p) || p->limit <= p->base) continue;
+        int k = n++;
+        while (k > 0 && lo[k-1] > p->base){
+            lo[k] = lo[k-1];
+            hi[k] = hi[k-1];
+            k--;
+        }
+        lo[k] = p->base;
+        hi[k] = p->limit;
+    }
+
+    u32 best_base = 0, best_size = 0, cursor = 0;
+    for (int i = 0; i <= n; i++){
+        u32 end = (i < n) ? lo[i] : ram_limit;
+        u32 gap = end > cursor ? end - cursor : 0;
+        if (need && gap >= need){
+            *base  = cursor;
+            *limit = cursor + need;
+            return true;
+        }
+        if (!need && gap > best_size){
+            best_base = cursor;
+            best_size = gap;
+        }
+        if (i < n && hi[i] > cursor) cursor = hi[i];
+    }
+    if (need || best_size == 0) return false;
+    *base  = best_base;
+    *limit = best_base + best_size;
+    return true;
+}
+
+static u32 footprint(const VmxImage* img, char** argv, int argc){
+    if (img->version != 2) return 0;
+    u32 need = (u32)img->const_sz + img->code_sz + img->data_sz + img->extra_sz + img->stack_sz;
+    if (argc > 0){
+        for (int i = 0; i < argc; i++) need += (u32)strlen(argv[i]) + 1u;
+        need += (u32)(argc + 1) * 4u;
+    }
+    return need;
+}
+
+static u32 spawn(VM* vm, Procs* ps, char* cmd){
+    char* argv[PROCS_ARGV_MAX];
+    int argc = 0;
+    char* save = NULL;
+    char* path = strtok_r(cmd, " \t", &save);
+    if (!path) return 0xFFFFFFFFu;
+    for (char* t = strtok_r(NULL, " \t", &save); t && argc < PROCS_ARGV_MAX; t = strtok_r(NULL, " \t", &save)){
+        argv[argc++] = t;
+    }
+
+    int slot = -1;
+    for (int i = 0; i < PROCS_MAX; i++){
+        if (ps->p[i].state == PROC_FREE){ slot = i; break; }
+    }
+    if (slot < 0){
+        fprintf(stderr, "Error: SYS_SPAWN: tabla de procesos llena\n");
+        return 0xFFFFFFFFu;
+    }
+
+    const VmxImage* img = image_for(ps, path);
+    if (!img) return 0xFFFFFFFFu;
+
+    u32 ram_limit = (u32)vm->ram_kib * 1024u;
+    if (ram_limit > sizeof vm->ram) ram_limit = (u32)sizeof vm->ram;
+
+    u32 base, limit;
+    if (!alloc_region(ps, ram_limit, footprint(img, argv, argc), &base, &limit)){
+        fprintf(stderr, "Error: SYS_SPAWN: no hay memoria libre para %s\n", path);
+        return 0xFFFFFFFFu;
+    }
+
+    /* se monta el hijo sobre los campos de la VM y se vuelve al padre */
+    GuestProc* parent = &ps->p[ps->cur];
+    ctx_save(vm, parent);
+    memset(&vm->ram[base], 0, limit - base);
+
+    int saved_have_params = vm->have_params;
+    vm->have_params = argc > 0;
+    bool ok = vm_load_image_at(vm, img, argc ? argv : NULL, argc, base, limit);
+    vm->have_params = saved_have_params;
+
+    GuestProc* child = &ps->p[slot];
+    if (ok){
+        memset(child, 0, sizeof *child);
+        ctx_save(vm, child);
+        child->state  = PROC_READY;
+        child->pid    = ps->next_pid++;
+        child->parent = parent->pid;
+        child->base   = base;
+        child->limit  = limit;
+        ps->spawned++;
+        u32 live = live_count(ps);
+        if (live > ps->peak) ps->peak = live;
+    }
+    ctx_load(vm, parent);
+    return ok ? child->pid : 0xFFFFFFFFu;
+}
+
+static void proc_exit(Procs* ps, int i, u32 code){
+    GuestProc* p = &ps->p[i];
+    p->state     = PROC_ZOMBIE;
+    p->exit_code = code;
+    p->base = p->limit = 0;
+
+    for (int w = 0; w < PROCS_MAX; w++){
+        GuestProc* q = &ps->p[w];
+        if (q->state != PROC_WAIT || q->pid != p->parent) continue;
+        if (q->wait_pid != p->pid && q->wait_pid != 0xFFFFFFFFu) continue;
+        q->reg[EAX] = code;
+        q->state    = PROC_READY;
+        p->state    = PROC_FREE;
+        return;
+    }
+    /* sin padre vivo nadie lo va a recoger */
+    int par = find_pid(ps, p->parent);
+    if (par < 0 || !holds_ram(&ps->p[par])) p->state = PROC_FREE;
+}
+
+static int sys_wait(VM* vm, Procs* ps, u32 target){
+    GuestProc* c = &ps->p[ps->cur];
+    bool any_child = false;
+    for (int i = 0; i < PROCS_MAX; i++){
+        GuestProc* p = &ps->p[i];
+        if (p->state == PROC_FREE || p->parent != c->pid) continue;
+        if (target != 0xFFFFFFFFu && p->pid != target) continue;
+        if (p->state == PROC_ZOMBIE){
+            vm->reg[EAX] = p->exit_code;
+            p->state = PROC_FREE;
+            return 0;
+        }
+        any_child = true;
+    }
+    if (!any_child){
+        vm->reg[EAX] = 0xFFFFFFFFu;
+        return 0;
+    }
+    c->state    = PROC_WAIT;
+    c->wait_pid = target;
+    return OP_SWITCH;
+}
+
+int procs_sys(VM* vm, u32 callno){
+    if (callno == SYS_SPAWN && vm->threads){
+        fprintf(stderr, "Error: SYS_SPAWN no se permite con hilos invitados\n");
+        vm->reg[EAX] = 0xFFFFFFFFu;
+        return 0;
+    }
+    if (!vm->procs){
+        if (callno != SYS_SPAWN){
+            /* un solo proceso: YIELD no hace nada, WAIT no tiene hijos, EXIT es STOP */
+            if (callno == SYS_WAIT) vm->reg[EAX] = 0xFFFFFFFFu;
+            if (callno == SYS_EXIT) vm->reg[IP] = 0xFFFFFFFFu;
+            return 0;
+        }
+        vm->procs = procs_create(vm);
+        if (!vm->procs) return -1;
+    }
+    Procs* ps = vm->procs;
+
+    switch (callno){
+    case SYS_SPAWN: {
+        vm->nondet = true;   /* lee otro archivo y reparte el tiempo */
+        char cmd[PROCS_PATH_MAX];
+        if (!mem_read_string(vm, vm->reg[EDX], cmd, sizeof cmd)) return -1;
+        vm->reg[EAX] = spawn(vm, ps, cmd);
+        return OP_SWITCH;   /* desde ahora rige el quantum */
+    }
+    case SYS_YIELD:
+        return OP_SWITCH;
+    case SYS_WAIT:
+        return sys_wait(vm, ps, vm->reg[EDX]);
+    case SYS_EXIT:
+        proc_exit(ps, ps->cur, vm->reg[EDX]);
+        return OP_SWITCH;
+    }
+    return -1;
+}
+
+int procs_sleep(VM* vm, uint64_t ns){
+    GuestProc* c = &vm->procs->p[vm->procs->cur];
+    c->state   = PROC_SLEEP;
+    c->wake_ns = host_now_ns() + ns;
+    return OP_SWITCH;
+}
+
+void procs_resume(VM* vm){
+    Procs* ps = vm->procs;
+    for (int i = 0; i < PROCS_MAX; i++){
+        if (ps->p[i].state == PROC_INPUT) ps->p[i].state = PROC_READY;
+    }
+}
+
+VmExit procs_switch(VM* vm, VmExit r){
+    Procs* ps = vm->procs;
+    GuestProc* c = &ps->p[ps->cur];
+
+    if (c->state == PROC_READY){
+        if (r == VM_HALTED || r == VM_FAULT){
+            if (c->pid == 0 && r == VM_FAULT) ps->root_fault = true;
+            proc_exit(ps, ps->cur, r == VM_HALTED ? 0u : 0xFFFFFFFFu);
+        } else if (r == VM_BLOCKED){
+            c->state = PROC_INPUT;
+        }
+    }
+    if (holds_ram(c)) ctx_save(vm, c);
+
+    for (;;){
+        uint64_t now = host_now_ns();
+        int next = -1, input = -1, waiting = 0;
+        uint64_t wake = UINT64_MAX;
+
+        /* round robin a partir del siguiente; el actual queda último */
+        for (int k = 1; k <= PROCS_MAX; k++){
+            int i = (ps->cur + k) % PROCS_MAX;
+            GuestProc* p = &ps->p[i];
+            if (p->state == PROC_SLEEP && p->wake_ns <= now) p->state = PROC_READY;
+            if (p->state == PROC_READY && next < 0) next = i;
+            if (p->state == PROC_INPUT && input < 0) input = i;
+            if (p->state == PROC_SLEEP && p->wake_ns < wake) wake = p->wake_ns;
+            if (p->state == PROC_WAIT) waiting++;
+        }
+
+        if (next >= 0 || input >= 0){
+            int i = next >= 0 ? next : input;
+            if (i != ps->cur) ps->switches++;
+            ps->cur = i;
+            ctx_load(vm, &ps->p[i]);
+            /* todos esperan entrada: que quien llamó espere el descriptor */
+            return next >= 0 ? VM_PREEMPTED : VM_BLOCKED;
+        }
+        if (wake != UINT64_MAX){
+            vmio_flush(&vm->io);
+            if (!vm_sleep_limited(vm, wake - now)) return VM_LIMIT;
+            continue;
+        }
+
+        vm->reg[IP] = 0xFFFFFFFFu;
+        if (waiting){
+            fprintf(stderr, "Error: interbloqueo: todos los procesos esperan a otro\n");
+            return VM_FAULT;
+        }
+        return ps->root_fault ? VM_FAULT : VM_HALTED;
+    }
+}
+
+void procs_report(const Procs* ps, FILE* out){
+    fprintf(out, "\n== procesos: %llu creados, maximo %u a la vez, %llu cambios de contexto, quantum %u ==\n",
+            (unsigned long long)ps->spawned, ps->peak,
+            (unsigned long long)ps->switches, ps->quantum);
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include "vm.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/* Varios procesos invitados en una misma VM. Cada uno tiene su banco de
+   registros y su tabla seg[] sobre una región propia de ram; el proceso en
+   ejecución está cargado en los campos de VM y el resto guardado aquí.
+   La tabla se crea con el primer SYS_SPAWN: el programa inicial es el pid 0. */
+
+#define SYS_SPAWN 0x20u   /* EDX -> "programa.vmx [params...]"; EAX <- pid o -1 */
+#define SYS_YIELD 0x21u   /* cede el resto del quantum */
+#define SYS_WAIT  0x22u   /* EDX = pid de un hijo (-1 = cualquiera); EAX <- código de salida o -1 */
+#define SYS_EXIT  0x23u   /* termina el proceso con código EDX (STOP termina con 0) */
+
+#define PROCS_MAX             16
+#define PROCS_QUANTUM_DEFAULT 10000u
+#define PROCS_PATH_MAX        256
+
+enum {
+    PROC_FREE = 0,
+    PROC_READY,      /* ejecutable (o en ejecución si es el actual) */
+    PROC_INPUT,      /* SYS 1/3 sin entrada disponible */
+    PROC_SLEEP,      /* SYS_SLEEP hasta wake_ns */
+    PROC_WAIT,       /* SYS_WAIT hasta que termine wait_pid */
+    PROC_ZOMBIE      /* terminó; espera que el padre lo recoja */
+};
+
+typedef struct {
+    int  state;
+    u32  pid;
+    u32  parent;
+
+    u32  reg[REG_COUNT];
+    SegmentDescriptor seg[SEG_COUNT];
+    int  idx_param, idx_const, idx_code, idx_data, idx_extra, idx_stack;
+    u16  code_size;
+    u16  sys_resume;
+    bool sys_waiting;
+
+    u32  base;            /* región de ram [base, limit) */
+    u32  limit;
+    u32  wait_pid;
+    u32  exit_code;
+    uint64_t wake_ns;
+} GuestProc;
+
+typedef struct {
+    char     path[PROCS_PATH_MAX];
+    VmxImage img;
+} ProcImage;
+
+typedef struct Procs {
+    GuestProc p[PROCS_MAX];
+    int       cur;            /* índice del proceso cargado en la VM */
+    u32       next_pid;
+    u32       quantum;
+    bool      root_fault;     /* el pid 0 terminó con error */
+
+    ProcImage images[PROCS_MAX];   /* programas ya leídos por SYS_SPAWN */
+    int       nimages;
+
+    uint64_t  spawned;
+    uint64_t  switches;
+    u32       peak;           /* máximo de procesos vivos a la vez */
+} Procs;
+
+void   procs_destroy(Procs* ps);
+
+/* SYS_SPAWN/YIELD/WAIT/EXIT; devuelve 0, -1 u OP_SWITCH */
+int    procs_sys(VM* vm, u32 callno);
+
+/* SYS_SLEEP con procesos: duerme solo el proceso actual */
+int    procs_sleep(VM* vm, uint64_t ns);
+
+/* al volver a entrar a la VM: los procesos que esperaban entrada reintentan */
+void   procs_resume(VM* vm);
+
+/* tras una rebanada de run_loop elige el próximo proceso. VM_PREEMPTED
+   significa "seguir ejecutando"; cualquier otro valor se devuelve a quien
+   llamó a vm_run/vm_run_for */
+VmExit procs_switch(VM* vm, VmExit r);
+
+void   procs_report(const Procs* ps, FILE* out);
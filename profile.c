@@ -0,0 +1,139 @@
+#include "profile.h"
+#include "decoder.h"
+#include "disasm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROFILE_TOP 10
+
+Profile* profile_create(VM* vm){
+    Profile* p = (Profile*)calloc(1, sizeof *p);
+    if (!p) return NULL;
+    p->hits_cap = vm->code_size;
+    p->hits = (uint64_t*)calloc(p->hits_cap ? p->hits_cap : 1u, sizeof *p->hits);
+    if (!p->hits){
+        free(p);
+        return NULL;
+    }
+    return p;
+}
+
+void profile_destroy(Profile* p){
+    if (!p) return;
+    free(p->hits);
+    free(p);
+}
+
+static double pct(uint64_t n, uint64_t total){
+    return total ? (100.0 * (double)n / (double)total) : 0.0;
+}
+
+static void print_opcodes(Profile* p, FILE* out){
+    uint64_t total_ns = 0;
+    int order[256];
+    int n = 0;
+    for (int op = 0; op < 256; op++){
+        total_ns += p->op_ns[op];
+        if (p->op_count[op]) order[n++] = op;
+    }
+    /* por tiempo de host descendente */
+    for (int i = 1; i < n; i++){
+        int k = order[i], j = i - 1;
+        while (j >= 0 && p->op_ns[order[j]] < p->op_ns[k]){ order[j+1] = order[j]; j--; }
+        order[j+1] = k;
+    }
+
+    fprintf(out, "OPCODES:\n");
+    fprintf(out, " %-5s %12s %7s %14s %7s %9s\n", "OP", "ejec", "%", "ns", "%ns", "ns/inst");
+    for (int i = 0; i < n; i++){
+        int op = order[i];
+        fprintf(out, " %-5s %12llu %6.2f%% %14llu %6.2f%% %9.1f\n",
+                opcode_mnemonic((u8)op),
+                (unsigned long long)p->op_count[op], pct(p->op_count[op], p->total),
+                (unsigned long long)p->op_ns[op], pct(p->op_ns[op], total_ns),
+                (double)p->op_ns[op] / (double)p->op_count[op]);
+    }
+    fputc('\n', out);
+}
+
+static void print_line(Profile* p, VM* vm, const DecodedInst* di, FILE* out){
+    char text[DISASM_LINE_MAX];
+    disasm_format(vm, di, text, sizeof text);
+    uint64_t h = p->hits[di->phys];
+    if (h){
+        fprintf(out, " %12llu %6.2f%%  %s\n", (unsigned long long)h, pct(h, p->total), text);
+    } else {
+        fprintf(out, " %12s %7s  %s\n", "", "", text);
+    }
+}
+
+void profile_report(Profile* p, VM* vm, FILE* out){
+    fprintf(out, "PROFILE: %llu instrucciones\n\n", (unsigned long long)p->total);
+    print_opcodes(p, out);
+
+    if (vm->idx_code < 0) return;
+    u16 seg  = (u16)vm->idx_code;
+    u16 size = vm->seg[seg].size;
+
+    u16 top[PROFILE_TOP];
+    int ntop = 0;
+    for (u32 a = 0; a < p->hits_cap; a++){
+        if (!p->hits[a]) continue;
+        int j;
+        if (ntop < PROFILE_TOP)                        j = ntop++;
+        else if (p->hits[a] > p->hits[top[ntop - 1]]) j = ntop - 1;
+        else continue;
+        while (j > 0 && p->hits[top[j-1]] < p->hits[a]){ top[j] = top[j-1]; j--; }
+        top[j] = (u16)a;
+    }
+
+    fprintf(out, "HOT SPOTS:\n");
+    for (int i = 0; i < ntop; i++){
+        DecodedInst di;
+        if (!decode_at(vm, seg, (u16)(top[i] - vm->seg[seg].base), &di)) continue;
+        print_line(p, vm, &di, out);
+    }
+    fputc('\n', out);
+
+    fprintf(out, "LISTADO:\n");
+    u16 off = 0;
+    while (off < size){
+        DecodedInst di;
+        if (!decode_at(vm, seg, off, &di)){
+            u16 phys = (u16)(vm->seg[seg].base + off);
+            fprintf(out, " %12s %7s  [%04X] %02X | ??\n", "", "", phys, vm->ram[phys]);
+            off++;
+            continue;
+        }
+        print_line(p, vm, &di, out);
+        off = (u16)(off + di.size);
+    }
+    fputc('\n', out);
+}
+
+bool profile_write(Profile* p, VM* vm, const char* path){
+    FILE* f = fopen(path, "w");
+    if (!f){
+        fprintf(stderr, "Error: no pude abrir el archivo de perfil %s\n", path);
+        return false;
+    }
+
+    fprintf(f, "# mv-profile 1\n");
+    fprintf(f, "total\t%llu\n", (unsigned long long)p->total);
+    for (int op = 0; op < 256; op++){
+        if (!p->op_count[op]) continue;
+        fprintf(f, "op\t%02X\t%s\t%llu\t%llu\n", op, opcode_mnemonic((u8)op),
+                (unsigned long long)p->op_count[op], (unsigned long long)p->op_ns[op]);
+    }
+    u16 code_base = (vm->idx_code >= 0) ? vm->seg[vm->idx_code].base : 0;
+    for (u32 a = 0; a < p->hits_cap; a++){
+        if (!p->hits[a]) continue;
+        fprintf(f, "insn\t%04X\t%04X\t%llu\n", (unsigned)a, (unsigned)(a - code_base),
+                (unsigned long long)p->hits[a]);
+    }
+
+    bool ok = (ferror(f) == 0);
+    fclose(f);
+    return ok;
+}
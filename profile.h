@@ -0,0 +1,25 @@
+#pragma once
+#include "vm.h"
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct Profile {
+    uint64_t* hits;          /* ejecuciones por dirección física de código */
+    u32       hits_cap;
+    uint64_t  op_count[256]; /* indexado igual que la tabla de init_dispatch_table */
+    uint64_t  op_ns[256];
+    uint64_t  total;
+} Profile;
+
+Profile* profile_create(VM* vm);
+void     profile_destroy(Profile* p);
+
+static inline void profile_record(Profile* p, u16 phys, u8 opcode, uint64_t ns){
+    if (phys < p->hits_cap) p->hits[phys]++;
+    p->op_count[opcode]++;
+    p->op_ns[opcode] += ns;
+    p->total++;
+}
+
+void profile_report(Profile* p, VM* vm, FILE* out);
+bool profile_write(Profile* p, VM* vm, const char* path);
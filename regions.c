@@ -0,0 +1,99 @@
+#include "regions.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NO_REGION 0xFFFFFFFFu
+
+Regions* regions_create(void){
+    return (Regions*)calloc(1, sizeof(Regions));
+}
+
+void regions_destroy(Regions* r){
+    if (!r) return;
+    free(r->nodes);
+    free(r);
+}
+
+static u32 find_or_add(Regions* r, u32 parent, const char* name){
+    for (u32 i = 0; i < r->count; i++){
+        if (r->nodes[i].parent == parent && strcmp(r->nodes[i].name, name) == 0) return i;
+    }
+    if (r->count == r->cap){
+        u32 cap = r->cap ? r->cap * 2u : 16u;
+        RegionNode* n = (RegionNode*)realloc(r->nodes, cap * sizeof *n);
+        if (!n) return NO_REGION;
+        r->nodes = n;
+        r->cap = cap;
+    }
+    RegionNode* n = &r->nodes[r->count];
+    memset(n, 0, sizeof *n);
+    snprintf(n->name, sizeof n->name, "%s", name);
+    n->parent = parent;
+    return r->count++;
+}
+
+bool regions_begin(Regions* r, const char* name, uint64_t now_ns, uint64_t insns){
+    if (r->depth == REGION_MAX_DEPTH) return false;
+    u32 parent = r->depth ? r->stack[r->depth - 1].node : NO_REGION;
+    u32 id = find_or_add(r, parent, name);
+    if (id == NO_REGION) return false;
+
+    RegionFrame* f = &r->stack[r->depth++];
+    f->node  = id;
+    f->t0    = now_ns;
+    f->insn0 = insns;
+    r->nodes[id].calls++;
+    return true;
+}
+
+static void close_top(Regions* r, uint64_t now_ns, uint64_t insns){
+    RegionFrame* f = &r->stack[--r->depth];
+    RegionNode* n = &r->nodes[f->node];
+    uint64_t ns = now_ns - f->t0;
+    n->ns    += ns;
+    n->insns += insns - f->insn0;
+    if (n->parent != NO_REGION) r->nodes[n->parent].child_ns += ns;
+}
+
+void regions_end(Regions* r, const char* name, uint64_t now_ns, uint64_t insns){
+    u32 k = r->depth;
+    if (name){
+        while (k > 0 && strcmp(r->nodes[r->stack[k - 1].node].name, name) != 0) k--;
+    }
+    if (k == 0){
+        r->mismatched++;
+        return;
+    }
+    /* cierra también las regiones internas que quedaron abiertas */
+    while (r->depth >= k) close_top(r, now_ns, insns);
+}
+
+static void print_tree(Regions* r, u32 parent, int level, FILE* out){
+    for (u32 i = 0; i < r->count; i++){
+        RegionNode* n = &r->nodes[i];
+        if (n->parent != parent) continue;
+        int width = 24 - level * 2;
+        if (width < 1) width = 1;
+        fprintf(out, " %*s%-*s %10llu %14llu %14llu %12.0f %14llu\n",
+                level * 2, "", width, n->name,
+                (unsigned long long)n->calls, (unsigned long long)n->ns,
+                (unsigned long long)(n->ns - n->child_ns),
+                n->calls ? (double)n->ns / (double)n->calls : 0.0,
+                (unsigned long long)n->insns);
+        print_tree(r, i, level + 1, out);
+    }
+}
+
+void regions_report(Regions* r, uint64_t now_ns, uint64_t insns, FILE* out){
+    u32 open = r->depth;
+    while (r->depth > 0) close_top(r, now_ns, insns);
+
+    fprintf(out, "REGIONES:\n");
+    fprintf(out, " %-24s %10s %14s %14s %12s %14s\n",
+            "nombre", "llamadas", "ns total", "ns propios", "ns/llamada", "instrucciones");
+    print_tree(r, NO_REGION, 0, out);
+    if (open)          fprintf(out, " (%u regiones seguían abiertas al terminar)\n", (unsigned)open);
+    if (r->mismatched) fprintf(out, " (%llu fines sin comienzo)\n", (unsigned long long)r->mismatched);
+    fputc('\n', out);
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "vm.h"
+#include <stdint.h>
+#include <stdio.h>
+
+#define SYS_REGION_BEGIN 0x11u   /* EDX -> nombre (cadena terminada en 0) */
+#define SYS_REGION_END   0x12u   /* EDX -> nombre; EDX = -1 cierra la región abierta más interna */
+
+#define REGION_NAME_MAX  48
+#define REGION_MAX_DEPTH 64
+
+typedef struct {
+    char     name[REGION_NAME_MAX];
+    u32      parent;
+    uint64_t calls;
+    uint64_t ns;
+    uint64_t child_ns;
+    uint64_t insns;
+} RegionNode;
+
+typedef struct {
+    u32      node;
+    uint64_t t0;
+    uint64_t insn0;
+} RegionFrame;
+
+typedef struct Regions {
+    RegionNode* nodes;
+    u32         count;
+    u32         cap;
+    RegionFrame stack[REGION_MAX_DEPTH];
+    u32         depth;
+    uint64_t    mismatched;   /* fines sin comienzo correspondiente */
+} Regions;
+
+Regions* regions_create(void);
+void     regions_destroy(Regions* r);
+
+bool     regions_begin(Regions* r, const char* name, uint64_t now_ns, uint64_t insns);
+void     regions_end(Regions* r, const char* name, uint64_t now_ns, uint64_t insns);
+
+void     regions_report(Regions* r, uint64_t now_ns, uint64_t insns, FILE* out);
@@ -0,0 +1,86 @@
+#include "rescache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define RESCACHE_MAGIC "MVRES001"
+
+static void entry_path(char* buf, size_t cap, const char* dir, const Fnv128* key){
+    char hex[33];
+    fnv128_hex(key, hex);
+    snprintf(buf, cap, "%s/%s.res", dir, hex);
+}
+
+bool rescache_key(Fnv128* key, const char* vmx_path, char** params, int argc,
+                  uint32_t ram_kib, const char* in, size_t in_len){
+    FILE* f = fopen(vmx_path, "rb");
+    if (!f) return false;
+
+    fnv128_init(key);
+    fnv128_field(key, RESCACHE_VERSION, sizeof RESCACHE_VERSION - 1);
+
+    /* el programa entra con su largo al final: se lee de a bloques */
+    char buf[65536];
+    uint64_t total = 0;
+    size_t r;
+    while ((r = fread(buf, 1, sizeof buf, f)) > 0){
+        fnv128_add(key, buf, r);
+        total += r;
+    }
+    bool ok = !ferror(f);
+    fclose(f);
+    fnv128_add(key, &total, sizeof total);
+
+    uint64_t n = (uint64_t)argc;
+    fnv128_add(key, &n, sizeof n);
+    for (int i = 0; i < argc; i++) fnv128_field(key, params[i], strlen(params[i]));
+    fnv128_add(key, &ram_kib, sizeof ram_kib);
+    fnv128_field(key, in, in_len);
+    return ok;
+}
+
+bool rescache_lookup(const char* dir, const Fnv128* key, VmOutBuf* out, int* rc){
+    char path[4096];
+    entry_path(path, sizeof path, dir, key);
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+
+    char magic[8];
+    uint32_t code = 0;
+    uint64_t len = 0;
+    bool ok = fread(magic, 1, 8, f) == 8 && memcmp(magic, RESCACHE_MAGIC, 8) == 0
+           && fread(&code, sizeof code, 1, f) == 1
+           && fread(&len, sizeof len, 1, f) == 1;
+    if (ok && len > 0){
+        out->data = (char*)malloc((size_t)len);
+        ok = out->data && fread(out->data, 1, (size_t)len, f) == len;
+        if (ok) out->len = out->cap = (size_t)len;
+        else vmio_outbuf_free(out);
+    }
+    fclose(f);
+    if (ok) *rc = (int)code;
+    return ok;
+}
+
+bool rescache_store(const char* dir, const Fnv128* key, const VmOutBuf* out, int rc){
+    char path[4096], tmp[4200];
+    mkdir(dir, 0777);
+    entry_path(path, sizeof path, dir, key);
+    snprintf(tmp, sizeof tmp, "%s.%ld.tmp", path, (long)getpid());
+
+    /* se escribe aparte y se renombra: un lector nunca ve una entrada a medias */
+    FILE* f = fopen(tmp, "wb");
+    if (!f) return false;
+    uint32_t code = (uint32_t)rc;
+    uint64_t len  = (uint64_t)out->len;
+    bool ok = fwrite(RESCACHE_MAGIC, 1, 8, f) == 8
+           && fwrite(&code, sizeof code, 1, f) == 1
+           && fwrite(&len, sizeof len, 1, f) == 1
+           && (len == 0 || fwrite(out->data, 1, out->len, f) == out->len);
+    if (fclose(f) != 0) ok = false;
+    if (ok && rename(tmp, path) == 0) return true;
+    unlink(tmp);
+    return false;
+}
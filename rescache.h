@@ -0,0 +1,21 @@
+#pragma once
+#include "hash.h"
+#include "vmio.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Cache de resultados en disco: una corrida determinista (sin RND, reloj,
+   SYS 0xF, procesos ni hilos; ver vm->nondet) queda guardada con su salida
+   bajo la clave hash(programa, params, m=, stdin), solo si terminó con
+   código 0 (stderr no se guarda).
+   Un archivo por corrida: DIR/<32 hex>.res */
+
+#define RESCACHE_VERSION "mv-rescache-1"   /* cambiarla invalida lo guardado */
+
+bool rescache_key(Fnv128* key, const char* vmx_path, char** params, int argc,
+                  uint32_t ram_kib, const char* in, size_t in_len);
+
+/* true si estaba: out recibe la salida y *rc el código */
+bool rescache_lookup(const char* dir, const Fnv128* key, VmOutBuf* out, int* rc);
+
+bool rescache_store(const char* dir, const Fnv128* key, const VmOutBuf* out, int rc);
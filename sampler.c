@@ -0,0 +1,279 @@
+#include "sampler.h"
+#include "decoder.h"
+#include "disasm.h"
+#include "memory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+#define SAMPLER_MAX_FRAMES 64
+#define SAMPLER_TOP        10
+
+struct Sampler {
+    VM*      vm;
+    u32      hz;
+    u16      entry;          /* dirección física del punto de entrada */
+    u32*     hits;           /* muestras por dirección física */
+    volatile u32 total;
+    volatile u32 outside;    /* muestras con IP fuera del código */
+    volatile u32 lost;       /* expiraciones del timer que no llegaron como señal */
+    volatile uint64_t stack_bytes_sum;
+    volatile u32 stack_bytes_max;
+    volatile uint64_t frames_sum;
+    volatile u32 frames_max;
+    int      running;
+#ifndef _WIN32
+#if defined(_POSIX_TIMERS) && _POSIX_TIMERS > 0 && defined(__linux__)
+    timer_t  timer;
+#endif
+    struct sigaction old_action;
+#endif
+};
+
+#ifndef _WIN32
+
+/* el handler de señal solo puede ver estado global */
+static Sampler* volatile active_sampler = NULL;
+
+static inline u32 ram_be32(const VM* vm, u32 phys){
+    return ((u32)vm->ram[phys] << 24) | ((u32)vm->ram[phys+1] << 16)
+         | ((u32)vm->ram[phys+2] << 8) | (u32)vm->ram[phys+3];
+}
+
+static void on_sigprof(int sig){
+    (void)sig;
+    Sampler* s = active_sampler;
+    if (!s) return;
+    const VM* vm = s->vm;
+
+    s->total++;
+#if defined(_POSIX_TIMERS) && _POSIX_TIMERS > 0 && defined(__linux__)
+    int overrun = timer_getoverrun(s->timer);
+    if (overrun > 0) s->lost += (u32)overrun;
+#endif
+
+    u32 ip = vm->insn_ip;
+    u32 seg = ip >> 16;
+    if (ip == 0xFFFFFFFFu || seg >= SEG_COUNT || (ip & 0xFFFFu) >= vm->seg[seg].size){
+        s->outside++;
+    } else {
+        u32 phys = (u32)vm->seg[seg].base + (ip & 0xFFFFu);
+        s->hits[phys]++;
+    }
+
+    /* profundidad de pila: bytes usados y cadena de BP */
+    u32 sp = vm->reg[SP], bp = vm->reg[BP];
+    u32 ss = sp >> 16;
+    if (sp == 0xFFFFFFFFu || ss >= SEG_COUNT || vm->seg[ss].size == 0) return;
+    u32 size  = vm->seg[ss].size;
+    u32 base  = vm->seg[ss].base;
+    u32 used  = (sp & 0xFFFFu) <= size ? size - (sp & 0xFFFFu) : 0;
+    s->stack_bytes_sum += used;
+    if (used > s->stack_bytes_max) s->stack_bytes_max = used;
+
+    u32 frames = 0;
+    u32 prev = sp & 0xFFFFu;
+    while (frames < SAMPLER_MAX_FRAMES && (bp >> 16) == ss){
+        u32 off = bp & 0xFFFFu;
+        if (off < prev || off + 4u > size) break;
+        frames++;
+        prev = off + 4u;
+        bp = ram_be32(vm, base + off);
+    }
+    s->frames_sum += frames;
+    if (frames > s->frames_max) s->frames_max = frames;
+}
+
+Sampler* sampler_start(VM* vm, u32 hz){
+    if (hz == 0) return NULL;
+    if (active_sampler){
+        fprintf(stderr, "Error: ya hay un muestreador activo\n");
+        return NULL;
+    }
+
+    Sampler* s = (Sampler*)calloc(1, sizeof *s);
+    if (!s) return NULL;
+    s->vm = vm;
+    s->hz = hz;
+    u32 ip_seg = vm->reg[IP] >> 16;
+    s->entry = (ip_seg < SEG_COUNT) ? (u16)(vm->seg[ip_seg].base + (vm->reg[IP] & 0xFFFFu)) : 0;
+    s->hits = (u32*)calloc(0x10000u, sizeof(u32));
+    if (!s->hits){
+        free(s);
+        return NULL;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = on_sigprof;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGPROF, &sa, &s->old_action) != 0){
+        fprintf(stderr, "Error: no pude instalar el handler de SIGPROF\n");
+        sampler_destroy(s);
+        return NULL;
+    }
+    active_sampler = s;
+
+    long period_ns = 1000000000L / (long)hz;
+    if (period_ns <= 0) period_ns = 1;
+
+#if defined(_POSIX_TIMERS) && _POSIX_TIMERS > 0 && defined(__linux__)
+    struct sigevent sev;
+    memset(&sev, 0, sizeof sev);
+    sev.sigev_notify = SIGEV_SIGNAL;
+    sev.sigev_signo  = SIGPROF;
+    struct itimerspec its;
+    its.it_value.tv_sec  = period_ns / 1000000000L;
+    its.it_value.tv_nsec = period_ns % 1000000000L;
+    its.it_interval = its.it_value;
+    if (timer_create(CLOCK_PROCESS_CPUTIME_ID, &sev, &s->timer) != 0 ||
+        timer_settime(s->timer, 0, &its, NULL) != 0){
+        fprintf(stderr, "Error: no pude crear el timer de muestreo\n");
+        active_sampler = NULL;
+        sigaction(SIGPROF, &s->old_action, NULL);
+        sampler_destroy(s);
+        return NULL;
+    }
+#else
+    struct itimerval itv;
+    itv.it_value.tv_sec  = period_ns / 1000000000L;
+    itv.it_value.tv_usec = (period_ns % 1000000000L) / 1000L;
+    if (itv.it_value.tv_sec == 0 && itv.it_value.tv_usec == 0) itv.it_value.tv_usec = 1;
+    itv.it_interval = itv.it_value;
+    if (setitimer(ITIMER_PROF, &itv, NULL) != 0){
+        fprintf(stderr, "Error: no pude crear el timer de muestreo\n");
+        active_sampler = NULL;
+        sigaction(SIGPROF, &s->old_action, NULL);
+        sampler_destroy(s);
+        return NULL;
+    }
+#endif
+    s->running = 1;
+    return s;
+}
+
+void sampler_stop(Sampler* s){
+    if (!s || !s->running) return;
+#if defined(_POSIX_TIMERS) && _POSIX_TIMERS > 0 && defined(__linux__)
+    timer_delete(s->timer);
+#else
+    struct itimerval off;
+    memset(&off, 0, sizeof off);
+    setitimer(ITIMER_PROF, &off, NULL);
+#endif
+    active_sampler = NULL;
+    sigaction(SIGPROF, &s->old_action, NULL);
+    s->running = 0;
+}
+
+#else
+
+Sampler* sampler_start(VM* vm, u32 hz){
+    (void)vm; (void)hz;
+    fprintf(stderr, "Error: --sample requiere un sistema POSIX (SIGPROF)\n");
+    return NULL;
+}
+
+void sampler_stop(Sampler* s){
+    (void)s;
+}
+
+#endif
+
+void sampler_destroy(Sampler* s){
+    if (!s) return;
+    sampler_stop(s);
+    free(s->hits);
+    free(s);
+}
+
+/* rutinas = entrada del programa + destinos inmediatos de CALL */
+static int collect_routines(VM* vm, u16 entry, u16* out, int cap){
+    int n = 0;
+    if (vm->idx_code < 0) return 0;
+    u16 seg  = (u16)vm->idx_code;
+    u16 base = vm->seg[seg].base;
+    u16 size = vm->seg[seg].size;
+
+    out[n++] = entry;
+    u16 off = 0;
+    while (off < size && n < cap){
+        DecodedInst di;
+        if (!decode_at(vm, seg, off, &di)){ off++; continue; }
+        if (di.opcode == 0x0D && di.A.type == OT_IMM){
+            u16 target = be16_pair(di.A.raw[0], di.A.raw[1]);
+            if (target < size) out[n++] = (u16)(base + target);
+        }
+        off = (u16)(off + di.size);
+    }
+
+    for (int i = 1; i < n; i++){
+        u16 k = out[i];
+        int j = i;
+        while (j > 0 && out[j-1] > k){ out[j] = out[j-1]; j--; }
+        out[j] = k;
+    }
+    int m = 0;
+    for (int i = 0; i < n; i++) if (m == 0 || out[m-1] != out[i]) out[m++] = out[i];
+    return m;
+}
+
+void sampler_report(Sampler* s, VM* vm, FILE* out){
+    u32 total = s->total;
+    u32 inside = total - s->outside;
+    fprintf(out, "SAMPLES: %u a %u Hz (%u fuera del código, %u perdidas)\n",
+            (unsigned)total, (unsigned)s->hz, (unsigned)s->outside, (unsigned)s->lost);
+    if (total){
+        fprintf(out, " pila: %.1f bytes promedio, %u max; %.1f frames promedio, %u max\n",
+                (double)s->stack_bytes_sum / total, (unsigned)s->stack_bytes_max,
+                (double)s->frames_sum / total, (unsigned)s->frames_max);
+    }
+    if (!inside || vm->idx_code < 0){
+        fputc('\n', out);
+        return;
+    }
+
+    u16 routines[1024];
+    int nr = collect_routines(vm, s->entry, routines, 1024);
+    u32 per_routine[1024];
+    memset(per_routine, 0, sizeof per_routine);
+
+    u16 base = vm->seg[vm->idx_code].base;
+    u32 end  = (u32)base + vm->seg[vm->idx_code].size;
+    for (u32 a = base; a < end; a++){
+        if (!s->hits[a]) continue;
+        int r = 0;
+        while (r + 1 < nr && routines[r + 1] <= a) r++;
+        per_routine[r] += s->hits[a];
+    }
+
+    fprintf(out, "RUTINAS:\n");
+    for (int r = 0; r < nr; r++){
+        if (!per_routine[r]) continue;
+        fprintf(out, " sub_%04X %10u %6.2f%%\n", (unsigned)(routines[r] - base),
+                (unsigned)per_routine[r], 100.0 * per_routine[r] / inside);
+    }
+
+    fprintf(out, "DIRECCIONES:\n");
+    for (int k = 0; k < SAMPLER_TOP; k++){
+        u32 best = 0, best_a = 0;
+        for (u32 a = base; a < end; a++){
+            if (s->hits[a] > best){ best = s->hits[a]; best_a = a; }
+        }
+        if (!best) break;
+        char text[DISASM_LINE_MAX] = "";
+        DecodedInst di;
+        if (decode_at(vm, (u16)vm->idx_code, (u16)(best_a - base), &di)){
+            disasm_format(vm, &di, text, sizeof text);
+        }
+        fprintf(out, " %10u %6.2f%%  %s\n", (unsigned)best, 100.0 * best / inside, text);
+        s->hits[best_a] = 0;
+    }
+    fputc('\n', out);
+}
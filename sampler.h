@@ -0,0 +1,12 @@
+#pragma once
+#include "vm.h"
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct Sampler Sampler;
+
+/* arranca un timer de SIGPROF a hz muestras por segundo de CPU sobre vm */
+Sampler* sampler_start(VM* vm, u32 hz);
+void     sampler_stop(Sampler* s);
+void     sampler_report(Sampler* s, VM* vm, FILE* out);
+void     sampler_destroy(Sampler* s);
@@ -0,0 +1,613 @@
+#include "sched.h"
+#include "compact.h"
+#include "hostclock.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEQUE_CAP   1024u     /* potencia de 2; si se llena, la tarea va a la cola global */
+#define IDLE_WAIT_NS 10000000 /* un trabajador ocioso vuelve a intentar robar cada 10 ms */
+#define GLOBAL_EVERY 8        /* cada tantas rebanadas se mira primero la cola global */
+
+typedef struct Task Task;
+
+struct Task {
+    VM*       vm;
+    int       in_fd;
+    int       out_fd;
+    char      inbuf[SCHED_INBUF_BYTES];
+    u32       in_len;
+    bool      in_eof;
+    bool      in_fifo;        /* FIFO: read() da 0 también antes de que llegue un escritor */
+    bool      in_writer;      /* ya hubo un escritor (dato o evento de epoll) */
+    bool      polled;         /* in_fd ya está en el epoll (EPOLLONESHOT) */
+    VmOutBuf  out;
+    SchedDone done;
+    void*     arg;
+    Task*     next;           /* cola global */
+
+    /* compactación (solo con idle_ns): mientras espera entrada la tarea está
+       en s->fresh o s->cold, y en cold puede tener la VM comprimida */
+    uint64_t  parked_ns;
+    bool      cold;
+    VmPacked* packed;         /* != NULL: vm == NULL hasta reanudar */
+    Task*     pprev;
+    Task*     pnext;
+};
+
+typedef struct {
+    Task* head;
+    Task* tail;
+} TaskList;
+
+/* cola de Chase-Lev: solo el dueño agrega abajo; todos (el dueño incluido)
+   sacan de arriba, así cada trabajador atiende sus tareas en orden FIFO y
+   una tarea expropiada va al final de la fila */
+typedef struct {
+    atomic_llong   top;
+    atomic_llong   bottom;
+    _Atomic(Task*) buf[DEQUE_CAP];
+} Deque;
+
+typedef struct {
+    Sched*    s;
+    unsigned  id;
+    pthread_t tid;
+    u32       tick;
+    Deque     dq;
+} Worker;
+
+struct Sched {
+    Worker*  w;
+    unsigned nworkers;
+    u32      slice;
+
+    pthread_mutex_t lock;     /* cola global y fin de tareas */
+    pthread_cond_t  work_cv;
+    pthread_cond_t  done_cv;
+    Task*       inj_head;
+    Task*       inj_tail;
+    atomic_uint idle;
+    atomic_int  live;
+    atomic_bool stop;
+
+    int       epfd;
+    int       wake_fd[2];
+    pthread_t io_tid;
+    bool      io_started;
+    pthread_mutex_t out_lock; /* serializa escrituras a stdout del host */
+
+    atomic_ullong slices;
+    atomic_ullong preempts;
+    atomic_ullong blocks;
+    atomic_ullong wakeups;
+    atomic_ullong steals;
+
+    uint64_t        idle_ns;    /* 0 = sin compactación */
+    pthread_mutex_t park_lock;  /* fresh y cold */
+    TaskList        fresh;      /* dormidas, por orden de llegada */
+    TaskList        cold;       /* ya revisadas por la compactación */
+    uint64_t        next_scan_ns;
+
+    atomic_ullong packs;
+    atomic_ullong pack_zero;    /* páginas nulas omitidas */
+    atomic_ullong pack_raw;     /* bytes de VM antes de comprimir, en total */
+    atomic_ullong pack_bytes;   /* y después */
+    atomic_ullong packed_now;   /* bytes comprimidos de las VM todavía dormidas */
+    atomic_ullong packed_peak;
+    atomic_ullong resumes;
+    atomic_ullong resume_ns;
+    atomic_ullong resume_max_ns;
+};
+
+static void list_append(TaskList* l, Task* t){
+    t->pnext = NULL;
+    t->pprev = l->tail;
+    if (l->tail) l->tail->pnext = t;
+    else         l->head = t;
+    l->tail = t;
+}
+
+static void list_remove(TaskList* l, Task* t){
+    if (t->pprev) t->pprev->pnext = t->pnext;
+    else          l->head = t->pnext;
+    if (t->pnext) t->pnext->pprev = t->pprev;
+    else          l->tail = t->pprev;
+    t->pprev = t->pnext = NULL;
+}
+
+static void park_remove(Sched* s, Task* t){
+    pthread_mutex_lock(&s->park_lock);
+    list_remove(t->cold ? &s->cold : &s->fresh, t);
+    t->cold = false;
+    pthread_mutex_unlock(&s->park_lock);
+}
+
+static bool deque_push(Deque* d, Task* t){
+    long long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    long long top = atomic_load_explicit(&d->top, memory_order_acquire);
+    if (b - top >= (long long)DEQUE_CAP) return false;
+    atomic_store_explicit(&d->buf[b & (DEQUE_CAP - 1)], t, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    return true;
+}
+
+static Task* deque_steal(Deque* d){
+    long long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if (t >= b) return NULL;
+    Task* x = atomic_load_explicit(&d->buf[t & (DEQUE_CAP - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed)){
+        return NULL;   /* otro la tomó; se reintenta en la próxima vuelta */
+    }
+    return x;
+}
+
+static void inject_push(Sched* s, Task* t){
+    t->next = NULL;
+    pthread_mutex_lock(&s->lock);
+    if (s->inj_tail) s->inj_tail->next = t;
+    else             s->inj_head = t;
+    s->inj_tail = t;
+    pthread_cond_signal(&s->work_cv);
+    pthread_mutex_unlock(&s->lock);
+}
+
+static Task* inject_pop(Sched* s){
+    pthread_mutex_lock(&s->lock);
+    Task* t = s->inj_head;
+    if (t){
+        s->inj_head = t->next;
+        if (!s->inj_head) s->inj_tail = NULL;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return t;
+}
+
+static int task_read_line(void* ctx, char* buf, size_t cap){
+    Task* t = (Task*)ctx;
+    for (;;){
+        char* nl = (char*)memchr(t->inbuf, '\n', t->in_len);
+        size_t n = nl ? (size_t)(nl - t->inbuf) + 1u : 0u;
+        if (!n && t->in_len && (t->in_eof || t->in_len == sizeof t->inbuf)) n = t->in_len;
+        if (n){
+            if (n > cap - 1) n = cap - 1;
+            memcpy(buf, t->inbuf, n);
+            buf[n] = 0;
+            memmove(t->inbuf, t->inbuf + n, t->in_len - n);
+            t->in_len -= (u32)n;
+            return VMIO_OK;
+        }
+        if (t->in_eof || t->in_fd < 0){
+            buf[0] = 0;
+            return VMIO_EOF;
+        }
+
+        ssize_t r = read(t->in_fd, t->inbuf + t->in_len, sizeof t->inbuf - t->in_len);
+        if (r > 0){
+            t->in_len += (u32)r;
+            t->in_writer = true;
+        } else if (r == 0 && t->in_fifo && !t->in_writer){
+            buf[0] = 0;
+            return VMIO_AGAIN;   /* nadie abrió la FIFO para escribir todavía */
+        } else if (r == 0){
+            t->in_eof = true;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK){
+            buf[0] = 0;
+            return VMIO_AGAIN;
+        } else if (errno != EINTR){
+            t->in_eof = true;   /* error de lectura: como fin de archivo */
+        }
+    }
+}
+
+static void flush_output(Sched* s, Task* t){
+    if (t->out.len == 0) return;
+    if (t->out_fd >= 0){
+        bool host_stdout = t->out_fd == STDOUT_FILENO;
+        if (host_stdout) pthread_mutex_lock(&s->out_lock);
+        size_t off = 0;
+        while (off < t->out.len){
+            ssize_t w = write(t->out_fd, t->out.data + off, t->out.len - off);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) break;
+            off += (size_t)w;
+        }
+        if (host_stdout) pthread_mutex_unlock(&s->out_lock);
+    }
+    t->out.len = 0;
+}
+
+static void finish_task(Sched* s, Task* t, int rc){
+    if (t->in_fd  > STDERR_FILENO) close(t->in_fd);
+    if (t->out_fd > STDERR_FILENO) close(t->out_fd);
+    vmio_outbuf_free(&t->out);
+    if (t->done) t->done(t->arg, t->vm, rc);
+    free(t);
+
+    if (atomic_fetch_sub(&s->live, 1) == 1){
+        pthread_mutex_lock(&s->lock);
+        pthread_cond_broadcast(&s->done_cv);
+        pthread_mutex_unlock(&s->lock);
+    }
+}
+
+/* la tarea queda fuera de toda cola hasta que el hilo de E/S la despierte */
+static void park_on_input(Sched* s, Task* t){
+    if (s->idle_ns){
+        t->parked_ns = host_now_ns();
+        pthread_mutex_lock(&s->park_lock);
+        list_append(&s->fresh, t);
+        pthread_mutex_unlock(&s->park_lock);
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof ev);
+    ev.events   = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    ev.data.ptr = t;
+    int op = t->polled ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    t->polled = true;
+    if (epoll_ctl(s->epfd, op, t->in_fd, &ev) != 0){
+        /* no se puede vigilar (archivo regular, etc.): reintentar más tarde */
+        if (s->idle_ns) park_remove(s, t);
+        inject_push(s, t);
+    }
+}
+
+/* la descompresión la paga el trabajador que la reanuda, no el hilo de E/S */
+static bool unpack_task(Sched* s, Task* t){
+    uint64_t t0 = host_now_ns();
+    size_t bytes = vm_packed_size(t->packed);
+    VM* vm = vm_unpack(t->packed);
+    if (!vm){
+        fprintf(stderr, "Error: sin memoria para reanudar una VM comprimida\n");
+        return false;
+    }
+    t->vm     = vm;
+    t->packed = NULL;
+
+    uint64_t ns = host_now_ns() - t0;
+    atomic_fetch_sub_explicit(&s->packed_now, bytes, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s->resumes, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s->resume_ns, ns, memory_order_relaxed);
+    unsigned long long max = atomic_load_explicit(&s->resume_max_ns, memory_order_relaxed);
+    while (ns > max &&
+           !atomic_compare_exchange_weak_explicit(&s->resume_max_ns, &max, ns,
+                                                  memory_order_relaxed, memory_order_relaxed)){}
+    return true;
+}
+
+static void run_slice(Worker* w, Task* t){
+    Sched* s = w->s;
+    if (t->packed && !unpack_task(s, t)){
+        inject_push(s, t);   /* se reintenta cuando haya memoria */
+        return;
+    }
+    VmExit r = vm_run_for(t->vm, s->slice);
+    atomic_fetch_add_explicit(&s->slices, 1, memory_order_relaxed);
+    flush_output(s, t);
+
+    switch (r){
+    case VM_PREEMPTED:
+        atomic_fetch_add_explicit(&s->preempts, 1, memory_order_relaxed);
+        if (!deque_push(&w->dq, t)){
+            inject_push(s, t);
+        } else if (atomic_load_explicit(&s->idle, memory_order_relaxed)){
+            pthread_mutex_lock(&s->lock);
+            pthread_cond_signal(&s->work_cv);
+            pthread_mutex_unlock(&s->lock);
+        }
+        break;
+    case VM_BLOCKED:
+        atomic_fetch_add_explicit(&s->blocks, 1, memory_order_relaxed);
+        park_on_input(s, t);
+        break;
+    default:
+        finish_task(s, t, vm_exit_rc(r));
+        break;
+    }
+}
+
+static Task* find_task(Worker* w){
+    Sched* s = w->s;
+    Task* t;
+
+    /* sin esto, una tarea de cálculo que se re-encola sola dejaría sin turno
+       a las tareas despertadas por E/S */
+    if (++w->tick % GLOBAL_EVERY == 0){
+        t = inject_pop(s);
+        if (t) return t;
+    }
+
+    t = deque_steal(&w->dq);
+    if (t) return t;
+
+    t = inject_pop(s);
+    if (t) return t;
+
+    for (unsigned k = 1; k < s->nworkers; k++){
+        Worker* v = &s->w[(w->id + k) % s->nworkers];
+        t = deque_steal(&v->dq);
+        if (t){
+            atomic_fetch_add_explicit(&s->steals, 1, memory_order_relaxed);
+            return t;
+        }
+    }
+    return NULL;
+}
+
+static void* worker_main(void* arg){
+    Worker* w = (Worker*)arg;
+    Sched* s = w->s;
+
+    while (!atomic_load(&s->stop)){
+        Task* t = find_task(w);
+        if (t){
+            run_slice(w, t);
+            continue;
+        }
+
+        pthread_mutex_lock(&s->lock);
+        if (!s->inj_head && !atomic_load(&s->stop)){
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += IDLE_WAIT_NS;
+            if (until.tv_nsec >= 1000000000L){
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000L;
+            }
+            atomic_fetch_add(&s->idle, 1);
+            pthread_cond_timedwait(&s->work_cv, &s->lock, &until);
+            atomic_fetch_sub(&s->idle, 1);
+        }
+        pthread_mutex_unlock(&s->lock);
+    }
+    return NULL;
+}
+
+/* comprime las VM que llevan más de idle_ns esperando entrada; la más vieja
+   está primero en fresh. Una por vez bajo park_lock, así un trabajador que
+   se duerme no espera más que una compresión */
+static void compact_idle(Sched* s){
+    uint64_t now = host_now_ns();
+    if (now < s->next_scan_ns) return;
+    s->next_scan_ns = now + s->idle_ns / 4;
+
+    bool freed = false;
+    for (;;){
+        pthread_mutex_lock(&s->park_lock);
+        Task* t = s->fresh.head;
+        if (!t || now - t->parked_ns < s->idle_ns){
+            pthread_mutex_unlock(&s->park_lock);
+            break;
+        }
+        list_remove(&s->fresh, t);
+        u32 zero = 0;
+        VmPacked* p = vm_pack(t->vm, &zero);
+        if (p){
+            size_t bytes = vm_packed_size(p);
+            free(t->vm);
+            freed     = true;
+            t->vm     = NULL;
+            t->packed = p;
+            atomic_fetch_add_explicit(&s->packs, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&s->pack_zero, zero, memory_order_relaxed);
+            atomic_fetch_add_explicit(&s->pack_raw, sizeof(VM), memory_order_relaxed);
+            atomic_fetch_add_explicit(&s->pack_bytes, bytes, memory_order_relaxed);
+            unsigned long long cur = atomic_fetch_add_explicit(&s->packed_now, bytes, memory_order_relaxed) + bytes;
+            if (cur > atomic_load_explicit(&s->packed_peak, memory_order_relaxed)){
+                atomic_store_explicit(&s->packed_peak, cur, memory_order_relaxed);
+            }
+        }
+        t->cold = true;   /* comprimida o no (hilos vivos), no se vuelve a mirar */
+        list_append(&s->cold, t);
+        pthread_mutex_unlock(&s->park_lock);
+    }
+
+    /* una VM (~26 KiB) queda bajo el umbral de mmap: sin esto glibc se
+       guarda los bloques liberados y el proceso no achica */
+    if (freed) malloc_trim(0);
+}
+
+static void* io_main(void* arg){
+    Sched* s = (Sched*)arg;
+    struct epoll_event evs[64];
+
+    /* con compactación, epoll_wait vuelve a tiempo para revisar las dormidas */
+    int timeout_ms = -1;
+    if (s->idle_ns){
+        uint64_t ms = s->idle_ns / 4000000ull;
+        timeout_ms = ms ? (ms < 1000 ? (int)ms : 1000) : 1;
+    }
+
+    for (;;){
+        int n = epoll_wait(s->epfd, evs, 64, timeout_ms);
+        if (n < 0){
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = 0; i < n; i++){
+            Task* t = (Task*)evs[i].data.ptr;
+            if (!t) return NULL;   /* aviso de fin por wake_fd */
+            atomic_fetch_add_explicit(&s->wakeups, 1, memory_order_relaxed);
+            /* una FIFO solo da eventos después de que se conectó un escritor:
+               desde ahora un read() de 0 es fin de archivo */
+            t->in_writer = true;
+            if (s->idle_ns) park_remove(s, t);
+            inject_push(s, t);
+        }
+        if (s->idle_ns) compact_idle(s);
+    }
+    return NULL;
+}
+
+Sched* sched_create(unsigned workers, u32 slice, u32 idle_ms){
+    if (workers == 0) workers = 1;
+    Sched* s = (Sched*)calloc(1, sizeof *s);
+    if (!s) return NULL;
+    s->w = (Worker*)calloc(workers, sizeof *s->w);
+    if (!s->w){
+        free(s);
+        return NULL;
+    }
+    s->nworkers = workers;
+    s->slice    = slice ? slice : SCHED_SLICE_DEFAULT;
+    s->idle_ns  = (uint64_t)idle_ms * 1000000ull;
+    s->wake_fd[0] = s->wake_fd[1] = -1;
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_mutex_init(&s->park_lock, NULL);
+    pthread_mutex_init(&s->out_lock, NULL);
+    pthread_cond_init(&s->work_cv, NULL);
+    pthread_cond_init(&s->done_cv, NULL);
+
+    s->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (s->epfd < 0 || pipe(s->wake_fd) != 0){
+        fprintf(stderr, "Error: no pude crear el epoll del planificador\n");
+        sched_destroy(s);
+        return NULL;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof ev);
+    ev.events   = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(s->epfd, EPOLL_CTL_ADD, s->wake_fd[0], &ev);
+
+    if (pthread_create(&s->io_tid, NULL, io_main, s) != 0){
+        fprintf(stderr, "Error: no pude crear el hilo de E/S\n");
+        sched_destroy(s);
+        return NULL;
+    }
+    s->io_started = true;
+
+    for (unsigned i = 0; i < workers; i++){
+        s->w[i].s  = s;
+        s->w[i].id = i;
+        if (pthread_create(&s->w[i].tid, NULL, worker_main, &s->w[i]) != 0){
+            fprintf(stderr, "Error: no pude crear el hilo trabajador %u\n", i);
+            s->nworkers = i;
+            sched_destroy(s);
+            return NULL;
+        }
+    }
+    return s;
+}
+
+bool sched_spawn(Sched* s, VM* vm, int in_fd, int out_fd, SchedDone done, void* arg){
+    Task* t = (Task*)calloc(1, sizeof *t);
+    if (!t) return false;
+    t->vm     = vm;
+    t->in_fd  = in_fd;
+    t->out_fd = out_fd;
+    struct stat st;
+    t->in_fifo = in_fd >= 0 && fstat(in_fd, &st) == 0 && S_ISFIFO(st.st_mode);
+    t->done   = done;
+    t->arg    = arg;
+
+    vmio_capture(&vm->io, &t->out);
+    vm->io.read_line = task_read_line;
+    vm->io.in_ctx    = t;
+
+    atomic_fetch_add(&s->live, 1);
+    inject_push(s, t);
+    return true;
+}
+
+void sched_wait(Sched* s){
+    pthread_mutex_lock(&s->lock);
+    while (atomic_load(&s->live) > 0){
+        pthread_cond_wait(&s->done_cv, &s->lock);
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+void sched_report(const Sched* s, FILE* out){
+    fprintf(out, "planificador: %u hilos, rebanada %u instr; rebanadas %llu, expropiaciones %llu, "
+                 "bloqueos por E/S %llu, despertares %llu, robos %llu\n",
+            s->nworkers, s->slice,
+            (unsigned long long)atomic_load(&s->slices),
+            (unsigned long long)atomic_load(&s->preempts),
+            (unsigned long long)atomic_load(&s->blocks),
+            (unsigned long long)atomic_load(&s->wakeups),
+            (unsigned long long)atomic_load(&s->steals));
+    if (!s->idle_ns) return;
+
+    unsigned long long packs   = atomic_load(&s->packs);
+    unsigned long long raw     = atomic_load(&s->pack_raw);
+    unsigned long long bytes   = atomic_load(&s->pack_bytes);
+    unsigned long long resumes = atomic_load(&s->resumes);
+    fprintf(out, "compactacion (dormidas > %llu ms): %llu VM comprimidas, %.1f KiB -> %.1f KiB",
+            (unsigned long long)(s->idle_ns / 1000000ull), packs, raw / 1024.0, bytes / 1024.0);
+    if (bytes) fprintf(out, " (%.1fx)", (double)raw / (double)bytes);
+    fprintf(out, ", %llu paginas nulas; pico %.1f KiB comprimidos a la vez\n",
+            (unsigned long long)atomic_load(&s->pack_zero),
+            atomic_load(&s->packed_peak) / 1024.0);
+    fprintf(out, "reanudaciones: %llu, latencia media %.1f us, max %.1f us\n", resumes,
+            resumes ? (double)atomic_load(&s->resume_ns) / 1e3 / (double)resumes : 0.0,
+            (double)atomic_load(&s->resume_max_ns) / 1e3);
+}
+
+void sched_destroy(Sched* s){
+    if (!s) return;
+
+    atomic_store(&s->stop, true);
+    pthread_mutex_lock(&s->lock);
+    pthread_cond_broadcast(&s->work_cv);
+    pthread_mutex_unlock(&s->lock);
+    for (unsigned i = 0; i < s->nworkers; i++){
+        if (s->w[i].s) pthread_join(s->w[i].tid, NULL);
+    }
+
+    if (s->io_started){
+        char c = 0;
+        if (write(s->wake_fd[1], &c, 1) != 1) { /* nada que hacer */ }
+        pthread_join(s->io_tid, NULL);
+    }
+    if (s->wake_fd[0] >= 0) close(s->wake_fd[0]);
+    if (s->wake_fd[1] >= 0) close(s->wake_fd[1]);
+    if (s->epfd >= 0) close(s->epfd);
+
+    pthread_cond_destroy(&s->done_cv);
+    pthread_cond_destroy(&s->work_cv);
+    pthread_mutex_destroy(&s->park_lock);
+    pthread_mutex_destroy(&s->out_lock);
+    pthread_mutex_destroy(&s->lock);
+    free(s->w);
+    free(s);
+}
+
+#else
+
+struct Sched { int unused; };
+
+Sched* sched_create(unsigned workers, u32 slice, u32 idle_ms){
+    (void)workers; (void)slice; (void)idle_ms;
+    fprintf(stderr, "Error: el planificador requiere Linux (epoll)\n");
+    return NULL;
+}
+
+bool sched_spawn(Sched* s, VM* vm, int in_fd, int out_fd, SchedDone done, void* arg){
+    (void)s; (void)vm; (void)in_fd; (void)out_fd; (void)done; (void)arg;
+    return false;
+}
+
+void sched_wait(Sched* s){ (void)s; }
+
+void sched_report(const Sched* s, FILE* out){ (void)s; (void)out; }
+
+void sched_destroy(Sched* s){ (void)s; }
+
+#endif
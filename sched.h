@@ -0,0 +1,34 @@
+#pragma once
+#include "vm.h"
+
+/* Planificador N:M: muchas VM como tareas cooperativas sobre un pool fijo de
+   hilos con colas de robo de trabajo. Cada tarea corre de a rebanadas de
+   'slice' instrucciones; si SYS 1/3 no tiene entrada la tarea se suspende y
+   un hilo de E/S (epoll) la despierta cuando su descriptor es legible.
+   Con idle_ms > 0 el hilo de E/S comprime (compact.h) las VM que llevan más
+   de idle_ms esperando entrada, y el trabajador que las reanuda las
+   descomprime. Solo Linux. */
+
+#define SCHED_SLICE_DEFAULT 20000u
+#define SCHED_INBUF_BYTES   4096u
+
+typedef struct Sched Sched;
+
+/* se llama desde un hilo trabajador cuando la VM termina (rc de vm_exit_rc) */
+typedef void (*SchedDone)(void* arg, VM* vm, int rc);
+
+/* idle_ms = 0: sin compactación */
+Sched* sched_create(unsigned workers, u32 slice, u32 idle_ms);
+
+/* toma posesión de in_fd/out_fd (-1 = sin entrada / salida descartada) y
+   reemplaza vm->io; in_fd debería ser no bloqueante. vm tiene que venir de
+   malloc: con compactación se libera y se reconstruye en otro lugar, y
+   'done' recibe la dirección actual */
+bool sched_spawn(Sched* s, VM* vm, int in_fd, int out_fd, SchedDone done, void* arg);
+
+/* espera a que terminen todas las tareas lanzadas */
+void sched_wait(Sched* s);
+
+void sched_report(const Sched* s, FILE* out);
+
+void sched_destroy(Sched* s);
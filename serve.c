@@ -0,0 +1,643 @@
+#include "serve.h"
+#include <stdio.h>
+
+#ifdef __unix__
+#include "hash.h"
+#include "vm.h"
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SERVE_REQ_MAX  65536
+#define SERVE_ARGV_MAX 256
+#define SERVE_OUT_BUF  4096
+#define SERVE_IN_BUF   4096
+#define SERVE_SLICE    (1u << 20)   /* instrucciones entre controles de la conexión */
+
+typedef struct {
+    bool     used;
+    uint64_t hash;
+    char*    path;            /* última ruta con la que se pidió */
+    dev_t    dev;
+    ino_t    ino;
+    off_t    size;
+    struct timespec mtime;
+    VmxImage img;
+    u32      refs;            /* trabajos corriendo con esta imagen */
+    uint64_t last_use;
+} ServeImage;
+
+typedef struct {
+    int       lfd;
+    u32       ram_kib;
+    VmLimits  limits;
+    FILE*     log;
+
+    pthread_mutex_t lock;     /* cache y contadores */
+    ServeImage*     cache;
+    unsigned        ncache;
+    uint64_t        tick;
+
+    uint64_t  jobs;
+    uint64_t  hits;
+    uint64_t  misses;
+} Server;
+
+/* salida del invitado hacia la conexión, en marcos 'O' */
+typedef struct {
+    int    fd;
+    bool   broken;            /* el cliente se fue: se descarta el resto */
+    size_t len;
+    char   buf[SERVE_OUT_BUF];
+} ServeOut;
+
+static bool send_all(int fd, const void* data, size_t n){
+    const char* p = (const char*)data;
+    while (n > 0){
+        ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+        if (w < 0){
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return true;
+}
+
+static bool recv_all(int fd, void* data, size_t n){
+    char* p = (char*)data;
+    while (n > 0){
+        ssize_t r = read(fd, p, n);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        p += r;
+        n -= (size_t)r;
+    }
+    return true;
+}
+
+static bool send_frame(int fd, char type, const void* data, u32 n){
+    u8 hdr[5] = { (u8)type, (u8)(n >> 24), (u8)(n >> 16), (u8)(n >> 8), (u8)n };
+    return send_all(fd, hdr, sizeof hdr) && (n == 0 || send_all(fd, data, n));
+}
+
+static void send_error(int fd, const char* msg){
+    (void)send_frame(fd, 'E', msg, (u32)strlen(msg));
+}
+
+static void send_exit(int fd, int rc){
+    u8 b[4] = { (u8)((u32)rc >> 24), (u8)((u32)rc >> 16), (u8)((u32)rc >> 8), (u8)rc };
+    (void)send_frame(fd, 'X', b, 4);
+}
+
+static void out_flush(void* ctx){
+    ServeOut* o = (ServeOut*)ctx;
+    if (o->len && !o->broken){
+        o->broken = !send_frame(o->fd, 'O', o->buf, (u32)o->len);
+    }
+    o->len = 0;
+}
+
+static void out_write(void* ctx, const char* data, size_t n){
+    ServeOut* o = (ServeOut*)ctx;
+    while (n > 0){
+        if (o->len == sizeof o->buf) out_flush(o);
+        size_t k = sizeof o->buf - o->len;
+        if (k > n) k = n;
+        memcpy(o->buf + o->len, data, k);
+        o->len += k;
+        data   += k;
+        n      -= k;
+    }
+}
+
+/* entrada del invitado: el fd del cliente, leído de a líneas con poll sobre
+   la conexión también, para no quedar bloqueado si el cliente se va */
+typedef struct {
+    int    fd;                /* -1 = sin entrada */
+    int    c;
+    bool   eof;
+    bool   gone;              /* el cliente cerró la conexión */
+    u32    len;
+    char   buf[SERVE_IN_BUF];
+} ServeIn;
+
+static short hangup_events(void){
+#ifdef POLLRDHUP
+    return POLLIN | POLLRDHUP;
+#else
+    return POLLIN;
+#endif
+}
+
+/* después del pedido el cliente no manda nada más: cualquier evento en la
+   conexión es que se fue */
+static bool peer_gone(int c){
+    struct pollfd p = { c, hangup_events(), 0 };
+    return poll(&p, 1, 0) > 0;
+}
+
+static int in_read_line(void* ctx, char* buf, size_t cap){
+    ServeIn* in = (ServeIn*)ctx;
+    for (;;){
+        char* nl = (char*)memchr(in->buf, '\n', in->len);
+        size_t n = nl ? (size_t)(nl - in->buf) + 1u : 0u;
+        if (!n && in->len && (in->eof || in->len == sizeof in->buf)) n = in->len;
+        if (n){
+            if (n > cap - 1) n = cap - 1;
+            memcpy(buf, in->buf, n);
+            buf[n] = 0;
+            memmove(in->buf, in->buf + n, in->len - n);
+            in->len -= (u32)n;
+            return VMIO_OK;
+        }
+        if (in->eof || in->gone || in->fd < 0){
+            buf[0] = 0;
+            return VMIO_EOF;
+        }
+
+        struct pollfd p[2] = { { in->fd, POLLIN, 0 }, { in->c, hangup_events(), 0 } };
+        if (poll(p, 2, -1) < 0){
+            if (errno == EINTR) continue;
+            in->eof = true;
+            continue;
+        }
+        if (p[1].revents){
+            in->gone = true;
+            continue;
+        }
+        ssize_t r = read(in->fd, in->buf + in->len, sizeof in->buf - in->len);
+        if (r > 0) in->len += (u32)r;
+        else if (r == 0 || (errno != EINTR && errno != EAGAIN)) in->eof = true;
+    }
+}
+
+static bool same_file(const ServeImage* e, const char* path, const struct stat* st){
+    return e->path && strcmp(e->path, path) == 0
+        && e->dev == st->st_dev && e->ino == st->st_ino && e->size == st->st_size
+        && e->mtime.tv_sec == st->st_mtim.tv_sec && e->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static void remember_file(ServeImage* e, const char* path, const struct stat* st){
+    if (!e->path || strcmp(e->path, path) != 0){
+        free(e->path);
+        e->path = strdup(path);
+    }
+    e->dev   = st->st_dev;
+    e->ino   = st->st_ino;
+    e->size  = st->st_size;
+    e->mtime = st->st_mtim;
+}
+
+static u8* read_file(const char* path, size_t* n){
+    FILE* f = fopen(path, "rb");
+    if (!f) return NULL;
+    u8* data = (u8*)vmio_read_all(f, n);
+    fclose(f);
+    return data;
+}
+
+/* lugar libre o la entrada menos usada que no esté corriendo; NULL si todas corren */
+static ServeImage* cache_slot(Server* s){
+    ServeImage* victim = NULL;
+    for (unsigned i = 0; i < s->ncache; i++){
+        ServeImage* e = &s->cache[i];
+        if (!e->used) return e;
+        if (e->refs == 0 && (!victim || e->last_use < victim->last_use)) victim = e;
+    }
+    if (victim){
+        if (s->log) fprintf(s->log, "cache: sale #%016llx %s\n", (unsigned long long)victim->hash, victim->path);
+        vmx_image_free(&victim->img);
+        free(victim->path);
+        memset(victim, 0, sizeof *victim);
+    }
+    return victim;
+}
+
+/* busca o carga el programa y le suma una referencia. Todo bajo el lock:
+   los fallos de cache son raros y así nunca se lee dos veces el mismo archivo */
+static ServeImage* cache_get(Server* s, const char* prog, char* err, size_t errcap){
+    ServeImage* e = NULL;
+    pthread_mutex_lock(&s->lock);
+
+    if (prog[0] == '#'){
+        uint64_t h = strtoull(prog + 1, NULL, 16);
+        for (unsigned i = 0; i < s->ncache && !e; i++){
+            if (s->cache[i].used && s->cache[i].hash == h) e = &s->cache[i];
+        }
+        if (!e) snprintf(err, errcap, "Error: %s no esta en la cache\n", prog);
+        else s->hits++;
+        goto out;
+    }
+
+    struct stat st;
+    if (stat(prog, &st) != 0){
+        snprintf(err, errcap, "Error: no pude abrir %s\n", prog);
+        goto out;
+    }
+    for (unsigned i = 0; i < s->ncache && !e; i++){
+        if (s->cache[i].used && same_file(&s->cache[i], prog, &st)) e = &s->cache[i];
+    }
+    if (e){
+        s->hits++;
+        goto out;
+    }
+
+    /* archivo nuevo o cambiado: el contenido decide */
+    size_t n = 0;
+    u8* data = read_file(prog, &n);
+    if (!data){
+        snprintf(err, errcap, "Error: no pude leer %s\n", prog);
+        goto out;
+    }
+    uint64_t h = fnv1a64(data, n);
+    free(data);
+    for (unsigned i = 0; i < s->ncache && !e; i++){
+        if (s->cache[i].used && s->cache[i].hash == h) e = &s->cache[i];
+    }
+    if (e){
+        remember_file(e, prog, &st);
+        s->hits++;
+        goto out;
+    }
+
+    e = cache_slot(s);
+    if (!e){
+        snprintf(err, errcap, "Error: la cache esta llena de programas en ejecucion\n");
+        goto out;
+    }
+    if (!vmx_image_read(prog, &e->img)){
+        snprintf(err, errcap, "Error: no pude cargar %s\n", prog);
+        e = NULL;
+        goto out;
+    }
+    e->used = true;
+    e->hash = h;
+    remember_file(e, prog, &st);
+    s->misses++;
+    if (s->log) fprintf(s->log, "cache: carga #%016llx %s\n", (unsigned long long)h, prog);
+
+out:
+    if (e){
+        e->refs++;
+        e->last_use = ++s->tick;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return e;
+}
+
+static void cache_put(Server* s, ServeImage* e){
+    pthread_mutex_lock(&s->lock);
+    e->refs--;
+    s->jobs++;
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* lee el marco 'R'; el fd de entrada viene como dato auxiliar del primer byte */
+static char* read_request(int c, int* in_fd, u32* len){
+    u8 hdr[5];
+    char cbuf[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = { hdr, sizeof hdr };
+    struct msghdr mh;
+    memset(&mh, 0, sizeof mh);
+    mh.msg_iov        = &iov;
+    mh.msg_iovlen     = 1;
+    mh.msg_control    = cbuf;
+    mh.msg_controllen = sizeof cbuf;
+
+    *in_fd = -1;
+    ssize_t r;
+    do {
+        r = recvmsg(c, &mh, MSG_CMSG_CLOEXEC);
+    } while (r < 0 && errno == EINTR);
+    if (r <= 0) return NULL;
+
+    for (struct cmsghdr* cm = CMSG_FIRSTHDR(&mh); cm; cm = CMSG_NXTHDR(&mh, cm)){
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS){
+            memcpy(in_fd, CMSG_DATA(cm), sizeof(int));
+        }
+    }
+    if ((size_t)r < sizeof hdr && !recv_all(c, hdr + r, sizeof hdr - (size_t)r)) return NULL;
+
+    *len = ((u32)hdr[1] << 24) | ((u32)hdr[2] << 16) | ((u32)hdr[3] << 8) | (u32)hdr[4];
+    if (hdr[0] != 'R' || *len == 0 || *len > SERVE_REQ_MAX) return NULL;
+
+    char* req = (char*)malloc(*len + 1);
+    if (!req) return NULL;
+    if (!recv_all(c, req, *len)){
+        free(req);
+        return NULL;
+    }
+    req[*len] = 0;
+    return req;
+}
+
+static void serve_conn(Server* s, VM* vm, int c){
+    int in_fd = -1;
+    u32 len = 0;
+    char* req = read_request(c, &in_fd, &len);
+    if (!req){
+        if (in_fd >= 0) close(in_fd);
+        send_error(c, "Error: pedido mal formado\n");
+        send_exit(c, SERVE_RC_LOAD);
+        return;
+    }
+
+    char* argv[SERVE_ARGV_MAX];
+    int n = 0;
+    for (u32 i = 0; i < len && n < SERVE_ARGV_MAX; i += (u32)strlen(req + i) + 1){
+        argv[n++] = req + i;
+    }
+
+    char err[512];
+    ServeImage* e = cache_get(s, argv[0], err, sizeof err);
+    if (!e){
+        if (in_fd >= 0) close(in_fd);
+        free(req);
+        send_error(c, err);
+        send_exit(c, SERVE_RC_LOAD);
+        return;
+    }
+
+    ServeIn in;
+    in.fd   = in_fd;
+    in.c    = c;
+    in.eof  = false;
+    in.gone = false;
+    in.len  = 0;
+
+    ServeOut out;
+    out.fd     = c;
+    out.broken = false;
+    out.len    = 0;
+
+    int argc = n - 1;
+    vm_init_job(vm, s->ram_kib, argv[0], argc);
+    vm->limits        = s->limits;
+    vm->io.read_line = in_read_line;
+    vm->io.in_ctx    = &in;
+    vm->io.write   = out_write;
+    vm->io.flush   = out_flush;
+    vm->io.out_ctx = &out;
+
+    /* de a tramos: si el cliente se fue, el trabajo se abandona y el hilo
+       queda libre */
+    int rc = SERVE_RC_LOAD;
+    bool gone = false;
+    if (vm_load_image(vm, &e->img, argc > 0 ? &argv[1] : NULL, argc)){
+        VmExit r;
+        do {
+            r = vm_run_for(vm, SERVE_SLICE);
+            gone = in.gone || out.broken || peer_gone(c);
+        } while (r == VM_PREEMPTED && !gone);
+        rc = gone ? 1 : vm_exit_rc(r);
+    }
+    out_flush(&out);
+    vm_release(vm);
+    cache_put(s, e);
+    if (in_fd >= 0) close(in_fd);
+
+    if (gone && s->log){
+        pthread_mutex_lock(&s->lock);
+        fprintf(s->log, "cliente desconectado: se abandona %s\n", argv[0]);
+        fflush(s->log);
+        pthread_mutex_unlock(&s->lock);
+    }
+    free(req);
+    if (gone) return;
+
+    send_exit(c, rc);
+}
+
+static void* serve_worker(void* arg){
+    Server* s = (Server*)arg;
+    VM* vm = (VM*)malloc(sizeof *vm);
+    if (!vm) return NULL;
+    for (;;){
+        int c = accept(s->lfd, NULL, NULL);
+        if (c < 0){
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        serve_conn(s, vm, c);
+        close(c);
+    }
+    free(vm);
+    return NULL;
+}
+
+static int listen_unix(const char* path){
+    struct sockaddr_un sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof sa.sun_path){
+        fprintf(stderr, "Error: ruta de socket demasiado larga: %s\n", path);
+        return -1;
+    }
+    strcpy(sa.sun_path, path);
+
+    /* un socket viejo de una corrida anterior */
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&sa, sizeof sa) != 0 || listen(fd, 128) != 0){
+        fprintf(stderr, "Error: no pude escuchar en %s\n", path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int serve_run(const char* sock_path, unsigned workers, uint32_t ram_kib, unsigned cache_size,
+              const VmLimits* limits, FILE* log){
+    /* estática: los hilos no se esperan al salir y los trabajos en curso
+       la siguen usando hasta que termina el proceso */
+    static Server s;
+    memset(&s, 0, sizeof s);
+    s.ram_kib = ram_kib;
+    if (limits){
+        s.limits = *limits;
+        s.limits.dump_path = NULL;   /* el servidor no deja archivos por trabajo */
+    }
+    if (!s.limits.wall_ns) s.limits.wall_ns = (uint64_t)SERVE_MAX_TIME_DEFAULT * 1000000ull;
+    s.log     = log;
+    s.ncache  = cache_size;
+    s.cache   = (ServeImage*)calloc(cache_size, sizeof *s.cache);
+    if (!s.cache) return 1;
+    pthread_mutex_init(&s.lock, NULL);
+
+    s.lfd = listen_unix(sock_path);
+    if (s.lfd < 0){
+        free(s.cache);
+        return 1;
+    }
+
+    /* las señales de fin las atiende solo este hilo */
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    for (unsigned i = 0; i < workers; i++){
+        pthread_t th;
+        if (pthread_create(&th, NULL, serve_worker, &s) != 0){
+            fprintf(stderr, "Error: no pude crear el hilo %u\n", i);
+            break;
+        }
+        pthread_detach(th);
+    }
+    if (log){
+        fprintf(log, "== escuchando en %s: %u hilos, cache de %u programas ==\n", sock_path, workers, cache_size);
+        fflush(log);
+    }
+
+    int sig = 0;
+    sigwait(&set, &sig);
+
+    /* los trabajos en curso terminan con el proceso */
+    close(s.lfd);
+    unlink(sock_path);
+    if (log){
+        pthread_mutex_lock(&s.lock);
+        fprintf(log, "== servidor: %llu trabajos, cache %llu aciertos / %llu cargas ==\n",
+                (unsigned long long)s.jobs, (unsigned long long)s.hits, (unsigned long long)s.misses);
+        pthread_mutex_unlock(&s.lock);
+    }
+    return 0;
+}
+
+int serve_request(const char* sock_path, const char* prog, char** params, int argc){
+    struct sockaddr_un sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sun_family = AF_UNIX;
+    if (strlen(sock_path) >= sizeof sa.sun_path){
+        fprintf(stderr, "Error: ruta de socket demasiado larga: %s\n", sock_path);
+        return SERVE_RC_LOAD;
+    }
+    strcpy(sa.sun_path, sock_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&sa, sizeof sa) != 0){
+        fprintf(stderr, "Error: no pude conectar con %s\n", sock_path);
+        if (fd >= 0) close(fd);
+        return SERVE_RC_LOAD;
+    }
+
+    /* el servidor corre en otro directorio: la ruta va absoluta */
+    char abs[PATH_MAX];
+    if (prog[0] != '#'){
+        if (!realpath(prog, abs)){
+            fprintf(stderr, "Error: no pude abrir %s\n", prog);
+            close(fd);
+            return SERVE_RC_LOAD;
+        }
+        prog = abs;
+    }
+
+    size_t len = strlen(prog) + 1;
+    for (int i = 0; i < argc; i++) len += strlen(params[i]) + 1;
+    if (len > SERVE_REQ_MAX){
+        fprintf(stderr, "Error: pedido demasiado largo\n");
+        close(fd);
+        return SERVE_RC_LOAD;
+    }
+    u8* msg = (u8*)malloc(5 + len);
+    if (!msg){
+        close(fd);
+        return SERVE_RC_LOAD;
+    }
+    msg[0] = 'R';
+    msg[1] = (u8)(len >> 24);
+    msg[2] = (u8)(len >> 16);
+    msg[3] = (u8)(len >> 8);
+    msg[4] = (u8)len;
+    size_t off = 5;
+    memcpy(msg + off, prog, strlen(prog) + 1);
+    off += strlen(prog) + 1;
+    for (int i = 0; i < argc; i++){
+        memcpy(msg + off, params[i], strlen(params[i]) + 1);
+        off += strlen(params[i]) + 1;
+    }
+
+    /* el fd de stdin viaja con el primer byte */
+    int in_fd = STDIN_FILENO;
+    char cbuf[CMSG_SPACE(sizeof(int))];
+    memset(cbuf, 0, sizeof cbuf);
+    struct iovec iov = { msg, 1 };
+    struct msghdr mh;
+    memset(&mh, 0, sizeof mh);
+    mh.msg_iov        = &iov;
+    mh.msg_iovlen     = 1;
+    mh.msg_control    = cbuf;
+    mh.msg_controllen = sizeof cbuf;
+    struct cmsghdr* cm = CMSG_FIRSTHDR(&mh);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type  = SCM_RIGHTS;
+    cm->cmsg_len   = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cm), &in_fd, sizeof(int));
+
+    bool ok = sendmsg(fd, &mh, MSG_NOSIGNAL) == 1 && send_all(fd, msg + 1, off - 1);
+    free(msg);
+    if (!ok){
+        fprintf(stderr, "Error: no pude enviar el pedido\n");
+        close(fd);
+        return SERVE_RC_LOAD;
+    }
+
+    int rc = -1;
+    char buf[SERVE_OUT_BUF];
+    for (;;){
+        u8 hdr[5];
+        if (!recv_all(fd, hdr, sizeof hdr)) break;
+        u32 n = ((u32)hdr[1] << 24) | ((u32)hdr[2] << 16) | ((u32)hdr[3] << 8) | (u32)hdr[4];
+        if (hdr[0] == 'X'){
+            u8 b[4];
+            if (n != 4 || !recv_all(fd, b, 4)) break;
+            rc = (int)(((u32)b[0] << 24) | ((u32)b[1] << 16) | ((u32)b[2] << 8) | (u32)b[3]);
+            break;
+        }
+        FILE* dst = hdr[0] == 'E' ? stderr : stdout;
+        while (n > 0){
+            u32 k = n < sizeof buf ? n : (u32)sizeof buf;
+            if (!recv_all(fd, buf, k)) break;
+            fwrite(buf, 1, k, dst);
+            n -= k;
+        }
+        if (n > 0) break;
+    }
+    fflush(stdout);
+    close(fd);
+    if (rc < 0){
+        fprintf(stderr, "Error: el servidor corto la conexion\n");
+        return SERVE_RC_LOAD;
+    }
+    return rc;
+}
+
+#else
+
+int serve_run(const char* sock_path, unsigned workers, uint32_t ram_kib, unsigned cache_size,
+              const VmLimits* limits, FILE* log){
+    (void)sock_path; (void)workers; (void)ram_kib; (void)cache_size; (void)limits; (void)log;
+    fprintf(stderr, "Error: el servidor requiere sockets Unix\n");
+    return 1;
+}
+
+int serve_request(const char* sock_path, const char* prog, char** params, int argc){
+    (void)sock_path; (void)prog; (void)params; (void)argc;
+    fprintf(stderr, "Error: --connect requiere sockets Unix\n");
+    return SERVE_RC_LOAD;
+}
+
+#endif
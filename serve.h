@@ -0,0 +1,36 @@
+#pragma once
+#include "vm.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/* Servidor: deja los programas ya leídos en una cache y corre trabajos
+   pedidos por un socket Unix local, sin crear un proceso por trabajo.
+
+   Cada mensaje es un marco: 1 byte de tipo, 4 bytes de largo (big-endian)
+   y el contenido.
+     cliente  -> 'R'  programa\0param1\0param2\0...
+                      programa = ruta al .vmx o '#' y el hash en hex (16 dígitos)
+                      de un programa que ya está en la cache. Con el marco puede
+                      ir un fd por SCM_RIGHTS: la entrada del invitado (sin fd = EOF)
+     servidor -> 'O'  salida del invitado (uno o más marcos, a medida que sale)
+                 'E'  mensaje de error
+                 'X'  4 bytes: código de salida (0 ok, 1 error en el programa,
+                      SERVE_RC_LOAD no se pudo cargar, VM_RC_LIMIT cuota agotada)
+
+   La cache es LRU y la clave es el hash del contenido del archivo: la misma
+   ruta con otro contenido es otra entrada, y dos rutas iguales en contenido
+   comparten la imagen. */
+
+#define SERVE_CACHE_DEFAULT 64
+#define SERVE_RC_LOAD       2
+#define SERVE_MAX_TIME_DEFAULT 60000u   /* ms por trabajo si no se pide --max-time */
+
+/* no vuelve salvo error al abrir el socket o SIGINT/SIGTERM.
+   limits (puede ser NULL): cuotas de cada trabajo, sin volcado .vmi; sin
+   cuota de tiempo se usa SERVE_MAX_TIME_DEFAULT. Un trabajo cuyo cliente
+   se desconecta se abandona */
+int serve_run(const char* sock_path, unsigned workers, uint32_t ram_kib, unsigned cache_size,
+              const VmLimits* limits, FILE* log);
+
+/* cliente: manda stdin como entrada y copia la salida a stdout; devuelve el código del trabajo */
+int serve_request(const char* sock_path, const char* prog, char** params, int argc);
@@ -0,0 +1,59 @@
+#include "snapshot.h"
+#include <stdlib.h>
+#include <string.h>
+
+_Static_assert(VM_PAGES <= 64, "vm->dirty tiene un bit por página");
+
+VmSnapshot* vm_snapshot(VM* vm){
+    VmSnapshot* s = (VmSnapshot*)calloc(1, sizeof *s);
+    if (!s) return NULL;
+    memcpy(&s->vm, vm, sizeof *vm);
+    s->vm.mem = s->vm.ram;
+    vm->dirty = 0;
+    return s;
+}
+
+u32 vm_reset(VM* vm, VmSnapshot* snap){
+    const VM* base = &snap->vm;
+
+    /* procesos e hilos escriben ram sin pasar por vm->dirty de esta VM */
+    bool all = vm->procs || vm->threads;
+    vm_release(vm);
+
+    uint64_t dirty = all ? ~0ull : vm->dirty;
+    u32 n = 0;
+    while (dirty){
+        unsigned p = (unsigned)__builtin_ctzll(dirty);
+        dirty &= dirty - 1;
+        if (p >= VM_PAGES) break;
+        memcpy(&vm->ram[p << VM_PAGE_SHIFT], &base->ram[p << VM_PAGE_SHIFT], VM_PAGE_BYTES);
+        n++;
+    }
+    vm->dirty = 0;
+
+    memcpy(vm->reg, base->reg, sizeof vm->reg);
+    memcpy(vm->seg, base->seg, sizeof vm->seg);
+    vm->insn_ip     = base->insn_ip;
+    vm->idx_param   = base->idx_param;
+    vm->idx_const   = base->idx_const;
+    vm->idx_code    = base->idx_code;
+    vm->idx_data    = base->idx_data;
+    vm->idx_extra   = base->idx_extra;
+    vm->idx_stack   = base->idx_stack;
+    vm->code_size   = base->code_size;
+    vm->sys_resume  = base->sys_resume;
+    vm->sys_waiting = base->sys_waiting;
+    vm->stats       = base->stats;    /* SYS 0x14 y las cuotas cuentan desde la foto */
+    vm->rng         = base->rng;
+    vm->nondet      = base->nondet;
+    vm->limits.armed = false;   /* cuotas nuevas para la próxima corrida */
+
+    snap->resets++;
+    snap->pages += n;
+    if (all) snap->full++;
+    return n;
+}
+
+void vm_snapshot_free(VmSnapshot* snap){
+    free(snap);
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "vm.h"
+#include <stdint.h>
+
+/* Foto de la VM recién cargada, para correr el mismo programa muchas veces.
+   memory.c marca en vm->dirty las páginas de ram que se escriben; vm_reset
+   devuelve los registros y solo esas páginas al estado de la foto. */
+
+typedef struct VmSnapshot {
+    VM       vm;              /* copia completa tomada después de vm_load */
+    uint64_t resets;
+    uint64_t pages;           /* páginas copiadas en total por los resets */
+    uint64_t full;            /* resets que copiaron toda la ram (procesos/hilos) */
+} VmSnapshot;
+
+/* toma la foto y empieza a seguir las páginas escritas */
+VmSnapshot* vm_snapshot(VM* vm);
+
+/* vuelve al estado de la foto (también contadores y semilla de RND);
+   la E/S y las herramientas de vm no cambian.
+   Devuelve la cantidad de páginas copiadas */
+u32  vm_reset(VM* vm, VmSnapshot* snap);
+
+void vm_snapshot_free(VmSnapshot* snap);
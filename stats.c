@@ -0,0 +1,66 @@
+#include "stats.h"
+#include <stdio.h>
+
+static double seconds(uint64_t ns){
+    return (double)ns / 1e9;
+}
+
+void stats_merge(VmStats* dst, const VmStats* src){
+    dst->insns += src->insns;
+    for (int i = 0; i < 3; i++){
+        dst->mem_reads[i]  += src->mem_reads[i];
+        dst->mem_writes[i] += src->mem_writes[i];
+    }
+    for (int s = 0; s < STATS_SYS_SLOTS; s++){
+        dst->sys_count[s] += src->sys_count[s];
+        dst->sys_ns[s]    += src->sys_ns[s];
+        for (int b = 0; b < STATS_HIST_BUCKETS; b++){
+            dst->sys_hist[s][b] += src->sys_hist[s][b];
+        }
+    }
+    if (src->stack_peak > dst->stack_peak) dst->stack_peak = src->stack_peak;
+}
+
+void stats_write_json(const VmStats* st, FILE* out){
+    double run_s = seconds(st->run_ns);
+    double mips  = run_s > 0.0 ? (double)st->insns / run_s / 1e6 : 0.0;
+    static const unsigned widths[3] = {1, 2, 4};
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"phases\": {\"load_s\": %.9f, \"run_s\": %.9f, \"snapshot_s\": %.9f, \"snapshots\": %u},\n",
+            seconds(st->load_ns), run_s, seconds(st->snapshot_ns), (unsigned)st->snapshots);
+    fprintf(out, "  \"instructions\": %llu,\n", (unsigned long long)st->insns);
+    fprintf(out, "  \"mips\": %.3f,\n", mips);
+
+    fprintf(out, "  \"memory\": {\n    \"reads\": {");
+    for (int i = 0; i < 3; i++){
+        fprintf(out, "%s\"%u\": %llu", i ? ", " : "", widths[i], (unsigned long long)st->mem_reads[i]);
+    }
+    fprintf(out, "},\n    \"writes\": {");
+    for (int i = 0; i < 3; i++){
+        fprintf(out, "%s\"%u\": %llu", i ? ", " : "", widths[i], (unsigned long long)st->mem_writes[i]);
+    }
+    fprintf(out, "}\n  },\n");
+
+    fprintf(out, "  \"sys\": {");
+    int first = 1;
+    for (int c = 0; c < STATS_SYS_SLOTS; c++){
+        if (!st->sys_count[c]) continue;
+        fprintf(out, "%s\n    \"%s%d\": {\"count\": %llu, \"total_ns\": %llu, \"latency_ns_hist\": {",
+                first ? "" : ",", c == STATS_SYS_SLOTS - 1 ? ">=" : "", c,
+                (unsigned long long)st->sys_count[c], (unsigned long long)st->sys_ns[c]);
+        int fb = 1;
+        for (int b = 0; b < STATS_HIST_BUCKETS; b++){
+            if (!st->sys_hist[c][b]) continue;
+            /* clave = cota superior (exclusiva) de la casilla */
+            fprintf(out, "%s\"%llu\": %u", fb ? "" : ", ", 1ull << (b + 1), (unsigned)st->sys_hist[c][b]);
+            fb = 0;
+        }
+        fprintf(out, "}}");
+        first = 0;
+    }
+    fprintf(out, "%s},\n", first ? "" : "\n  ");
+
+    fprintf(out, "  \"stack_peak_bytes\": %u\n", (unsigned)st->stack_peak);
+    fprintf(out, "}\n");
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+#define STATS_SYS_SLOTS    64   /* la última casilla junta los números de SYS mayores */
+#define STATS_HIST_BUCKETS 32   /* casilla i: latencias en [2^i, 2^(i+1)) ns */
+
+typedef struct {
+    uint64_t load_ns;
+    uint64_t run_ns;
+    uint64_t snapshot_ns;
+    uint32_t snapshots;
+
+    uint64_t insns;
+    uint64_t mem_reads[3];     /* por ancho: 1, 2 y 4 bytes */
+    uint64_t mem_writes[3];
+
+    uint64_t sys_count[STATS_SYS_SLOTS];
+    uint64_t sys_ns[STATS_SYS_SLOTS];
+    uint32_t sys_hist[STATS_SYS_SLOTS][STATS_HIST_BUCKETS];
+
+    uint32_t stack_peak;       /* bytes usados en la pila, máximo */
+} VmStats;
+
+/* nbytes es 1, 2 o 4 -> casillas 0, 1, 2 */
+static inline unsigned stats_width_slot(uint16_t nbytes){
+    return (unsigned)(nbytes >> 1);
+}
+
+static inline void stats_sys(VmStats* st, uint32_t callno, uint64_t ns){
+    unsigned slot = callno < STATS_SYS_SLOTS ? (unsigned)callno : STATS_SYS_SLOTS - 1;
+    unsigned b = 0;
+    while (b + 1 < STATS_HIST_BUCKETS && (ns >> (b + 1)) != 0) b++;
+    st->sys_count[slot]++;
+    st->sys_ns[slot] += ns;
+    st->sys_hist[slot][b]++;
+}
+
+/* suma los contadores de src en dst (los tiempos de carga/ejecución no) */
+void stats_merge(VmStats* dst, const VmStats* src);
+
+void stats_write_json(const VmStats* st, FILE* out);
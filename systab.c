@@ -0,0 +1,103 @@
+#include "systab.h"
+#include "memory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __unix__
+#include <dlfcn.h>
+#endif
+
+static bool call_read(MvSysCall* c, uint32_t addr, void* dst, size_t n){
+    return mem_host_read(c->vm, addr, dst, n);
+}
+
+static bool call_write(MvSysCall* c, uint32_t addr, const void* src, size_t n){
+    return mem_host_write(c->vm, addr, src, n);
+}
+
+int systab_host_call(VM* vm, const SysEntry* e, u32 callno){
+    vm->nondet = true;   /* no sabemos de qué depende el host */
+    MvSysCall c;
+    c.reg    = vm->reg;
+    c.callno = callno;
+    c.user   = e->user;
+    c.read   = call_read;
+    c.write  = call_write;
+    c.vm     = vm;
+    return e->host(&c) == 0 ? 0 : -1;
+}
+
+MvSysTable* mv_systab_create(void){
+    MvSysTable* t = (MvSysTable*)calloc(1, sizeof *t);
+    if (!t) return NULL;
+    memcpy(t->e, sys_builtin, sizeof t->e);
+    return t;
+}
+
+void mv_systab_destroy(MvSysTable* t){
+    if (!t) return;
+#ifdef __unix__
+    for (int i = t->nplugins - 1; i >= 0; i--) dlclose(t->plugins[i]);
+#endif
+    free(t);
+}
+
+bool mv_systab_set(MvSysTable* t, uint32_t callno, MvSysFn fn, void* user){
+    if (callno >= SYS_TABLE_SIZE){
+        fprintf(stderr, "Error: SYS %u fuera de la tabla (max %u)\n", (unsigned)callno, SYS_TABLE_SIZE - 1u);
+        return false;
+    }
+    if (!fn){
+        t->e[callno] = sys_builtin[callno];
+        return true;
+    }
+    SysEntry* e = &t->e[callno];
+    e->fn   = NULL;
+    e->host = fn;
+    e->user = user;
+    e->io   = false;
+    return true;
+}
+
+bool mv_systab_load(MvSysTable* t, const char* so_path){
+#ifdef __unix__
+    if (t->nplugins == SYSTAB_PLUGINS_MAX){
+        fprintf(stderr, "Error: demasiados plugins (max %d)\n", SYSTAB_PLUGINS_MAX);
+        return false;
+    }
+    void* h = dlopen(so_path, RTLD_NOW | RTLD_LOCAL);
+    if (!h){
+        fprintf(stderr, "Error: no pude cargar %s: %s\n", so_path, dlerror());
+        return false;
+    }
+    typedef int (*PluginInit)(MvSysTable*, MvSysRegister);
+    PluginInit init;
+    *(void**)&init = dlsym(h, "mv_plugin_init");
+    if (!init){
+        fprintf(stderr, "Error: %s no exporta mv_plugin_init\n", so_path);
+        dlclose(h);
+        return false;
+    }
+    /* si falla a medias, lo que registró apuntaría al .so ya descargado */
+    SysEntry* before = (SysEntry*)malloc(sizeof t->e);
+    if (!before){
+        dlclose(h);
+        return false;
+    }
+    memcpy(before, t->e, sizeof t->e);
+    int rc = init(t, mv_systab_set);
+    if (rc != 0) memcpy(t->e, before, sizeof t->e);
+    free(before);
+    if (rc != 0){
+        fprintf(stderr, "Error: mv_plugin_init de %s fallo\n", so_path);
+        dlclose(h);
+        return false;
+    }
+    t->plugins[t->nplugins++] = h;
+    return true;
+#else
+    (void)t;
+    fprintf(stderr, "Error: plugins de SYS no disponibles en esta plataforma (%s)\n", so_path);
+    return false;
+#endif
+}
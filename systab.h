@@ -0,0 +1,31 @@
+#pragma once
+#include "mv.h"
+#include "vm.h"
+
+/* Tabla de SYS: una entrada por número de llamada, así op_sys despacha con
+   un índice. sys_builtin (cpu.c) tiene las llamadas propias; un MvSysTable
+   (mv.h) empieza como copia y el host o un plugin reemplazan entradas.
+   Cada VM usa vm->systab o, si es NULL, sys_builtin. */
+
+#define SYS_TABLE_SIZE   256
+#define SYSTAB_PLUGINS_MAX 16
+
+typedef int (*SysFn)(VM* vm, u32 callno);
+
+typedef struct {
+    SysFn   fn;        /* llamada propia, o */
+    MvSysFn host;      /* del host (fn == NULL) */
+    void*   user;
+    bool    io;        /* usa vm->io: exclusión entre hilos y cuota de salida */
+} SysEntry;
+
+struct MvSysTable {
+    SysEntry e[SYS_TABLE_SIZE];
+    void*    plugins[SYSTAB_PLUGINS_MAX];   /* handles de dlopen */
+    int      nplugins;
+};
+
+extern const SysEntry sys_builtin[SYS_TABLE_SIZE];
+
+/* llama a una entrada con host != NULL; 0 o -1 */
+int systab_host_call(VM* vm, const SysEntry* e, u32 callno);
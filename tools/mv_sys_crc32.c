@@ -0,0 +1,36 @@
+// mv_sys_crc32: plugin de ejemplo para --sys-plugin (ver mv.h)
+//
+//   gcc -shared -fPIC -I. -o crc32.so tools/mv_sys_crc32.c
+//   mv programa.vmx --sys-plugin=./crc32.so
+//
+// SYS 0x40: EAX <- CRC-32 de los ECX bytes apuntados por EDX
+#include "mv.h"
+
+#define SYS_CRC32 0x40u
+
+static uint32_t crc_table[256];
+
+static int sys_crc32(MvSysCall* c){
+    uint32_t ptr = c->reg[MV_EDX];
+    uint32_t n   = c->reg[MV_ECX];
+    uint32_t crc = 0xFFFFFFFFu;
+    unsigned char buf[256];
+    while (n){
+        uint32_t k = n < sizeof buf ? n : (uint32_t)sizeof buf;
+        if (!c->read(c, ptr, buf, k)) return -1;
+        for (uint32_t i = 0; i < k; i++) crc = crc_table[(crc ^ buf[i]) & 0xFF] ^ (crc >> 8);
+        ptr += k;
+        n   -= k;
+    }
+    c->reg[MV_EAX] = ~crc;
+    return 0;
+}
+
+int mv_plugin_init(MvSysTable* t, MvSysRegister reg){
+    for (uint32_t i = 0; i < 256; i++){
+        uint32_t c = i;
+        for (int b = 0; b < 8; b++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc_table[i] = c;
+    }
+    return reg(t, SYS_CRC32, sys_crc32, NULL) ? 0 : -1;
+}
@@ -0,0 +1,163 @@
+// mv-trace: lector de trazas binarias generadas con mv --trace-bin=ARCH
+//
+//   gcc -I. -pthread -o mv-trace tools/mv_trace.c decoder.c disasm.c memory.c memprof.c tracebin.c
+#include "decoder.h"
+#include "disasm.h"
+#include "tracebin.h"
+#include "vm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static bool read_u16(FILE* f, u16* out){
+    u8 b[2];
+    if (fread(b, 1, 2, f) != 2) return false;
+    *out = (u16)(((u16)b[0] << 8) | b[1]);
+    return true;
+}
+
+static bool read_u32(FILE* f, u32* out){
+    u8 b[4];
+    if (fread(b, 1, 4, f) != 4) return false;
+    *out = ((u32)b[0] << 24) | ((u32)b[1] << 16) | ((u32)b[2] << 8) | (u32)b[3];
+    return true;
+}
+
+static bool read_varint(FILE* f, u32* out){
+    u32 v = 0;
+    for (int shift = 0; shift < 35; shift += 7){
+        int c = getc(f);
+        if (c == EOF) return false;
+        v |= (u32)(c & 0x7F) << shift;
+        if (!(c & 0x80)){
+            *out = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char** argv){
+    if (argc < 2){
+        fprintf(stderr, "Uso:\n"
+                        "  %s traza.bin [--range=LO:HI] [--from=N] [--count=N] [--no-regs] [--no-mem] [--summary]\n",
+                argv[0]);
+        return 1;
+    }
+
+    const char* path = NULL;
+    u32 lo = 0, hi = 0xFFFFu;
+    unsigned long long from = 0, count = ~0ull;
+    bool show_regs = true, show_mem = true, summary = false;
+
+    for (int i = 1; i < argc; i++){
+        const char* a = argv[i];
+        if (strncmp(a, "--range=", 8) == 0){
+            char* end = NULL;
+            lo = (u32)strtoul(a + 8, &end, 16);
+            if (!end || *end != ':'){ fprintf(stderr, "--range espera LO:HI en hexadecimal\n"); return 1; }
+            hi = (u32)strtoul(end + 1, NULL, 16);
+        } else if (strncmp(a, "--from=", 7) == 0){
+            from = strtoull(a + 7, NULL, 10);
+        } else if (strncmp(a, "--count=", 8) == 0){
+            count = strtoull(a + 8, NULL, 10);
+        } else if (strcmp(a, "--no-regs") == 0){
+            show_regs = false;
+        } else if (strcmp(a, "--no-mem") == 0){
+            show_mem = false;
+        } else if (strcmp(a, "--summary") == 0){
+            summary = true;
+        } else {
+            path = a;
+        }
+    }
+
+    FILE* f = path ? fopen(path, "rb") : NULL;
+    if (!f){
+        fprintf(stderr, "No pude abrir la traza %s\n", path ? path : "(ninguna)");
+        return 1;
+    }
+
+    static VM vm;
+    memset(&vm, 0, sizeof vm);
+    vm.mem = vm.ram;   /* sin vm.c no hay vm_init */
+    vm.idx_param = vm.idx_const = vm.idx_data = vm.idx_extra = vm.idx_stack = -1;
+
+    u8 magic[7];
+    u16 code_base = 0, code_size = 0;
+    if (fread(magic, 1, 7, f) != 7 || memcmp(magic, "MVTB25", 6) != 0 || magic[6] != TRACEBIN_VERSION ||
+        !read_u16(f, &code_base) || !read_u16(f, &code_size)){
+        fprintf(stderr, "Traza inválida: %s\n", path);
+        fclose(f);
+        return 1;
+    }
+    for (int i = 0; i < REG_COUNT; i++){
+        if (!read_u32(f, &vm.reg[i])){ fprintf(stderr, "Traza truncada\n"); fclose(f); return 1; }
+    }
+    if ((u32)code_base + code_size > sizeof vm.ram ||
+        fread(&vm.ram[code_base], 1, code_size, f) != code_size){
+        fprintf(stderr, "Traza truncada en el código\n");
+        fclose(f);
+        return 1;
+    }
+    vm.seg[0].base = code_base;
+    vm.seg[0].size = code_size;
+    vm.idx_code    = 0;
+    vm.code_size   = (u16)(code_base + code_size);
+
+    unsigned long long n_insn = 0, n_regs = 0, n_mem = 0;
+    u16 phys = 0;
+    bool shown = false;
+    bool ended = false;
+
+    for (;;){
+        int tag = getc(f);
+        if (tag == EOF) break;
+
+        if (tag <= TB_INSN_LONG){
+            u32 z = (u32)tag;
+            if (tag == TB_INSN_LONG && !read_varint(f, &z)) break;
+            int32_t d = (int32_t)(z >> 1) ^ -(int32_t)(z & 1u);
+            phys = (u16)((int32_t)phys + d);
+
+            unsigned long long idx = n_insn++;
+            shown = !summary && idx >= from && idx - from < count && phys >= lo && phys <= hi;
+            if (!shown) continue;
+
+            char text[DISASM_LINE_MAX];
+            DecodedInst di;
+            if (phys >= code_base && decode_at(&vm, 0, (u16)(phys - code_base), &di)){
+                disasm_format(&vm, &di, text, sizeof text);
+            } else {
+                snprintf(text, sizeof text, "[%04X] ??", phys);
+            }
+            printf("%12llu %s\n", idx, text);
+        } else if (tag == TB_REG){
+            int r = getc(f);
+            u32 v;
+            if (r == EOF || !read_varint(f, &v)) break;
+            n_regs++;
+            if (r < REG_COUNT) vm.reg[r] = v;
+            if (shown && show_regs) printf("%12s   %-4s <- %08X\n", "", reg_name((u8)r), (unsigned)v);
+        } else if (tag == TB_MEM){
+            u32 a, v;
+            int n;
+            if (!read_varint(f, &a) || (n = getc(f)) == EOF || !read_varint(f, &v)) break;
+            n_mem++;
+            if (shown && show_mem) printf("%12s   [%04X] <- %0*X (%d)\n", "", (unsigned)a, n * 2, (unsigned)v, n);
+        } else if (tag == TB_END){
+            ended = true;
+            break;
+        } else {
+            fprintf(stderr, "Registro desconocido %02X en la traza\n", tag);
+            break;
+        }
+    }
+    fclose(f);
+
+    if (summary || !ended){
+        printf("instrucciones=%llu escrituras_reg=%llu escrituras_mem=%llu%s\n",
+               n_insn, n_regs, n_mem, ended ? "" : " (traza incompleta)");
+    }
+    return ended ? 0 : 1;
+}
@@ -0,0 +1,179 @@
+#include "trace.h"
+#include "disasm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    u8  raw[8];      /* bytes con los que se renderizó (detecta código modificado) */
+    u8  raw_len;     /* 0 = todavía no renderizada */
+    u16 text_len;
+    u32 text_off;    /* offset dentro de Trace.arena */
+} TraceLine;
+
+struct Trace {
+    FILE* out;
+    int   own_out;
+
+    char* buf;
+    u32   buf_len;
+
+    TraceLine* lines;
+    u32   lines_cap;
+    char* arena;
+    u32   arena_len;
+    u32   arena_cap;
+
+    u16   range_lo;
+    u16   range_hi;
+    u32   every;
+    u32   countdown;
+
+    int      have_entry;
+    uint16_t entry_phys;
+};
+
+Trace* trace_open(const char* path){
+    Trace* t = (Trace*)calloc(1, sizeof *t);
+    if (!t) return NULL;
+
+    if (path){
+        t->out = fopen(path, "w");
+        if (!t->out){
+            fprintf(stderr, "Error: no pude abrir el archivo de traza %s\n", path);
+            free(t);
+            return NULL;
+        }
+        t->own_out = 1;
+    } else {
+        t->out = stdout;
+    }
+
+    t->buf = (char*)malloc(TRACE_BUF_BYTES);
+    if (!t->buf){
+        if (t->own_out) fclose(t->out);
+        free(t);
+        return NULL;
+    }
+
+    t->range_lo  = 0;
+    t->range_hi  = 0xFFFFu;
+    t->every     = 1;
+    t->countdown = 1;
+    return t;
+}
+
+void trace_flush(Trace* t){
+    if (!t) return;
+    if (t->buf_len){
+        fwrite(t->buf, 1, t->buf_len, t->out);
+        t->buf_len = 0;
+    }
+    fflush(t->out);
+}
+
+void trace_close(Trace* t){
+    if (!t) return;
+    trace_flush(t);
+    if (t->own_out) fclose(t->out);
+    free(t->buf);
+    free(t->lines);
+    free(t->arena);
+    free(t);
+}
+
+void trace_set_range(Trace* t, u16 lo, u16 hi){
+    t->range_lo = lo;
+    t->range_hi = hi;
+}
+
+void trace_set_every(Trace* t, u32 every){
+    t->every     = every ? every : 1;
+    t->countdown = t->every;
+}
+
+void trace_header(Trace* t, VM* vm){
+    trace_flush(t);
+    disasm_dump_segments(vm, t->out);
+    disasm_dump_const_strings(vm, t->out);
+    fflush(t->out);
+}
+
+static void trace_put(Trace* t, const char* p, u32 n){
+    if (t->buf_len + n > TRACE_BUF_BYTES){
+        fwrite(t->buf, 1, t->buf_len, t->out);
+        t->buf_len = 0;
+    }
+    memcpy(t->buf + t->buf_len, p, n);
+    t->buf_len += n;
+}
+
+static TraceLine* cached_line(Trace* t, VM* vm, const DecodedInst* di){
+    if (!t->lines){
+        t->lines_cap = vm->code_size;
+        t->lines = (TraceLine*)calloc(t->lines_cap ? t->lines_cap : 1u, sizeof *t->lines);
+        if (!t->lines) return NULL;
+    }
+    if (di->phys >= t->lines_cap) return NULL;
+
+    TraceLine* l = &t->lines[di->phys];
+    u16 n = di->size;
+    if (n > sizeof l->raw) n = sizeof l->raw;
+
+    if (l->raw_len == n && memcmp(l->raw, &vm->ram[di->phys], n) == 0){
+        return l;
+    }
+
+    char text[DISASM_LINE_MAX];
+    int len = disasm_format(vm, di, text, sizeof text);
+    if (len < 0) return NULL;
+    if (len >= (int)sizeof text) len = (int)sizeof text - 1;
+
+    if (t->arena_len + (u32)len > t->arena_cap){
+        u32 cap = t->arena_cap ? t->arena_cap * 2u : 4096u;
+        while (cap < t->arena_len + (u32)len) cap *= 2u;
+        char* a = (char*)realloc(t->arena, cap);
+        if (!a) return NULL;
+        t->arena = a;
+        t->arena_cap = cap;
+    }
+    memcpy(t->arena + t->arena_len, text, (size_t)len);
+
+    memcpy(l->raw, &vm->ram[di->phys], n);
+    l->raw_len  = (u8)n;
+    l->text_len = (u16)len;
+    l->text_off = t->arena_len;
+    t->arena_len += (u32)len;
+    return l;
+}
+
+void trace_insn(Trace* t, VM* vm, const DecodedInst* di){
+    if (!t->have_entry){ t->entry_phys = di->phys; t->have_entry = 1; }
+
+    /* SYS puede escribir en stdout: vaciar antes para no desordenar la salida,
+       también si este SYS no se traza */
+    bool sys = di->opcode == 0x00 && t->out == stdout;
+    if (di->phys < t->range_lo || di->phys > t->range_hi || --t->countdown != 0){
+        if (sys) trace_flush(t);
+        return;
+    }
+    t->countdown = t->every;
+
+    char mark = (di->phys == t->entry_phys) ? '>' : ' ';
+    trace_put(t, &mark, 1);
+
+    TraceLine* l = cached_line(t, vm, di);
+    if (l){
+        trace_put(t, t->arena + l->text_off, l->text_len);
+    } else {
+        char text[DISASM_LINE_MAX];
+        int len = disasm_format(vm, di, text, sizeof text);
+        if (len >= (int)sizeof text) len = (int)sizeof text - 1;
+        if (len > 0) trace_put(t, text, (u32)len);
+    }
+    trace_put(t, "\n", 1);
+
+    if (sys){
+        trace_flush(t);
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "vm.h"
+#include "decoder.h"
+#include <stdio.h>
+
+#define TRACE_BUF_BYTES (1u << 20)
+
+typedef struct Trace Trace;
+
+/* path == NULL -> stdout */
+Trace* trace_open(const char* path);
+void   trace_close(Trace* t);
+
+/* filtros: rango de direcciones físicas [lo, hi] y 1 de cada N instrucciones */
+void   trace_set_range(Trace* t, u16 lo, u16 hi);
+void   trace_set_every(Trace* t, u32 every);
+
+void   trace_header(Trace* t, VM* vm);
+void   trace_insn(Trace* t, VM* vm, const DecodedInst* di);
+void   trace_flush(Trace* t);
@@ -0,0 +1,135 @@
+#include "tracebin.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static inline bool reg_is_traced(int r){
+    return r == SP || r == BP || r >= EAX;
+}
+
+static void* writer_main(void* arg){
+    TraceBin* tb = (TraceBin*)arg;
+    const struct timespec nap = {0, 200000};
+
+    for (;;){
+        uint64_t head = atomic_load_explicit(&tb->head, memory_order_acquire);
+        uint64_t tail = atomic_load_explicit(&tb->tail, memory_order_relaxed);
+
+        if (head == tail){
+            if (atomic_load_explicit(&tb->done, memory_order_acquire)){
+                head = atomic_load_explicit(&tb->head, memory_order_acquire);
+                if (head == tail) break;
+                continue;
+            }
+            nanosleep(&nap, NULL);
+            continue;
+        }
+
+        u32 pos = (u32)(tail & (TRACEBIN_RING_BYTES - 1u));
+        uint64_t n = head - tail;
+        if (n > TRACEBIN_RING_BYTES - pos) n = TRACEBIN_RING_BYTES - pos;
+        fwrite(tb->ring + pos, 1, (size_t)n, tb->out);
+        atomic_store_explicit(&tb->tail, tail + n, memory_order_release);
+    }
+    return NULL;
+}
+
+static void be16w(FILE* f, u16 v){
+    u8 b[2] = { (u8)(v>>8), (u8)v };
+    fwrite(b, 1, 2, f);
+}
+
+static void be32w(FILE* f, u32 v){
+    u8 b[4] = { (u8)(v>>24), (u8)(v>>16), (u8)(v>>8), (u8)v };
+    fwrite(b, 1, 4, f);
+}
+
+TraceBin* tracebin_open(VM* vm, const char* path){
+    TraceBin* tb = (TraceBin*)calloc(1, sizeof *tb);
+    if (!tb) return NULL;
+
+    tb->ring = (u8*)malloc(TRACEBIN_RING_BYTES);
+    tb->out  = fopen(path, "wb");
+    if (!tb->ring || !tb->out){
+        fprintf(stderr, "Error: no pude abrir la traza binaria %s\n", path);
+        if (tb->out) fclose(tb->out);
+        free(tb->ring);
+        free(tb);
+        return NULL;
+    }
+
+    u16 code_base = 0, code_size = 0;
+    if (vm->idx_code >= 0){
+        code_base = vm->seg[vm->idx_code].base;
+        code_size = vm->seg[vm->idx_code].size;
+    }
+    fwrite("MVTB25", 1, 6, tb->out);
+    fputc(TRACEBIN_VERSION, tb->out);
+    be16w(tb->out, code_base);
+    be16w(tb->out, code_size);
+    for (int i = 0; i < REG_COUNT; i++) be32w(tb->out, vm->reg[i]);
+    fwrite(&vm->ram[code_base], 1, code_size, tb->out);
+
+    memcpy(tb->shadow, vm->reg, sizeof tb->shadow);
+    atomic_init(&tb->head, 0);
+    atomic_init(&tb->tail, 0);
+    atomic_init(&tb->done, 0);
+
+    if (pthread_create(&tb->writer, NULL, writer_main, tb) != 0){
+        fprintf(stderr, "Error: no pude crear el hilo de la traza binaria\n");
+        fclose(tb->out);
+        free(tb->ring);
+        free(tb);
+        return NULL;
+    }
+    return tb;
+}
+
+void tracebin_publish(TraceBin* tb){
+    const struct timespec nap = {0, 50000};
+    u32 len = tb->stage_len;
+    if (!len) return;
+
+    uint64_t head = atomic_load_explicit(&tb->head, memory_order_relaxed);
+    while (TRACEBIN_RING_BYTES - (head - atomic_load_explicit(&tb->tail, memory_order_acquire)) < len){
+        tb->stalls++;
+        nanosleep(&nap, NULL);
+    }
+
+    u32 pos   = (u32)(head & (TRACEBIN_RING_BYTES - 1u));
+    u32 first = TRACEBIN_RING_BYTES - pos;
+    if (first > len) first = len;
+    memcpy(tb->ring + pos, tb->stage, first);
+    memcpy(tb->ring, tb->stage + first, len - first);
+    atomic_store_explicit(&tb->head, head + len, memory_order_release);
+    tb->stage_len = 0;
+}
+
+void tracebin_regs(TraceBin* tb, VM* vm){
+    for (int r = SP; r < REG_COUNT; r++){
+        if (vm->reg[r] == tb->shadow[r] || !reg_is_traced(r)) continue;
+        tb->shadow[r] = vm->reg[r];
+        tb_reserve(tb);
+        tb_byte(tb, TB_REG);
+        tb_byte(tb, (u8)r);
+        tb_varint(tb, vm->reg[r]);
+    }
+}
+
+void tracebin_close(TraceBin* tb){
+    if (!tb) return;
+    tb_reserve(tb);
+    tb_byte(tb, TB_END);
+    tracebin_publish(tb);
+
+    atomic_store_explicit(&tb->done, 1, memory_order_release);
+    pthread_join(tb->writer, NULL);
+
+    if (tb->stalls){
+        fprintf(stderr, "traza binaria: el ring se llenó %llu veces\n", (unsigned long long)tb->stalls);
+    }
+    fclose(tb->out);
+    free(tb->ring);
+    free(tb);
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include "vm.h"
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+/*
+ * Traza binaria (--trace-bin=ARCH)
+ *
+ * Encabezado: "MVTB25" | versión (1) | base código (u16 BE) | tamaño código (u16 BE)
+ *             | 32 registros iniciales (u32 BE) | bytes del segmento de código
+ * Registros del flujo:
+ *   0x00..0x7F  instrucción, delta zigzag de la dirección física respecto de la anterior
+ *   0x80 v      instrucción, delta zigzag en varint
+ *   0x81 r v    escritura de registro r (índice de vm->reg) con valor v
+ *   0x82 a n v  escritura en memoria física a de n bytes con valor v
+ *   0x83        fin de la traza
+ * Los enteros v/a son varint LEB128 sin signo.
+ */
+
+#define TRACEBIN_VERSION    1
+#define TRACEBIN_RING_BYTES (4u << 20)
+#define TRACEBIN_STAGE      4096u
+
+enum {
+    TB_INSN_LONG = 0x80,
+    TB_REG       = 0x81,
+    TB_MEM       = 0x82,
+    TB_END       = 0x83
+};
+
+typedef struct TraceBin {
+    FILE*    out;
+    u8*      ring;
+    _Atomic uint64_t head;   /* bytes publicados por el intérprete */
+    _Atomic uint64_t tail;   /* bytes consumidos por el escritor */
+    atomic_int done;
+    pthread_t writer;
+
+    u8       stage[TRACEBIN_STAGE];
+    u32      stage_len;
+
+    u16      last_phys;
+    u32      shadow[REG_COUNT];
+    uint64_t stalls;         /* veces que el ring estaba lleno */
+} TraceBin;
+
+TraceBin* tracebin_open(VM* vm, const char* path);
+void      tracebin_close(TraceBin* tb);
+
+void      tracebin_publish(TraceBin* tb);
+void      tracebin_regs(TraceBin* tb, VM* vm);
+
+static inline void tb_byte(TraceBin* tb, u8 b){
+    tb->stage[tb->stage_len++] = b;
+}
+
+static inline void tb_varint(TraceBin* tb, u32 v){
+    while (v >= 0x80u){
+        tb_byte(tb, (u8)(v | 0x80u));
+        v >>= 7;
+    }
+    tb_byte(tb, (u8)v);
+}
+
+/* peor caso de un registro: 1 + 5 + 1 + 5 */
+static inline void tb_reserve(TraceBin* tb){
+    if (tb->stage_len > TRACEBIN_STAGE - 16u) tracebin_publish(tb);
+}
+
+static inline void tracebin_insn(TraceBin* tb, u16 phys){
+    int32_t d = (int32_t)phys - (int32_t)tb->last_phys;
+    u32 z = ((u32)d << 1) ^ (u32)(d >> 31);
+    tb->last_phys = phys;
+    tb_reserve(tb);
+    if (z < 0x80u){
+        tb_byte(tb, (u8)z);
+    } else {
+        tb_byte(tb, TB_INSN_LONG);
+        tb_varint(tb, z);
+    }
+}
+
+static inline void tracebin_mem(TraceBin* tb, u16 phys, u16 nbytes, u32 value){
+    tb_reserve(tb);
+    tb_byte(tb, TB_MEM);
+    tb_varint(tb, phys);
+    tb_byte(tb, (u8)nbytes);
+    tb_varint(tb, value);
+}
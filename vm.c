@@ -1,9 +1,21 @@
 // vm.c
+#include "callgraph.h"
+#include "costmodel.h"
 #include "cpu.h"
 #include "decoder.h"
 #include "disasm.h"
+#include "gthreads.h"
+#include "hostclock.h"
 #include "memory.h"
+#include "memprof.h"
+#include "probes.h"
+#include "procs.h"
+#include "profile.h"
+#include "regions.h"
+#include "trace.h"
+#include "tracebin.h"
 #include "vm.h"
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -19,9 +31,7 @@ static inline u32 place(u32* cursor, u32 size){
 }
 
 
-static int ensure_ram_capacity(const VM* vm, u32 needed){
-  const u32 limit_bytes = (u32)vm->ram_kib * 1024u;
-
+static int ensure_ram_capacity(u32 limit_bytes, u32 needed){
   if (needed > limit_bytes){
     fprintf(stderr,"Error: memoria insuficiente para montar el proceso.\n");
     return 0;
@@ -87,6 +97,7 @@ static int build_param_segment(VM* vm,char** params,int argc,u32 seg_base,u32 se
 
 void vm_init(VM* vm, bool disassemble) {
   memset(vm, 0, sizeof(*vm));
+  vm->mem = vm->ram;
 
   vm->disassemble   = disassemble;
   vm->ram_kib       = RAM_DEFAULT_KIB;
@@ -111,10 +122,42 @@ void vm_init(VM* vm, bool disassemble) {
   vm->idx_data  = -1;
   vm->idx_extra = -1;
   vm->idx_stack = -1;
+
+  vmio_stdio(&vm->io, stdin, stdout);
+}
+
+void vm_init_job(VM* vm, u32 ram_kib, const char* vmx_path, int argc) {
+  vm_init(vm, false);
+  vm->ram_kib       = ram_kib;
+  vm->opt_vmx_path  = vmx_path;
+  vm->have_vmx      = 1;
+  vm->have_params   = argc > 0;
+  vm->argc_on_stack = argc;
 }
 
+void vm_seed(VM* vm, uint64_t seed) {
+  /* splitmix64: semillas parecidas dan estados bien distintos, nunca 0 */
+  uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  z ^= z >> 31;
+  vm->rng = z ? z : 1u;
+}
 
-bool vm_save_vmi(VM* vm, const char* path) {
+void vm_release(VM* vm) {
+  if (vm->threads && vm->threads->owner == vm) {
+    gthreads_destroy(vm->threads);
+  }
+  regions_destroy(vm->regions);
+  procs_destroy(vm->procs);
+  vm->regions = NULL;
+  vm->procs   = NULL;
+  vm->threads = NULL;
+}
+
+static bool load_vmi_file(VM* vm, const char* path);
+
+static bool save_vmi_file(VM* vm, const char* path) {
   if (!path) return false;
 
   FILE* g = fopen(path, "wb");
@@ -148,65 +191,109 @@ bool vm_save_vmi(VM* vm, const char* path) {
   return true;
 }
 
-bool vm_load(VM* vm, char** params, int argc) {
-
-  if (!vm->have_vmx || !vm->opt_vmx_path) {
-    if (vm->have_vmi && vm->opt_vmi_path) {
-      return vm_load_vmi(vm, vm->opt_vmi_path);
-    } else {
-      fprintf(stderr, "No se especificó archivo .vmx ni .vmi.\n");
-      return false;
-    }
-  }
-
-  FILE* f = fopen(vm->opt_vmx_path, "rb");
-  if (!f) {
-    fprintf(stderr, "Error: No se pudo abrir el archivo %s\n", vm->opt_vmx_path);
-    return false;
-  }
+/* arma img desde los len bytes de un .vmx; path solo es para los mensajes */
+static bool vmx_image_parse(const u8* p, size_t len, const char* path, VmxImage* img) {
+  memset(img, 0, sizeof(*img));
 
-  u8 hdr6[6];
-  if (fread(hdr6, 1, 6, f) != 6 || memcmp(hdr6, "VMX25", 5) != 0) {
-    fprintf(stderr, "Error: Formato de archivo inválido en %s\n", vm->opt_vmx_path);
-    fclose(f);
+  if (len < 6 || memcmp(p, "VMX25", 5) != 0) {
+    fprintf(stderr, "Error: Formato de archivo inválido en %s\n", path);
     return false;
   }
-  const int version = hdr6[5];
+  const int version = p[5];
+  size_t pos = 6;
 
   u16 code_sz = 0, data_sz = 0, extra_sz = 0, stack_sz = 0, const_sz = 0, entry_off = 0;
 
   if (version == 1) {
-    u8 sz2[2];
-    if (fread(sz2, 1, 2, f) != 2) {
-      fclose(f);
+    if (len - pos < 2) {
       fprintf(stderr, "Error: encabezado v1 incompleto\n");
       return false;
     }
-    code_sz = be16p(sz2);
-    const_sz = 0;
-    data_sz  = 0;
-    extra_sz = 0;
-    stack_sz = 0;
-    entry_off = 0;
+    code_sz = be16p(p + pos);
+    pos += 2;
   } else if (version == 2) {
-    u8 rest[12];
-    if (fread(rest, 1, 12, f) != 12) {
-      fclose(f);
+    if (len - pos < 12) {
       fprintf(stderr, "Error: encabezado v2 incompleto\n");
       return false;
     }
+    const u8* rest = p + pos;
     code_sz  = be16p(&rest[0]);
     data_sz  = be16p(&rest[2]);
     extra_sz = be16p(&rest[4]);
     stack_sz = be16p(&rest[6]);
     const_sz = be16p(&rest[8]);
     entry_off = be16p(&rest[10]);
+    pos += 12;
   } else {
-    fclose(f);
     fprintf(stderr, "Error: Versión de VMX no soportada (%d)\n", version);
     return false;
   }
 
+  if (len - pos < code_sz) {
+    fprintf(stderr, "Error: el binario no contiene %u bytes de código\n", code_sz);
+    return false;
+  }
+  if (len - pos - code_sz < const_sz) {
+    fprintf(stderr, "Error: el binario no contiene %u bytes de const\n", const_sz);
+    return false;
+  }
+
+  u8* bytes = (u8*)malloc((size_t)code_sz + const_sz + 1u);
+  if (!bytes) {
+    fprintf(stderr, "Error: memoria insuficiente para leer %s\n", path);
+    return false;
+  }
+  memcpy(bytes, p + pos, (size_t)code_sz + const_sz);
+
+  img->version   = version;
+  img->code_sz   = code_sz;
+  img->data_sz   = data_sz;
+  img->extra_sz  = extra_sz;
+  img->stack_sz  = stack_sz;
+  img->const_sz  = const_sz;
+  img->entry_off = entry_off;
+  img->code      = bytes;
+  img->konst     = bytes + code_sz;
+  return true;
+}
+
+bool vmx_image_read(const char* path, VmxImage* img) {
+  memset(img, 0, sizeof(*img));
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    fprintf(stderr, "Error: No se pudo abrir el archivo %s\n", path);
+    return false;
+  }
+  long n = (fseek(f, 0, SEEK_END) == 0) ? ftell(f) : -1;
+  u8* buf = (n >= 0 && fseek(f, 0, SEEK_SET) == 0) ? (u8*)malloc((size_t)n + 1u) : NULL;
+  if (!buf) {
+    fclose(f);
+    fprintf(stderr, "Error: no pude leer %s\n", path);
+    return false;
+  }
+  size_t got = fread(buf, 1, (size_t)n, f);
+  fclose(f);
+  bool ok = vmx_image_parse(buf, got, path, img);
+  free(buf);
+  return ok;
+}
+
+bool vmx_image_from_buffer(const void* data, size_t len, VmxImage* img) {
+  return vmx_image_parse((const u8*)data, len, "(memoria)", img);
+}
+
+void vmx_image_free(VmxImage* img) {
+  free(img->code);
+  img->code  = NULL;
+  img->konst = NULL;
+}
+
+/* monta los segmentos en ram[base, limit) */
+static bool mount_image(VM* vm, const VmxImage* img, char** params, int argc, u32 base, u32 limit) {
+  const int version = img->version;
+  u16 code_sz  = img->code_sz,  data_sz  = img->data_sz,  extra_sz  = img->extra_sz;
+  u16 stack_sz = img->stack_sz, const_sz = img->const_sz, entry_off = img->entry_off;
+
   u16 param_sz = 0;
   if (vm->have_params && params && argc > 0) {
     u32 need = 0;
@@ -216,15 +303,14 @@ bool vm_load(VM* vm, char** params, int argc) {
     }
     need += (u32)(argc + 1) * 4u;
     if (need > 0xFFFFu) {
-      fclose(f);
       fprintf(stderr, "Demasiados parámetros\n");
       return false;
     }
     param_sz = (u16)need;
   }
 
-  const u32 ram_limit = (u32)vm->ram_kib * 1024u;
-  u32 cursor = 0;
+  const u32 ram_limit = limit;
+  u32 cursor = base;
 
   if (version == 1) {
     const_sz = 0;
@@ -236,17 +322,17 @@ bool vm_load(VM* vm, char** params, int argc) {
 
   u32 param_base = 0;
   if (param_sz) {
-    if (!ensure_ram_capacity(vm, cursor + param_sz)) { fclose(f); return false; }
+    if (!ensure_ram_capacity(ram_limit, cursor + param_sz)) { return false; }
     param_base = place(&cursor, (u32)param_sz);
   }
 
   u32 const_base = 0;
   if (const_sz) {
-    if (!ensure_ram_capacity(vm, cursor + const_sz)) { fclose(f); return false; }
+    if (!ensure_ram_capacity(ram_limit, cursor + const_sz)) { return false; }
     const_base = place(&cursor, (u32)const_sz);
   }
 
-  if (!ensure_ram_capacity(vm, cursor + code_sz)) { fclose(f); return false; }
+  if (!ensure_ram_capacity(ram_limit, cursor + code_sz)) { return false; }
   u32 code_base = place(&cursor, (u32)code_sz);
 
   u32 data_base = 0;
@@ -258,47 +344,37 @@ bool vm_load(VM* vm, char** params, int argc) {
     data_sz = (u16)remaining;
 
     if (data_sz) {
-      if (!ensure_ram_capacity(vm, cursor + data_sz)) { fclose(f); return false; }
+      if (!ensure_ram_capacity(ram_limit, cursor + data_sz)) { return false; }
       data_base = place(&cursor, (u32)data_sz);
     }
     extra_sz = 0;
     extra_base = 0;
   } else {
     if (data_sz) {
-      if (!ensure_ram_capacity(vm, cursor + data_sz)) { fclose(f); return false; }
+      if (!ensure_ram_capacity(ram_limit, cursor + data_sz)) { return false; }
       data_base = place(&cursor, (u32)data_sz);
     }
     if (extra_sz) {
-      if (!ensure_ram_capacity(vm, cursor + extra_sz)) { fclose(f); return false; }
+      if (!ensure_ram_capacity(ram_limit, cursor + extra_sz)) { return false; }
       extra_base = place(&cursor, (u32)extra_sz);
     }
   }
 
   u32 stack_base = 0;
   if (stack_sz) {
-    if (!ensure_ram_capacity(vm, cursor + stack_sz)) { fclose(f); return false; }
+    if (!ensure_ram_capacity(ram_limit, cursor + stack_sz)) { return false; }
     stack_base = place(&cursor, (u32)stack_sz);
   }
 
   if (cursor > ram_limit) {
-    fclose(f);
     fprintf(stderr, "Error: memoria insuficiente para montar el proceso.\n");
     return false;
   }
 
-  if (fread(&vm->ram[code_base], 1, code_sz, f) != code_sz) {
-    fclose(f);
-    fprintf(stderr, "Error: el binario no contiene %u bytes de código\n", code_sz);
-    return false;
-  }
+  memcpy(&vm->ram[code_base], img->code, code_sz);
   if (const_sz) {
-    if (fread(&vm->ram[const_base], 1, const_sz, f) != const_sz) {
-      fclose(f);
-      fprintf(stderr, "Error: el binario no contiene %u bytes de const\n", const_sz);
-      return false;
-    }
+    memcpy(&vm->ram[const_base], img->konst, const_sz);
   }
-  fclose(f);
 
   u16 used_param = 0;
   u16 argv_off   = 0;
@@ -409,6 +485,7 @@ bool vm_load(VM* vm, char** params, int argc) {
 
     vm->reg[SP] = ((u32)seg_idx << 16) | (u32)sp;
     vm->reg[BP] = vm->reg[SP];
+    vm->stats.stack_peak = (u32)vm->seg[seg_idx].size - sp;
   }
 
   vm->reg[OPC] = 0;
@@ -425,7 +502,28 @@ bool vm_load(VM* vm, char** params, int argc) {
   return true;
 }
 
-bool vm_load_vmi(VM* vm, const char* path) {
+static bool load_vmx_file(VM* vm, char** params, int argc) {
+
+  if (!vm->have_vmx || !vm->opt_vmx_path) {
+    if (vm->have_vmi && vm->opt_vmi_path) {
+      MV_PROBE1(vmi__load__start, vm->opt_vmi_path);
+      bool ok = load_vmi_file(vm, vm->opt_vmi_path);
+      MV_PROBE2(vmi__load__end, vm->opt_vmi_path, (int)ok);
+      return ok;
+    } else {
+      fprintf(stderr, "No se especificó archivo .vmx ni .vmi.\n");
+      return false;
+    }
+  }
+
+  VmxImage img;
+  if (!vmx_image_read(vm->opt_vmx_path, &img)) return false;
+  bool ok = mount_image(vm, &img, params, argc, 0, (u32)vm->ram_kib * 1024u);
+  vmx_image_free(&img);
+  return ok;
+}
+
+static bool load_vmi_file(VM* vm, const char* path) {
   FILE* f = fopen(path, "rb");
   if (!f) {
     fprintf(stderr, "VMI: no pude abrir %s\n", path);
@@ -512,53 +610,390 @@ bool vm_load_vmi(VM* vm, const char* path) {
 }
 
 
-int vm_run(VM* vm) {
-  OpHandler table[256];
-  init_dispatch_table(table);
+bool vm_save_vmi(VM* vm, const char* path) {
+  MV_PROBE1(vmi__save__start, path);
+  uint64_t t0 = host_now_ns();
+  bool ok = save_vmi_file(vm, path);
+  vm->stats.snapshot_ns += host_now_ns() - t0;
+  vm->stats.snapshots++;
+  MV_PROBE2(vmi__save__end, path, (int)ok);
+  return ok;
+}
 
-  if (vm->disassemble) {
-    disasm_dump_segments(vm);
-    disasm_dump_const_strings(vm);
-  }
+bool vm_load(VM* vm, char** params, int argc) {
+  const char* path = vm->opt_vmx_path ? vm->opt_vmx_path : vm->opt_vmi_path;
+  (void)path;
+  MV_PROBE1(load__start, path);
+  uint64_t t0 = host_now_ns();
+  bool ok = load_vmx_file(vm, params, argc);
+  vm->stats.load_ns += host_now_ns() - t0;
+  MV_PROBE2(load__end, path, (int)ok);
+  return ok;
+}
+
+bool vm_load_image(VM* vm, const VmxImage* img, char** params, int argc) {
+  uint64_t t0 = host_now_ns();
+  bool ok = mount_image(vm, img, params, argc, 0, (u32)vm->ram_kib * 1024u);
+  vm->stats.load_ns += host_now_ns() - t0;
+  return ok;
+}
+
+bool vm_load_image_at(VM* vm, const VmxImage* img, char** params, int argc, u32 base, u32 limit) {
+  uint64_t t0 = host_now_ns();
+  bool ok = mount_image(vm, img, params, argc, base, limit);
+  vm->stats.load_ns += host_now_ns() - t0;
+  return ok;
+}
+
+bool vm_load_vmi(VM* vm, const char* path) {
+  MV_PROBE1(vmi__load__start, path);
+  uint64_t t0 = host_now_ns();
+  bool ok = load_vmi_file(vm, path);
+  vm->stats.load_ns += host_now_ns() - t0;
+  MV_PROBE2(vmi__load__end, path, (int)ok);
+  return ok;
+}
 
+static VmExit run_loop(VM* vm, OpHandler table[256], uint64_t budget) {
   for (;;) {
     if (vm->reg[IP] == 0xFFFFFFFFu) {
-      return 0;
+      return VM_HALTED;
     }
 
     u16 seg = (u16)(vm->reg[IP] >> 16);
     u16 off = (u16)(vm->reg[IP] & 0xFFFFu);
 
     if (off == vm->seg[seg].size) {
-      return 0;
+      return VM_HALTED;
     }
 
     if (off > vm->seg[seg].size) {
+      MV_PROBE1(seg__fault, vm->reg[IP]);
       fprintf(stderr, "Error: fallo de segmento\n");
-      return 1;
+      return VM_FAULT;
     }
 
+    if (budget == 0) {
+      return VM_PREEMPTED;
+    }
+    budget--;
+
     u16 phys;
     if (!translate_and_check(vm, seg, off, 1, &phys)) {
+      MV_PROBE2(insn__invalid, vm->reg[IP], 0xFFu);
       fprintf(stderr, "Error: instruccion invalida\n");
-      return 1;
+      return VM_FAULT;
     }
 
     DecodedInst di;
+    vm->insn_ip = vm->reg[IP];
     if (!fetch_and_decode(vm, &di)) {
       u32 opc = 0xFF;
       (void)mem_read_u8(vm, seg, off, &opc);
+      MV_PROBE2(insn__invalid, vm->insn_ip, opc);
       fprintf(stderr, "Error: instruccion invalida OPC=%02X\n", (unsigned)opc);
-      return 1;
+      return VM_FAULT;
+    }
+
+    MV_PROBE_INSN(di.phys, di.opcode);
+
+    vm->stats.insns++;
+
+    if (vm->trace) {
+      trace_insn(vm->trace, vm, &di);
     }
 
-    if (vm->disassemble) {
-      disasm_print(vm, &di);
+    if (vm->cost) {
+      cost_insn(vm->cost, &di);
+    }
+    if (vm->callgraph) {
+      callgraph_tick(vm->callgraph);
+    }
+    if (vm->memprof) {
+      memprof_insn(vm->memprof, di.phys);
+    }
+    if (vm->tracebin) {
+      tracebin_insn(vm->tracebin, di.phys);
     }
 
-    int rc = exec_instruction(vm, &di, table);
+    int rc;
+    if (vm->profile) {
+      uint64_t t0 = host_now_ns();
+      rc = exec_instruction(vm, &di, table);
+      profile_record(vm->profile, di.phys, di.opcode, host_now_ns() - t0);
+    } else {
+      rc = exec_instruction(vm, &di, table);
+    }
+    if (vm->tracebin) {
+      tracebin_regs(vm->tracebin, vm);
+    }
     if (rc < 0) {
-      return 1;
+      if (rc == OP_BLOCKED) return VM_BLOCKED;
+      if (rc == OP_LIMIT) return VM_LIMIT;
+      return rc == OP_SWITCH ? VM_SWITCH : VM_FAULT;
+    }
+  }
+}
+
+/* con procesos invitados, run_loop corre de a un quantum y procs_switch
+   elige el siguiente */
+static VmExit run_guest(VM* vm, OpHandler table[256], uint64_t budget) {
+  if (vm->procs) {
+    procs_resume(vm);
+  }
+  for (;;) {
+    uint64_t q = budget;
+    if (vm->procs && q > vm->procs->quantum) {
+      q = vm->procs->quantum;
+    }
+
+    uint64_t before = vm->stats.insns;
+    VmExit r = run_loop(vm, table, q);
+    if (!vm->procs || r == VM_LIMIT) {
+      return r;   /* la cuota es de toda la VM, no del proceso */
+    }
+
+    uint64_t ran = vm->stats.insns - before;
+    budget = (ran < budget) ? budget - ran : 0;
+
+    r = procs_switch(vm, r);
+    if (r != VM_PREEMPTED) {
+      return r;
+    }
+    if (budget == 0) {
+      return VM_PREEMPTED;
     }
   }
 }
+
+static bool limits_active(const VM* vm) {
+  return vm->limits.insns || vm->limits.wall_ns || vm->limits.out_bytes;
+}
+
+/* las cuotas cuentan desde la primera llamada a vm_run/vm_run_for */
+static void limits_arm(VM* vm) {
+  VmLimits* l = &vm->limits;
+  if (l->armed) return;
+  l->armed    = true;
+  l->start_ns = host_now_ns();
+  l->insns0   = vm->stats.insns;
+  l->out0     = vm->io.written;
+  l->hit      = VM_LIMIT_NONE;
+}
+
+/* run_guest de a tramos de VM_LIMIT_CHECK instrucciones; entre tramos se
+   miran las cuotas, así el ciclo de ejecución no cambia */
+static VmExit run_limited(VM* vm, OpHandler table[256], uint64_t budget) {
+  if (!limits_active(vm)) {
+    return run_guest(vm, table, budget);
+  }
+  VmLimits* l = &vm->limits;
+  limits_arm(vm);
+  for (;;) {
+    if (vm->threads && atomic_load(&vm->threads->hit) != VM_LIMIT_NONE) {
+      l->hit = atomic_load(&vm->threads->hit);
+      return VM_LIMIT;
+    }
+    uint64_t used = vm->threads ? gthreads_charge_insns(vm) : vm->stats.insns - l->insns0;
+    if (l->insns && used >= l->insns) {
+      l->hit = VM_LIMIT_INSNS;
+      return VM_LIMIT;
+    }
+    if (l->wall_ns && host_now_ns() - l->start_ns >= l->wall_ns) {
+      l->hit = VM_LIMIT_WALL;
+      vm->nondet = true;   /* dónde se corta depende del host */
+      return VM_LIMIT;
+    }
+    if (budget == 0) {
+      return VM_PREEMPTED;
+    }
+
+    uint64_t q = budget < VM_LIMIT_CHECK ? budget : VM_LIMIT_CHECK;
+    if (l->insns && q > l->insns - used) {
+      q = l->insns - used;
+    }
+    uint64_t before = vm->stats.insns;
+    VmExit r = run_guest(vm, table, q);
+    if (r == VM_HALTED && vm->threads && atomic_load(&vm->threads->hit) != VM_LIMIT_NONE) {
+      continue;   /* un hilo agotó la cuota común antes del HLT */
+    }
+    if (r != VM_PREEMPTED) {
+      return r;
+    }
+    uint64_t ran = vm->stats.insns - before;
+    budget = (ran < budget) ? budget - ran : 0;
+  }
+}
+
+static const char* limit_name(int hit) {
+  switch (hit) {
+  case VM_LIMIT_INSNS:  return "instrucciones";
+  case VM_LIMIT_WALL:   return "tiempo";
+  case VM_LIMIT_OUTPUT: return "salida";
+  }
+  return "?";
+}
+
+/* informa el corte y deja el estado en un .vmi para mirarlo con el depurador */
+static void limit_stop(VM* vm) {
+  const VmLimits* l = &vm->limits;
+  vmio_flush(&vm->io);
+  fprintf(stderr, "Error: cuota de %s agotada (%llu instrucciones, %.3f s, %llu bytes de salida) en IP=%08X\n",
+          limit_name(l->hit),
+          (unsigned long long)(vm->stats.insns - l->insns0),
+          (double)(host_now_ns() - l->start_ns) / 1e9,
+          (unsigned long long)(vm->io.written - l->out0),
+          (unsigned)vm->reg[IP]);
+  if (l->dump_path && !vm_save_vmi(vm, l->dump_path)) {
+    fprintf(stderr, "Error: no pude escribir %s\n", l->dump_path);
+  }
+}
+
+uint64_t vm_wall_left(const VM* vm) {
+  const VmLimits* l = &vm->limits;
+  if (!l->wall_ns || !l->armed) return UINT64_MAX;
+  uint64_t used = host_now_ns() - l->start_ns;
+  return used >= l->wall_ns ? 0 : l->wall_ns - used;
+}
+
+bool vm_sleep_limited(VM* vm, uint64_t ns) {
+  uint64_t left = vm_wall_left(vm);
+  if (ns < left) {
+    host_sleep_ns(ns);
+    return true;
+  }
+  host_sleep_ns(left);
+  vm->limits.hit = VM_LIMIT_WALL;
+  vm->nondet = true;
+  return false;
+}
+
+int vm_exit_rc(VmExit r) {
+  if (r == VM_HALTED) return 0;
+  return r == VM_LIMIT ? VM_RC_LIMIT : 1;
+}
+
+/* cuando termina el hilo principal terminan también los hilos invitados */
+static void end_threads(VM* vm, VmExit r) {
+  if (r == VM_PREEMPTED || r == VM_BLOCKED) return;
+  if (vm->threads && vm->threads->owner == vm) {
+    gthreads_stop(vm->threads);
+  }
+}
+
+/* la tabla no depende de la VM: se arma una vez para todas */
+static OpHandler dispatch[256];
+static pthread_once_t dispatch_once = PTHREAD_ONCE_INIT;
+
+static void dispatch_init(void) {
+  init_dispatch_table(dispatch);
+}
+
+static OpHandler* dispatch_table(void) {
+  pthread_once(&dispatch_once, dispatch_init);
+  return dispatch;
+}
+
+int vm_run(VM* vm) {
+  OpHandler* table = dispatch_table();
+
+  Trace* own_trace = NULL;
+  if (vm->disassemble) {
+    if (!vm->trace) {
+      own_trace = trace_open(NULL);
+      if (!own_trace) return 1;
+      vm->trace = own_trace;
+    }
+    trace_header(vm->trace, vm);
+  }
+
+  uint64_t t0 = host_now_ns();
+  VmExit r = run_limited(vm, table, UINT64_MAX);
+  vm->stats.run_ns += host_now_ns() - t0;
+  end_threads(vm, r);
+  if (r == VM_LIMIT) {
+    limit_stop(vm);
+  }
+  int rc = vm_exit_rc(r);
+
+  if (vm->trace) {
+    trace_flush(vm->trace);
+  }
+  if (own_trace) {
+    trace_close(own_trace);
+    vm->trace = NULL;
+  }
+  return rc;
+}
+
+VmExit vm_run_for(VM* vm, uint64_t max_insns) {
+  OpHandler* table = dispatch_table();
+
+  uint64_t t0 = host_now_ns();
+  VmExit r = run_limited(vm, table, max_insns);
+  vm->stats.run_ns += host_now_ns() - t0;
+  end_threads(vm, r);
+  if (r == VM_LIMIT && !(vm->threads && vm->threads->owner != vm)) {
+    limit_stop(vm);   /* de un hilo invitado informa la dueña */
+  }
+  return r;
+}
+
+VmExit vm_call(VM* vm, u16 entry, const u32* args, int nargs, uint64_t max_insns, u32* result) {
+  if (vm->procs) {
+    fprintf(stderr, "Error: no se puede llamar una subrutina con procesos invitados\n");
+    return VM_FAULT;
+  }
+  u16 cs = (u16)(vm->reg[CS] >> 16);
+  u16 ss = (u16)(vm->reg[SS] >> 16);
+  if (cs >= SEG_COUNT || entry >= vm->seg[cs].size) {
+    fprintf(stderr, "Error: subrutina fuera del codigo (%04X)\n", (unsigned)entry);
+    return VM_FAULT;
+  }
+  if (nargs < 0 || vm->reg[SS] == 0xFFFFFFFFu || ss >= SEG_COUNT ||
+      (vm->reg[SP] & 0xFFFFu) < 4u * (u32)(nargs + 1)) {
+    fprintf(stderr, "Error: stack overflow\n");
+    return VM_FAULT;
+  }
+
+  /* fin del código: run_loop termina ahí sin ejecutar nada */
+  u32 sentinel = (vm->reg[CS] & 0xFFFF0000u) | vm->seg[cs].size;
+  u16 sp = (u16)(vm->reg[SP] & 0xFFFFu);
+  for (int i = nargs - 1; i >= -1; i--) {
+    sp -= 4;
+    if (!mem_write_u32(vm, ss, sp, i < 0 ? sentinel : args[i])) {
+      fprintf(stderr, "Error: stack overflow\n");
+      return VM_FAULT;
+    }
+  }
+
+  /* un SYS 1/3 que quede a medias es de esta llamada, no del invitado */
+  u32  saved[REG_COUNT];
+  u16  sys_resume  = vm->sys_resume;
+  bool sys_waiting = vm->sys_waiting;
+  memcpy(saved, vm->reg, sizeof saved);
+  vm->sys_resume  = 0;
+  vm->sys_waiting = false;
+  u32 sp_back = (vm->reg[SS] & 0xFFFF0000u) | (u16)(sp + 4);
+  vm->reg[SP] = (vm->reg[SS] & 0xFFFF0000u) | sp;
+  vm->reg[IP] = (vm->reg[CS] & 0xFFFF0000u) | entry;
+
+  uint64_t t0 = host_now_ns();
+  VmExit r = run_limited(vm, dispatch_table(), max_insns ? max_insns : UINT64_MAX);
+  vm->stats.run_ns += host_now_ns() - t0;
+
+  if (r == VM_HALTED && (vm->reg[IP] != sentinel || vm->reg[SP] != sp_back)) {
+    fprintf(stderr, "Error: la subrutina termino sin volver (IP=%08X)\n", (unsigned)vm->reg[IP]);
+    r = VM_FAULT;
+  }
+  if (r == VM_HALTED && result) {
+    *result = vm->reg[EAX];
+  }
+  if (r == VM_LIMIT) {
+    limit_stop(vm);
+  }
+  memcpy(vm->reg, saved, sizeof saved);
+  vm->sys_resume  = sys_resume;
+  vm->sys_waiting = sys_waiting;
+  return r;
+}
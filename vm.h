@@ -1,6 +1,8 @@
 #pragma once
 #include <stdint.h>
 #include <stdbool.h>
+#include "stats.h"
+#include "vmio.h"
 
 typedef uint8_t  u8;
 typedef uint16_t u16;
@@ -10,6 +12,11 @@ typedef uint32_t u32;
 #define REG_COUNT 32
 #define SEG_COUNT 8
 
+/* páginas de ram para vm->dirty (snapshot.h) */
+#define VM_PAGE_SHIFT 8
+#define VM_PAGE_BYTES (1u << VM_PAGE_SHIFT)
+#define VM_PAGES      ((RAM_DEFAULT_KIB * 1024) >> VM_PAGE_SHIFT)
+
 typedef struct {
     u16 base;   
     u16 size;   
@@ -35,14 +42,57 @@ enum {
     R22_RES = 22, R23_RES = 23, R24_RES = 24, R25_RES = 25,
     CS = 26, DS = 27, ES = 28, SS = 29, KS = 30, PS = 31
 };
+/* cuotas por corrida (0 = sin límite). Las instrucciones se cortan justas
+   con el presupuesto de run_guest; el reloj se mira cada VM_LIMIT_CHECK
+   instrucciones y la salida después de cada SYS de E/S. Una lectura o un
+   SYS_SLEEP que bloquea no se interrumpe. */
+#define VM_LIMIT_CHECK 65536u
+#define VM_RC_LIMIT    3         /* código de salida al cortar por cuota */
+
+enum { VM_LIMIT_NONE = 0, VM_LIMIT_INSNS, VM_LIMIT_WALL, VM_LIMIT_OUTPUT };
+
 typedef struct {
+    uint64_t    insns;
+    uint64_t    wall_ns;
+    uint64_t    out_bytes;
+    const char* dump_path;    /* VMI con el estado al cortar; NULL = sin volcado */
+
+    bool        armed;        /* lo que sigue se toma al empezar la corrida */
+    uint64_t    start_ns;
+    uint64_t    insns0;
+    uint64_t    out0;
+    int         hit;          /* VM_LIMIT_* */
+
+    /* con hilos invitados la cuota es de todos juntos (gthreads.h):
+       hasta dónde esta VM ya sumó sus contadores a los compartidos */
+    uint64_t    insns_charged;
+    uint64_t    out_charged;
+} VmLimits;
+
+/* la misma estructura es el MvVm de mv.h */
+typedef struct MvVm {
     u8  ram[RAM_DEFAULT_KIB * 1024]; 
+    u8* mem;                  /* ram en uso: la propia o la de la VM dueña (hilos invitados) */
+    uint64_t dirty;           /* páginas de ram escritas desde la última foto (bit i = página i) */
     SegmentDescriptor seg[SEG_COUNT];
     u32 reg[REG_COUNT];
+    u32 insn_ip;              /* IP de la instrucción en ejecución (IP ya apunta a la siguiente) */
 
     bool disassemble;         
     u32  ram_kib;             
 
+    struct Trace*   trace;
+    struct Profile* profile;
+    struct CallGraph* callgraph;
+    struct MemProf*   memprof;
+    struct TraceBin*  tracebin;
+    struct CostModel* cost;
+    struct Regions*   regions;
+    struct Procs*     procs;      /* NULL hasta el primer SYS_SPAWN */
+    u32               proc_quantum;
+    struct GThreads*  threads;    /* NULL hasta el primer SYS_THREAD_START */
+    const struct MvSysTable* systab; /* NULL = solo las llamadas propias (systab.h) */
+
     const char* opt_vmx_path;
     const char* opt_vmi_path;
     int  have_vmx;
@@ -59,14 +109,83 @@ typedef struct {
     int  argc_on_stack;
 
     u16  code_size;           
+
+    VmIo    io;
+    u16     sys_resume;       /* celda de SYS 1 en la que se bloqueó la lectura */
+    bool    sys_waiting;      /* SYS 1/3 suspendido esperando entrada */
+    bool    nondet;           /* usó RND, el reloj, SYS 0xF, procesos o hilos (rescache.h) */
+    uint64_t rng;             /* estado de RND (xorshift64*); 0 = se siembra con el reloj */
+    VmLimits limits;
+    VmStats stats;
 } VM;
 
+/* programa VMX ya leído; se puede montar en varias VM (solo lectura) */
+typedef struct {
+    int version;
+    u16 code_sz, data_sz, extra_sz, stack_sz, const_sz, entry_off;
+    u8* code;                 /* code_sz bytes */
+    u8* konst;                /* const_sz bytes, a continuación del código */
+} VmxImage;
+
 void vm_init(VM* vm, bool disassemble);
 
+/* vm_init para un trabajo: vmx_path con argc parámetros y ram_kib de ram */
+void vm_init_job(VM* vm, u32 ram_kib, const char* vmx_path, int argc);
+
+/* RND reproducible: la misma semilla da la misma secuencia */
+void vm_seed(VM* vm, uint64_t seed);
+
+/* libera lo que la propia ejecución crea (regiones, procesos, hilos) */
+void vm_release(VM* vm);
+
 bool vm_load(VM* vm, char** params, int argc);
 
+bool vmx_image_read(const char* path, VmxImage* img);
+
+/* como vmx_image_read pero desde un .vmx ya en memoria (se copia) */
+bool vmx_image_from_buffer(const void* data, size_t len, VmxImage* img);
+
+void vmx_image_free(VmxImage* img);
+
+bool vm_load_image(VM* vm, const VmxImage* img, char** params, int argc);
+
+/* como vm_load_image pero los segmentos se ubican en ram[base, limit) */
+bool vm_load_image_at(VM* vm, const VmxImage* img, char** params, int argc, u32 base, u32 limit);
+
 int  vm_run(VM* vm);
 
+typedef enum {
+    VM_HALTED    = 0,   /* STOP o fin del segmento de código */
+    VM_FAULT     = 1,   /* error (ya informado en stderr) */
+    VM_PREEMPTED = 2,   /* se agotó el presupuesto de instrucciones */
+    VM_BLOCKED   = 3,   /* SYS 1/3 sin entrada disponible (VMIO_AGAIN) */
+    VM_SWITCH    = 4,   /* interno: cambio de proceso invitado (procs.h) */
+    VM_LIMIT     = 5    /* se superó una cuota (vm->limits.hit) */
+} VmExit;
+
+/* código de salida del proceso para un VmExit terminal: 0, 1 o VM_RC_LIMIT */
+int vm_exit_rc(VmExit r);
+
+/* ns que quedan de la cuota de tiempo; UINT64_MAX si no hay. Para que una
+   espera del invitado (SYS_SLEEP) no pase por encima de --max-time */
+uint64_t vm_wall_left(const VM* vm);
+
+/* duerme hasta ns pero no más que la cuota de tiempo; false = la agotó
+   (vm->limits.hit queda en VM_LIMIT_WALL) */
+bool vm_sleep_limited(VM* vm, uint64_t ns);
+
+/* ejecuta como máximo max_insns instrucciones; se puede volver a llamar para continuar.
+   No abre la traza: si vm->trace está puesta se usa. */
+VmExit vm_run_for(VM* vm, uint64_t max_insns);
+
+/* llama a la subrutina en CS:entry como lo haría CALL: los nargs argumentos
+   van a la pila (args[0] en [SP+4] al entrar) y la dirección de retorno es el
+   fin del código, así que el RET que le corresponde termina la corrida.
+   VM_HALTED = volvió y *result tiene EAX; con cualquier otro resultado la
+   llamada se abandona (VM_PREEMPTED = no volvió en max_insns, 0 = sin tope).
+   Los registros quedan siempre como estaban; la memoria no se restaura. */
+VmExit vm_call(VM* vm, u16 entry, const u32* args, int nargs, uint64_t max_insns, u32* result);
+
 bool vm_save_vmi(VM* vm, const char* path);
 
 bool vm_load_vmi(VM* vm, const char* path);
@@ -0,0 +1,119 @@
+#include "vmio.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int stdio_read_line(void* ctx, char* buf, size_t cap){
+    FILE* f = (FILE*)ctx;
+    if (!f || !fgets(buf, (int)cap, f)){
+        if (f) clearerr(f);
+        buf[0] = 0;
+        return VMIO_EOF;
+    }
+    return VMIO_OK;
+}
+
+/* como fgets: hasta '\n' o cap-1 bytes */
+static int inbuf_read_line(void* ctx, char* buf, size_t cap){
+    VmInBuf* in = (VmInBuf*)ctx;
+    size_t n = 0;
+    while (in->pos < in->len && n + 1 < cap){
+        char ch = in->data[in->pos++];
+        buf[n++] = ch;
+        if (ch == '\n') break;
+    }
+    buf[n] = 0;
+    return n ? VMIO_OK : VMIO_EOF;
+}
+
+static void stdio_write(void* ctx, const char* data, size_t n){
+    if (ctx) fwrite(data, 1, n, (FILE*)ctx);
+}
+
+static void stdio_flush(void* ctx){
+    if (ctx) fflush((FILE*)ctx);
+}
+
+static void outbuf_write(void* ctx, const char* data, size_t n){
+    VmOutBuf* b = (VmOutBuf*)ctx;
+    if (b->len + n > b->cap){
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < b->len + n) cap *= 2;
+        char* p = (char*)realloc(b->data, cap);
+        if (!p) return;
+        b->data = p;
+        b->cap  = cap;
+    }
+    memcpy(b->data + b->len, data, n);
+    b->len += n;
+}
+
+void vmio_stdio(VmIo* io, FILE* in, FILE* out){
+    io->read_line = stdio_read_line;
+    io->write     = stdio_write;
+    io->flush     = stdio_flush;
+    io->in_ctx    = in;
+    io->out_ctx   = out;
+}
+
+void vmio_input(VmIo* io, VmInBuf* in){
+    io->read_line = inbuf_read_line;
+    io->in_ctx    = in;
+}
+
+void vmio_capture(VmIo* io, VmOutBuf* out){
+    io->write   = outbuf_write;
+    io->flush   = NULL;
+    io->out_ctx = out;
+}
+
+void vmio_outbuf_free(VmOutBuf* b){
+    free(b->data);
+    b->data = NULL;
+    b->len = b->cap = 0;
+}
+
+char* vmio_read_all(FILE* f, size_t* n){
+    char* data = NULL;
+    size_t len = 0, cap = 0;
+    for (;;){
+        if (len == cap){
+            cap = cap ? cap * 2 : 65536;
+            char* p = (char*)realloc(data, cap);
+            if (!p){ free(data); return NULL; }
+            data = p;
+        }
+        size_t r = fread(data + len, 1, cap - len, f);
+        len += r;
+        if (r == 0) break;
+    }
+    *n = len;
+    return data;
+}
+
+int vmio_read_line(VmIo* io, char* buf, size_t cap){
+    return io->read_line(io->in_ctx, buf, cap);
+}
+
+void vmio_write(VmIo* io, const char* data, size_t n){
+    io->written += n;
+    io->write(io->out_ctx, data, n);
+}
+
+void vmio_putc(VmIo* io, int ch){
+    char c = (char)ch;
+    io->written++;
+    io->write(io->out_ctx, &c, 1);
+}
+
+void vmio_printf(VmIo* io, const char* fmt, ...){
+    char buf[128];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof buf, fmt, ap);
+    va_end(ap);
+    if (n <= 0) return;
+    if ((size_t)n >= sizeof buf) n = (int)sizeof buf - 1;
+    io->written += (unsigned)n;
+    io->write(io->out_ctx, buf, (size_t)n);
+}
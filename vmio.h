@@ -0,0 +1,55 @@
+#pragma once
+#include <stddef.h>
+#include <stdio.h>
+
+/* E/S del invitado (SYS 1/2/3/4/7 y el prompt de SYS 0xF).
+   Por defecto va a stdin/stdout; el modo batch la redirige por trabajo. */
+
+/* VMIO_AGAIN: todavía no hay una línea completa; SYS 1/3 suspenden la VM
+   (vm_run_for devuelve VM_BLOCKED) y la instrucción se repite al continuar */
+enum { VMIO_OK = 0, VMIO_EOF = -1, VMIO_AGAIN = -2 };
+
+typedef struct VmIo {
+    /* deja en buf una línea terminada en '\0' (puede incluir el '\n') */
+    int  (*read_line)(void* ctx, char* buf, size_t cap);
+    void (*write)(void* ctx, const char* data, size_t n);
+    void (*flush)(void* ctx);
+    void* in_ctx;
+    void* out_ctx;
+    unsigned long long written;   /* bytes escritos por el invitado (cuota de salida) */
+} VmIo;
+
+/* salida acumulada en memoria */
+typedef struct {
+    char*  data;
+    size_t len;
+    size_t cap;
+} VmOutBuf;
+
+/* entrada ya leída en memoria (no se copia) */
+typedef struct {
+    const char* data;
+    size_t      len;
+    size_t      pos;
+} VmInBuf;
+
+void vmio_stdio(VmIo* io, FILE* in, FILE* out);
+void vmio_input(VmIo* io, VmInBuf* in);
+void vmio_capture(VmIo* io, VmOutBuf* out);
+void vmio_outbuf_free(VmOutBuf* b);
+
+/* lee f hasta el final en un bloque de malloc; NULL si no hay memoria */
+char* vmio_read_all(FILE* f, size_t* n);
+
+int  vmio_read_line(VmIo* io, char* buf, size_t cap);
+void vmio_write(VmIo* io, const char* data, size_t n);
+void vmio_putc(VmIo* io, int ch);
+void vmio_printf(VmIo* io, const char* fmt, ...)
+#if defined(__GNUC__)
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+
+static inline void vmio_flush(VmIo* io){
+    if (io->flush) io->flush(io->out_ctx);
+}